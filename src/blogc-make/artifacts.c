@@ -0,0 +1,268 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "../common/error.h"
+#include "../common/file.h"
+#include "../common/utils.h"
+#include "artifacts.h"
+#include "exec.h"
+#include "jobs.h"
+#include "manifest.h"
+
+#ifndef PACKAGE_STRING
+#define PACKAGE_STRING "blogc Unknown"
+#endif
+
+// the artifact cache is a directory shared by builds of the same site, e.g.
+// in different CI runners, that stores the rendered outputs by a hash of
+// everything used to render them: the content of the sources and templates,
+// the variables and the blogc version. outputs that would be rebuilt are
+// restored from it without rendering, if found.
+//
+// the key is the full text of these inputs, and artifacts are stored as
+// <dir>/<first 2 hex digits>/<remaining hex digits> of its hash. the key is
+// stored in the artifact, before the output, and compared on lookup, so hash
+// collisions are misses instead of restoring the wrong output. artifacts are
+// written to temporary files that are renamed into place, so concurrent builds
+// sharing the directory never see a partial artifact.
+
+
+// returns the version of the blogc binary, as printed by 'blogc -v', or
+// NULL on error. NULL blogc means the in-process blogc.
+static char*
+blogc_version(const char *blogc)
+{
+    if (blogc == NULL)
+        return bc_strdup(PACKAGE_STRING);
+
+    char *const argv[] = {(char*) blogc, "-v", NULL};
+    char *out = NULL;
+    char *out_err = NULL;
+    bc_error_t *err = NULL;
+    int status = bm_exec_command(argv, NULL, NULL, &out, &out_err, &err);
+    free(out_err);
+    if (err != NULL || status != 0 || out == NULL) {
+        bc_error_free(err);
+        free(out);
+        return NULL;
+    }
+
+    char *rv = bc_strdup(bc_str_strip(out));
+    free(out);
+    return rv;
+}
+
+
+bm_artifacts_t*
+bm_artifacts_new(const char *dir, const char *blogc)
+{
+    if (dir == NULL)
+        return NULL;
+
+    // the version is read once, and is part of all the keys.
+    char *version = blogc_version(blogc);
+    if (version == NULL) {
+        fprintf(stderr, "blogc-make: warning: failed to get the version of "
+            "blogc (%s), artifact cache disabled\n", blogc);
+        return NULL;
+    }
+
+    bm_artifacts_t *rv = bc_malloc(sizeof(bm_artifacts_t));
+    rv->dir = bc_strdup(dir);
+    rv->blogc_version = version;
+    rv->hits = 0;
+    rv->misses = 0;
+    pthread_mutex_init(&rv->mutex, NULL);
+    return rv;
+}
+
+
+void
+bm_artifacts_free(bm_artifacts_t *artifacts)
+{
+    if (artifacts == NULL)
+        return;
+    free(artifacts->dir);
+    free(artifacts->blogc_version);
+    pthread_mutex_destroy(&artifacts->mutex);
+    free(artifacts);
+}
+
+
+static void
+append_inputs(bc_string_t *str, char type, bc_slist_t *inputs)
+{
+    for (bc_slist_t *l = inputs; l != NULL; l = l->next) {
+        bm_manifest_input_t *input = l->data;
+
+        // the compressed sidecars don't change the rendered output.
+        if (0 == strcmp(input->path, ":compress"))
+            continue;
+
+        bc_string_append_printf(str, "%c %016" PRIx64 " %s\n", type,
+            input->hash, input->path);
+    }
+}
+
+
+// the manifest entry already records everything an output depends on, but
+// the blogc version, that is included. the key is terminated by an empty
+// line, and must be freed by the caller.
+char*
+bm_artifacts_key(bm_artifacts_t *artifacts, bm_manifest_entry_t *entry)
+{
+    if (artifacts == NULL)
+        return NULL;
+    bc_string_t *rv = bc_string_new();
+    bc_string_append_printf(rv, "blogc %s\n", artifacts->blogc_version);
+    if (entry != NULL) {
+        bc_string_append_printf(rv, "V %016" PRIx64 "\n", entry->variables);
+        append_inputs(rv, 'I', entry->inputs);
+        append_inputs(rv, 'M', entry->members);
+    }
+    bc_string_append_c(rv, '\n');
+    return bc_string_free(rv, false);
+}
+
+
+static char*
+artifact_path(bm_artifacts_t *artifacts, const char *key)
+{
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016" PRIx64, bc_hash_str(key));
+    return bc_strdup_printf("%s/%.2s/%s", artifacts->dir, hex, hex + 2);
+}
+
+
+static void
+count(bm_artifacts_t *artifacts, bool hit)
+{
+    pthread_mutex_lock(&artifacts->mutex);
+    if (hit)
+        artifacts->hits++;
+    else
+        artifacts->misses++;
+    pthread_mutex_unlock(&artifacts->mutex);
+}
+
+
+// returns the content of the artifact, or NULL if not found or stored with
+// another key.
+char*
+bm_artifacts_lookup(bm_artifacts_t *artifacts, const char *key, size_t *len)
+{
+    if (artifacts == NULL || key == NULL)
+        return NULL;
+
+    char *path = artifact_path(artifacts, key);
+    bc_error_t *err = NULL;
+    size_t rv_len = 0;
+    char *rv = bc_file_get_contents(path, false, &rv_len, &err);
+    free(path);
+    if (err != NULL) {
+        bc_error_free(err);
+        rv = NULL;
+    }
+
+    size_t key_len = strlen(key);
+    if (rv != NULL && (rv_len < key_len || 0 != memcmp(rv, key, key_len))) {
+        free(rv);
+        rv = NULL;
+    }
+
+    if (rv != NULL) {
+        *len = rv_len - key_len;
+        memmove(rv, rv + key_len, *len + 1);
+    }
+    count(artifacts, rv != NULL);
+    return rv;
+}
+
+
+// failing to store an artifact is not an error, the output was built anyway.
+void
+bm_artifacts_store(bm_artifacts_t *artifacts, const char *key,
+    const char *output)
+{
+    if (artifacts == NULL || key == NULL || output == NULL)
+        return;
+
+    size_t len;
+    bc_error_t *err = NULL;
+    char *content = bc_file_get_contents(output, false, &len, &err);
+    if (err != NULL) {
+        bc_error_free(err);
+        return;
+    }
+
+    char *path = artifact_path(artifacts, key);
+    char *tmp = bc_strdup_printf("%s.XXXXXX", path);
+
+    // the cache directory is created on demand, with the subdirectory.
+    char *sep = strrchr(path, '/');
+    *sep = '\0';
+    if ((0 != mkdir(artifacts->dir, 0777) && errno != EEXIST) ||
+        (0 != mkdir(path, 0777) && errno != EEXIST))
+    {
+        bm_jobs_eprintf("blogc-make: warning: failed to create artifact cache "
+            "directory (%s): %s\n", path, strerror(errno));
+        goto cleanup;
+    }
+    *sep = '/';
+
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        bm_jobs_eprintf("blogc-make: warning: failed to store artifact (%s): "
+            "%s\n", path, strerror(errno));
+        goto cleanup;
+    }
+
+    // mkstemp(3) creates the file readable only by the owner, but the cache
+    // may be shared.
+    fchmod(fd, 0644);
+
+    size_t key_len = strlen(key);
+    bool ok = key_len == (size_t) write(fd, key, key_len) &&
+        (len == 0 || len == (size_t) write(fd, content, len));
+    if (0 != close(fd) || !ok || 0 != rename(tmp, path)) {
+        bm_jobs_eprintf("blogc-make: warning: failed to store artifact (%s): "
+            "%s\n", path, strerror(errno));
+        unlink(tmp);
+    }
+
+cleanup:
+    free(tmp);
+    free(path);
+    free(content);
+}
+
+
+void
+bm_artifacts_print_stats(bm_artifacts_t *artifacts)
+{
+    if (artifacts == NULL || artifacts->hits + artifacts->misses == 0)
+        return;
+    printf("Artifact cache: %zu hits, %zu misses\n", artifacts->hits,
+        artifacts->misses);
+}
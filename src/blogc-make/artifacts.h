@@ -0,0 +1,35 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#ifndef _MAKE_ARTIFACTS_H
+#define _MAKE_ARTIFACTS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "manifest.h"
+
+typedef struct {
+    char *dir;
+    char *blogc_version;
+    size_t hits;
+    size_t misses;
+    pthread_mutex_t mutex;
+} bm_artifacts_t;
+
+bm_artifacts_t* bm_artifacts_new(const char *dir, const char *blogc);
+void bm_artifacts_free(bm_artifacts_t *artifacts);
+char* bm_artifacts_key(bm_artifacts_t *artifacts, bm_manifest_entry_t *entry);
+char* bm_artifacts_lookup(bm_artifacts_t *artifacts, const char *key,
+    size_t *len);
+void bm_artifacts_store(bm_artifacts_t *artifacts, const char *key,
+    const char *output);
+void bm_artifacts_print_stats(bm_artifacts_t *artifacts);
+
+#endif /* _MAKE_ARTIFACTS_H */
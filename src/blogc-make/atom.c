@@ -6,10 +6,12 @@
  * See the file LICENSE.
  */
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include "../blogc/template-parser.h"
 #include "../common/error.h"
 #include "../common/utils.h"
 #include "settings.h"
@@ -85,18 +87,50 @@ bm_atom_generate(bm_settings_t *settings)
 }
 
 
+static bool
+atom_check(bm_settings_t *settings, bc_error_t **err)
+{
+    if (NULL != bc_trie_lookup(settings->settings, "atom_legacy_entry_id")) {
+        *err = bc_error_new_printf(BLOGC_MAKE_ERROR_ATOM,
+            "'atom_legacy_entry_id' setting is not supported anymore. see "
+            "https://blogc.rgm.io/news/blogc-0.16.1/ for details");
+        return false;
+    }
+    return true;
+}
+
+
+// returns the parsed atom template, to be rendered directly when blogc is
+// running in-process. the hash of the generated template is returned in
+// `hash`, to detect changes.
+bc_slist_t*
+bm_atom_parse(bm_settings_t *settings, uint64_t *hash, bc_error_t **err)
+{
+    if (settings == NULL || hash == NULL || err == NULL || *err != NULL)
+        return NULL;
+
+    if (!atom_check(settings, err))
+        return NULL;
+
+    char *content = bm_atom_generate(settings);
+    if (content == NULL)
+        return NULL;
+
+    *hash = bc_hash_str(content);
+    bc_slist_t *rv = blogc_template_parse(content, strlen(content), err);
+    free(content);
+    return rv;
+}
+
+
 char*
 bm_atom_deploy(bm_settings_t *settings, bc_error_t **err)
 {
     if (settings == NULL || err == NULL || *err != NULL)
         return NULL;
 
-    if (NULL != bc_trie_lookup(settings->settings, "atom_legacy_entry_id")) {
-        *err = bc_error_new_printf(BLOGC_MAKE_ERROR_ATOM,
-            "'atom_legacy_entry_id' setting is not supported anymore. see "
-            "https://blogc.rgm.io/news/blogc-0.16.1/ for details");
+    if (!atom_check(settings, err))
         return NULL;
-    }
 
     // this is not really portable
     char fname[] = "/tmp/blogc-make_XXXXXX";
@@ -9,10 +9,14 @@
 #ifndef _MAKE_ATOM_H
 #define _MAKE_ATOM_H
 
+#include <stdint.h>
 #include "../common/error.h"
+#include "../common/utils.h"
 #include "settings.h"
 
 char* bm_atom_generate(bm_settings_t *settings);
+bc_slist_t* bm_atom_parse(bm_settings_t *settings, uint64_t *hash,
+    bc_error_t **err);
 char* bm_atom_deploy(bm_settings_t *settings, bc_error_t **err);
 void bm_atom_destroy(const char *fname);
 
@@ -0,0 +1,494 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../blogc/loader.h"
+#include "../blogc/template-cache.h"
+#include "../blogc/template-parser.h"
+#include "../common/error.h"
+#include "../common/file.h"
+#include "../common/utils.h"
+#include "ctx.h"
+#include "cache.h"
+
+
+static void
+cache_entry_free(bm_cache_entry_t *entry)
+{
+    if (entry == NULL)
+        return;
+    bc_trie_free(entry->source);
+    free(entry->toctree_maxdepth);
+    free(entry);
+}
+
+
+static void
+cache_dir_free(bm_cache_dir_t *dir)
+{
+    if (dir == NULL)
+        return;
+    for (size_t i = 0; i < dir->len; i++)
+        free(dir->entries[i].name);
+    free(dir->entries);
+    free(dir);
+}
+
+
+void
+bm_cache_template_vars_free(bm_cache_template_vars_t *vars)
+{
+    if (vars == NULL)
+        return;
+    bc_trie_free(vars->names);
+    bc_slist_free_full(vars->prefixes, free);
+    free(vars);
+}
+
+
+typedef struct {
+    bc_slist_t *ast;
+    bm_cache_template_vars_t *vars;
+} template_vars_entry_t;
+
+
+static void
+template_vars_entry_free(template_vars_entry_t *entry)
+{
+    if (entry == NULL)
+        return;
+    bm_cache_template_vars_free(entry->vars);
+    free(entry);
+}
+
+
+bm_cache_t*
+bm_cache_new(void)
+{
+    bm_cache_t *rv = bc_malloc(sizeof(bm_cache_t));
+    rv->entries = bc_trie_new((bc_free_func_t) cache_entry_free);
+    rv->metadata = bc_trie_new((bc_free_func_t) cache_entry_free);
+    rv->snapshots = bc_trie_new((bc_free_func_t) cache_dir_free);
+    rv->templates = blogc_template_cache_new();
+    rv->variables = bc_trie_new((bc_free_func_t) template_vars_entry_free);
+    rv->dirs = bc_trie_new(NULL);
+    rv->stale = NULL;
+    pthread_mutex_init(&rv->mutex, NULL);
+    return rv;
+}
+
+
+void
+bm_cache_free(bm_cache_t *cache)
+{
+    if (cache == NULL)
+        return;
+    bc_trie_free(cache->entries);
+    bc_trie_free(cache->metadata);
+    bc_trie_free(cache->snapshots);
+    blogc_template_cache_free(cache->templates);
+    bc_trie_free(cache->variables);
+    bc_trie_free(cache->dirs);
+    bc_slist_free_full(cache->stale, (bc_free_func_t) bc_trie_free);
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache);
+}
+
+
+static bool
+str_equal(const char *a, const char *b)
+{
+    if (a == NULL || b == NULL)
+        return a == b;
+    return 0 == strcmp(a, b);
+}
+
+
+static bool
+entry_fresh(bm_cache_entry_t *entry, struct stat *buf)
+{
+    return entry != NULL && entry->tv_sec == buf->st_mtim_tv_sec &&
+        entry->tv_nsec == buf->st_mtim_tv_nsec && entry->size == buf->st_size;
+}
+
+
+static bool
+entry_valid(bm_cache_entry_t *entry, struct stat *buf, const char *maxdepth)
+{
+    return entry_fresh(entry, buf) &&
+        str_equal(entry->toctree_maxdepth, maxdepth);
+}
+
+
+// must be called with the lock held.
+static bc_trie_t*
+entry_store(bm_cache_t *cache, bc_trie_t *entries, const char *path,
+    bc_trie_t *s, const char *maxdepth, struct stat *buf)
+{
+    bm_cache_entry_t *entry = bc_trie_lookup(entries, path);
+    if (entry_valid(entry, buf, maxdepth)) {
+        // someone else parsed it in the meantime
+        bc_trie_free(s);
+        return entry->source;
+    }
+
+    if (entry == NULL) {
+        entry = bc_malloc(sizeof(bm_cache_entry_t));
+        entry->toctree_maxdepth = NULL;
+        bc_trie_insert(entries, path, entry);
+    }
+    else {
+        // other jobs may still be using the stale source, keep it around.
+        cache->stale = bc_slist_append(cache->stale, entry->source);
+        free(entry->toctree_maxdepth);
+    }
+
+    entry->source = s;
+    entry->toctree_maxdepth = bc_strdup(maxdepth);
+    entry->tv_sec = buf->st_mtim_tv_sec;
+    entry->tv_nsec = buf->st_mtim_tv_nsec;
+    entry->size = buf->st_size;
+    return s;
+}
+
+
+static int
+stat_source(const char *path, struct stat *buf, bc_error_t **err)
+{
+    if (0 != stat(path, buf)) {
+        int tmp_errno = errno;
+        *err = bc_error_new_printf(BC_ERROR_FILE,
+            "Failed to open file (%s): %s", path, strerror(tmp_errno));
+        return 1;
+    }
+    return 0;
+}
+
+
+// returns the parsed source for the given path, parsing it only if it was
+// never seen before or if its mtime/size changed. the returned trie is owned
+// by the cache and must not be modified or freed by the caller. it is valid
+// at least until the next call to bm_cache_purge().
+//
+// this function can be called from concurrent jobs. sources are parsed
+// without holding the lock, so a source may be parsed twice if requested by
+// two jobs at the same time, but only the first result is kept.
+bc_trie_t*
+bm_cache_get_source(bm_cache_t *cache, bc_trie_t *conf, const char *path,
+    bc_error_t **err)
+{
+    if (cache == NULL || path == NULL || err == NULL || *err != NULL)
+        return NULL;
+
+    struct stat buf;
+    if (0 != stat_source(path, &buf, err))
+        return NULL;
+
+    // the source parser uses this variable, so it is part of the key.
+    const char *maxdepth = bc_trie_lookup(conf, "TOCTREE_MAXDEPTH");
+
+    pthread_mutex_lock(&cache->mutex);
+    bm_cache_entry_t *entry = bc_trie_lookup(cache->entries, path);
+    if (entry_valid(entry, &buf, maxdepth)) {
+        bc_trie_t *rv = entry->source;
+        pthread_mutex_unlock(&cache->mutex);
+        return rv;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    bc_trie_t *s = blogc_source_parse_from_file(conf, path, err);
+    if (s == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&cache->mutex);
+    bc_trie_t *rv = entry_store(cache, cache->entries, path, s, maxdepth, &buf);
+    pthread_mutex_unlock(&cache->mutex);
+    return rv;
+}
+
+
+// returns the metadata of the source for the given path, that is enough to
+// filter and paginate sources, without parsing its content. if the whole
+// source was already parsed, it is returned instead. same ownership and
+// locking rules of bm_cache_get_source() apply.
+bc_trie_t*
+bm_cache_get_metadata(bm_cache_t *cache, const char *path, bc_error_t **err)
+{
+    if (cache == NULL || path == NULL || err == NULL || *err != NULL)
+        return NULL;
+
+    struct stat buf;
+    if (0 != stat_source(path, &buf, err))
+        return NULL;
+
+    pthread_mutex_lock(&cache->mutex);
+    bm_cache_entry_t *entry = bc_trie_lookup(cache->entries, path);
+    if (!entry_fresh(entry, &buf)) {
+        entry = bc_trie_lookup(cache->metadata, path);
+        if (!entry_fresh(entry, &buf))
+            entry = NULL;
+    }
+    if (entry != NULL) {
+        bc_trie_t *rv = entry->source;
+        pthread_mutex_unlock(&cache->mutex);
+        return rv;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    bc_trie_t *s = blogc_source_parse_metadata_from_file(path, err);
+    if (s == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&cache->mutex);
+    bc_trie_t *rv = entry_store(cache, cache->metadata, path, s, NULL, &buf);
+    pthread_mutex_unlock(&cache->mutex);
+    return rv;
+}
+
+
+// returns the parsed template for the given path. templates are few and
+// rarely change, then they are parsed with the lock held. same ownership
+// rules of bm_cache_get_source() apply.
+bc_slist_t*
+bm_cache_get_template(bm_cache_t *cache, const char *path, bc_error_t **err)
+{
+    if (cache == NULL || path == NULL || err == NULL || *err != NULL)
+        return NULL;
+
+    pthread_mutex_lock(&cache->mutex);
+    bc_slist_t *rv = blogc_template_cache_get(cache->templates, path, err);
+    pthread_mutex_unlock(&cache->mutex);
+    return rv;
+}
+
+
+static void
+vars_add(bm_cache_template_vars_t *vars, const char *name)
+{
+    if (name == NULL)
+        return;
+
+    bc_trie_insert(vars->names, name, (void*) 1);
+
+    // same lookups done by blogc_format_variable(): the variable name as is,
+    // then without the "_N" length suffix, and without the "_FORMATTED"
+    // suffix, that also reads DATE_FORMAT.
+    char *var = bc_strdup(name);
+    size_t len = strlen(var);
+    size_t i;
+    for (i = len - 1; i > 0 && var[i] >= '0' && var[i] <= '9'; i--);
+    if (var[i] == '_' && i + 1 < len) {
+        var[i] = '\0';
+        bc_trie_insert(vars->names, var, (void*) 1);
+    }
+    if (bc_str_ends_with(var, "_FORMATTED")) {
+        var[strlen(var) - 10] = '\0';
+        bc_trie_insert(vars->names, var, (void*) 1);
+        bc_trie_insert(vars->names, "DATE_FORMAT", (void*) 1);
+    }
+    free(var);
+}
+
+
+// lists the variables an output may read from the template AST: the ones
+// referenced by the nodes outside of blocks and by the blocks rendered for
+// the kind of output (listing or not), and the ones always read by blogc.
+// FOREACH_VALUE reads any variable named after the items of the foreach
+// variable, so these are matched by prefix.
+bm_cache_template_vars_t*
+bm_cache_template_vars_new(bc_slist_t *ast, bool listing)
+{
+    bm_cache_template_vars_t *rv = bc_malloc(sizeof(bm_cache_template_vars_t));
+    rv->names = bc_trie_new(NULL);
+    rv->prefixes = bc_slist_append(NULL, bc_strdup("FILTER_"));
+    bc_trie_insert(rv->names, "TOCTREE_MAXDEPTH", (void*) 1);
+
+    bool skip = false;
+    for (bc_slist_t *l = ast; l != NULL; l = l->next) {
+        blogc_template_node_t *node = l->data;
+        switch (node->type) {
+            case BLOGC_TEMPLATE_NODE_BLOCK:
+                skip = listing == (0 == strcmp(node->data[0], "entry"));
+                break;
+            case BLOGC_TEMPLATE_NODE_ENDBLOCK:
+                skip = false;
+                break;
+            case BLOGC_TEMPLATE_NODE_FOREACH:
+                if (!skip) {
+                    vars_add(rv, node->data[0]);
+                    rv->prefixes = bc_slist_append(rv->prefixes,
+                        bc_strdup_printf("%s__", node->data[0]));
+                }
+                break;
+            case BLOGC_TEMPLATE_NODE_IF:
+                if (skip)
+                    break;
+                vars_add(rv, node->data[0]);
+                // quoted operands are strings, not variables.
+                if (node->data[1] != NULL && node->data[1][0] != '"')
+                    vars_add(rv, node->data[1]);
+                break;
+            case BLOGC_TEMPLATE_NODE_IFDEF:
+            case BLOGC_TEMPLATE_NODE_IFNDEF:
+            case BLOGC_TEMPLATE_NODE_VARIABLE:
+                if (!skip)
+                    vars_add(rv, node->data[0]);
+                break;
+            default:
+                break;
+        }
+    }
+    return rv;
+}
+
+
+bool
+bm_cache_template_vars_contains(bm_cache_template_vars_t *vars,
+    const char *name)
+{
+    if (vars == NULL)
+        return true;
+    if (NULL != bc_trie_lookup(vars->names, name))
+        return true;
+    for (bc_slist_t *l = vars->prefixes; l != NULL; l = l->next)
+        if (bc_str_starts_with(name, l->data))
+            return true;
+    return false;
+}
+
+
+// returns the variables read by outputs rendered with the given template,
+// cached until the template changes. same ownership rules of
+// bm_cache_get_source() apply.
+bm_cache_template_vars_t*
+bm_cache_get_template_vars(bm_cache_t *cache, const char *path, bool listing,
+    bc_error_t **err)
+{
+    if (cache == NULL || path == NULL || err == NULL || *err != NULL)
+        return NULL;
+
+    char *key = bc_strdup_printf("%c%s", listing ? 'L' : 'E', path);
+
+    pthread_mutex_lock(&cache->mutex);
+    bm_cache_template_vars_t *rv = NULL;
+    bc_slist_t *ast = blogc_template_cache_get(cache->templates, path, err);
+    if (ast != NULL) {
+        template_vars_entry_t *entry = bc_trie_lookup(cache->variables, key);
+        if (entry == NULL || entry->ast != ast) {
+            entry = bc_malloc(sizeof(template_vars_entry_t));
+            entry->ast = ast;
+            entry->vars = bm_cache_template_vars_new(ast, listing);
+            bc_trie_insert(cache->variables, key, entry);
+        }
+        rv = entry->vars;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    free(key);
+    return rv;
+}
+
+
+// returns the entries of a directory from the last scan, if its mtime didn't
+// change since then, i.e. no entries were added, removed or renamed. the
+// result is owned by the cache, and is valid until the next call to
+// bm_cache_set_dir() for the same path.
+bm_cache_dir_t*
+bm_cache_get_dir(bm_cache_t *cache, const char *path, struct stat *st)
+{
+    if (cache == NULL || path == NULL || st == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&cache->mutex);
+    bm_cache_dir_t *rv = bc_trie_lookup(cache->snapshots, path);
+    if (rv != NULL && (rv->tv_sec != st->st_mtim_tv_sec ||
+        rv->tv_nsec != st->st_mtim_tv_nsec))
+        rv = NULL;
+    pthread_mutex_unlock(&cache->mutex);
+    return rv;
+}
+
+
+// stores the entries of a directory. the cache takes ownership of the
+// entries.
+bm_cache_dir_t*
+bm_cache_set_dir(bm_cache_t *cache, const char *path, struct stat *st,
+    bm_cache_dirent_t *entries, size_t len)
+{
+    if (cache == NULL || path == NULL || st == NULL)
+        return NULL;
+
+    bm_cache_dir_t *rv = bc_malloc(sizeof(bm_cache_dir_t));
+    rv->entries = entries;
+    rv->len = len;
+    rv->tv_sec = st->st_mtim_tv_sec;
+    rv->tv_nsec = st->st_mtim_tv_nsec;
+
+    pthread_mutex_lock(&cache->mutex);
+    bc_trie_insert(cache->snapshots, path, rv);
+    pthread_mutex_unlock(&cache->mutex);
+    return rv;
+}
+
+
+// output directories already created during the current build, to avoid
+// calling mkdir(2) for every component of every output path.
+bool
+bm_cache_has_dir(bm_cache_t *cache, const char *dir)
+{
+    if (cache == NULL || dir == NULL)
+        return false;
+
+    pthread_mutex_lock(&cache->mutex);
+    bool rv = NULL != bc_trie_lookup(cache->dirs, dir);
+    pthread_mutex_unlock(&cache->mutex);
+    return rv;
+}
+
+
+void
+bm_cache_add_dir(bm_cache_t *cache, const char *dir)
+{
+    if (cache == NULL || dir == NULL)
+        return;
+
+    pthread_mutex_lock(&cache->mutex);
+    bc_trie_insert(cache->dirs, dir, (void*) 1);
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+// frees sources replaced by newer versions. must be called when no jobs are
+// running.
+void
+bm_cache_purge(bm_cache_t *cache)
+{
+    if (cache == NULL)
+        return;
+
+    pthread_mutex_lock(&cache->mutex);
+    bc_slist_free_full(cache->stale, (bc_free_func_t) bc_trie_free);
+    cache->stale = NULL;
+    blogc_template_cache_purge(cache->templates);
+
+    // the variables are cached by template AST, and the stale ASTs are gone.
+    bc_trie_free(cache->variables);
+    cache->variables = bc_trie_new((bc_free_func_t) template_vars_entry_free);
+
+    // directories may be removed between builds, e.g. in watch mode.
+    bc_trie_free(cache->dirs);
+    cache->dirs = bc_trie_new(NULL);
+    pthread_mutex_unlock(&cache->mutex);
+}
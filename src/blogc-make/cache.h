@@ -0,0 +1,80 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#ifndef _MAKE_CACHE_H
+#define _MAKE_CACHE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
+#include "../blogc/template-cache.h"
+#include "../common/error.h"
+#include "../common/utils.h"
+
+typedef struct {
+    bc_trie_t *source;
+    char *toctree_maxdepth;
+    time_t tv_sec;
+    long tv_nsec;
+    off_t size;
+} bm_cache_entry_t;
+
+typedef struct {
+    char *name;
+    unsigned char type;  // d_type from readdir(3)
+} bm_cache_dirent_t;
+
+typedef struct {
+    bm_cache_dirent_t *entries;
+    size_t len;
+    time_t tv_sec;
+    long tv_nsec;
+} bm_cache_dir_t;
+
+typedef struct {
+    bc_trie_t *names;
+    bc_slist_t *prefixes;
+} bm_cache_template_vars_t;
+
+typedef struct {
+    bc_trie_t *entries;
+    bc_trie_t *metadata;
+    bc_trie_t *snapshots;
+    blogc_template_cache_t *templates;
+    bc_trie_t *variables;
+    bc_trie_t *dirs;
+    bc_slist_t *stale;
+    pthread_mutex_t mutex;
+} bm_cache_t;
+
+bm_cache_t* bm_cache_new(void);
+void bm_cache_free(bm_cache_t *cache);
+bc_trie_t* bm_cache_get_source(bm_cache_t *cache, bc_trie_t *conf,
+    const char *path, bc_error_t **err);
+bc_trie_t* bm_cache_get_metadata(bm_cache_t *cache, const char *path,
+    bc_error_t **err);
+bc_slist_t* bm_cache_get_template(bm_cache_t *cache, const char *path,
+    bc_error_t **err);
+bm_cache_template_vars_t* bm_cache_template_vars_new(bc_slist_t *ast,
+    bool listing);
+void bm_cache_template_vars_free(bm_cache_template_vars_t *vars);
+bool bm_cache_template_vars_contains(bm_cache_template_vars_t *vars,
+    const char *name);
+bm_cache_template_vars_t* bm_cache_get_template_vars(bm_cache_t *cache,
+    const char *path, bool listing, bc_error_t **err);
+bm_cache_dir_t* bm_cache_get_dir(bm_cache_t *cache, const char *path,
+    struct stat *st);
+bm_cache_dir_t* bm_cache_set_dir(bm_cache_t *cache, const char *path,
+    struct stat *st, bm_cache_dirent_t *entries, size_t len);
+bool bm_cache_has_dir(bm_cache_t *cache, const char *dir);
+void bm_cache_add_dir(bm_cache_t *cache, const char *dir);
+void bm_cache_purge(bm_cache_t *cache);
+
+#endif /* _MAKE_CACHE_H */
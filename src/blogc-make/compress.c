@@ -0,0 +1,331 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../common/error.h"
+#include "../common/file.h"
+#include "../common/utils.h"
+#include "compress.h"
+#include "ctx.h"
+#include "jobs.h"
+#include "settings.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif /* HAVE_ZLIB */
+
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif /* HAVE_BROTLI */
+
+// compressed sidecars (<output>.gz and <output>.br) are written next to the
+// outputs, by the same job that builds them, for web servers that serve
+// precompressed files. they are enabled by the gzip_level and brotli_level
+// settings, for all the rendered outputs and the copied files with one of the
+// extensions listed by the compress_ext setting.
+//
+// sidecars are only written when their output is built, that only happens
+// when the content hashes of its inputs change. changing the settings changes
+// the hash returned by bm_compress_hash(), that is recorded in the manifest
+// entries of the outputs, and rebuilds them with their sidecars.
+
+typedef char* (*compress_func_t) (const char *content, size_t len, int level,
+    size_t *out_len);
+
+typedef struct {
+    const char *setting;
+    const char *ext;
+    int min_level;
+    int max_level;
+    compress_func_t func;
+} compress_format_t;
+
+
+#ifdef HAVE_ZLIB
+
+static char*
+compress_gzip(const char *content, size_t len, int level, size_t *out_len)
+{
+    z_stream strm;
+    memset(&strm, 0, sizeof(z_stream));
+
+    // 16 + MAX_WBITS writes a gzip header, with no file name and no mtime,
+    // so the sidecars are reproducible.
+    if (Z_OK != deflateInit2(&strm, level, Z_DEFLATED, 16 + MAX_WBITS, 8,
+            Z_DEFAULT_STRATEGY))
+        return NULL;
+
+    size_t cap = deflateBound(&strm, len);
+    char *rv = bc_malloc(cap);
+    strm.next_in = (unsigned char*) content;
+    strm.avail_in = len;
+    strm.next_out = (unsigned char*) rv;
+    strm.avail_out = cap;
+
+    if (Z_STREAM_END != deflate(&strm, Z_FINISH)) {
+        deflateEnd(&strm);
+        free(rv);
+        return NULL;
+    }
+
+    *out_len = strm.total_out;
+    deflateEnd(&strm);
+    return rv;
+}
+
+#endif /* HAVE_ZLIB */
+
+
+#ifdef HAVE_BROTLI
+
+static char*
+compress_brotli(const char *content, size_t len, int level, size_t *out_len)
+{
+    size_t cap = BrotliEncoderMaxCompressedSize(len);
+    if (cap == 0)
+        return NULL;
+
+    char *rv = bc_malloc(cap);
+    *out_len = cap;
+    if (!BrotliEncoderCompress(level, BROTLI_DEFAULT_WINDOW,
+            BROTLI_MODE_TEXT, len, (const uint8_t*) content, out_len,
+            (uint8_t*) rv))
+    {
+        free(rv);
+        return NULL;
+    }
+    return rv;
+}
+
+#endif /* HAVE_BROTLI */
+
+
+static const compress_format_t formats[] = {
+#ifdef HAVE_ZLIB
+    {"gzip_level", ".gz", 1, 9, compress_gzip},
+#else
+    {"gzip_level", ".gz", 1, 9, NULL},
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_BROTLI
+    {"brotli_level", ".br", 0, 11, compress_brotli},
+#else
+    {"brotli_level", ".br", 0, 11, NULL},
+#endif /* HAVE_BROTLI */
+    {NULL, NULL, 0, 0, NULL},
+};
+
+
+// returns -1 if the format is disabled. values were validated by
+// bm_compress_check_settings() already.
+static int
+compress_level(bc_trie_t *settings, const compress_format_t *format)
+{
+    const char *value = bc_trie_lookup(settings, format->setting);
+    if (value == NULL || value[0] == '\0')
+        return -1;
+    return strtol(value, NULL, 10);
+}
+
+
+void
+bm_compress_check_settings(bm_settings_t *settings, bc_error_t **err)
+{
+    if (settings == NULL || err == NULL || *err != NULL)
+        return;
+
+    for (size_t i = 0; formats[i].setting != NULL; i++) {
+        const char *value = bc_trie_lookup(settings->settings,
+            formats[i].setting);
+        if (value == NULL || value[0] == '\0')
+            continue;
+
+        char *endptr;
+        long level = strtol(value, &endptr, 10);
+        if (*endptr != '\0' || level < formats[i].min_level ||
+            level > formats[i].max_level)
+        {
+            *err = bc_error_new_printf(BLOGC_MAKE_ERROR_SETTINGS,
+                "Invalid %s (must be between %d and %d): %s",
+                formats[i].setting, formats[i].min_level, formats[i].max_level,
+                value);
+            return;
+        }
+
+        if (formats[i].func == NULL) {
+            *err = bc_error_new_printf(BLOGC_MAKE_ERROR_SETTINGS,
+                "%s set, but blogc-make was built without %s sidecars support",
+                formats[i].setting, formats[i].ext);
+            return;
+        }
+    }
+}
+
+
+static bool
+compress_ext(bm_ctx_t *ctx, bm_filectx_t *output)
+{
+    const char *ext = strrchr(output->short_path, '.');
+    if (ext == NULL || NULL != strchr(ext, '/'))
+        return false;
+
+    char **exts = bc_str_split(bm_ctx_settings_lookup_str(ctx, "compress_ext"),
+        ' ', 0);
+    bool rv = false;
+    for (size_t i = 0; exts[i] != NULL; i++) {
+        if (0 == strcmp(exts[i], ext)) {
+            rv = true;
+            break;
+        }
+    }
+    bc_strv_free(exts);
+    return rv;
+}
+
+
+// returns 0 if no sidecars are written for the output.
+uint64_t
+bm_compress_hash(bm_ctx_t *ctx, bm_filectx_t *output, bool copy)
+{
+    if (ctx == NULL || output == NULL)
+        return 0;
+
+    uint64_t rv = BC_HASH_INIT;
+    bool enabled = false;
+    for (size_t i = 0; formats[i].setting != NULL; i++) {
+        int level = compress_level(ctx->settings->settings, &formats[i]);
+        if (level < 0)
+            continue;
+        enabled = true;
+        rv = bc_hash_update(rv, formats[i].ext, strlen(formats[i].ext) + 1);
+        rv = bc_hash_update(rv, &level, sizeof(int));
+    }
+
+    if (!enabled || (copy && !compress_ext(ctx, output)))
+        return 0;
+    return rv;
+}
+
+
+// writes the enabled sidecars of the output, and removes the disabled ones.
+// sidecars that wouldn't be smaller than the output aren't written.
+int
+bm_compress_sidecars(bm_ctx_t *ctx, bm_filectx_t *output, bool copy)
+{
+    if (ctx == NULL || output == NULL)
+        return 0;
+
+    bool enabled = !copy || compress_ext(ctx, output);
+
+    char *content = NULL;
+    size_t len = 0;
+
+    int rv = 0;
+    for (size_t i = 0; formats[i].setting != NULL; i++) {
+        int level = enabled ? compress_level(ctx->settings->settings,
+            &formats[i]) : -1;
+        char *path = bc_strdup_printf("%s%s", output->path, formats[i].ext);
+
+        char *compressed = NULL;
+        size_t compressed_len = 0;
+        if (level >= 0 && formats[i].func != NULL) {
+            if (content == NULL) {
+                bc_error_t *err = NULL;
+                content = bc_file_get_contents(output->path, false, &len, &err);
+                if (err != NULL) {
+                    bm_jobs_error_print(err);
+                    bc_error_free(err);
+                    free(path);
+                    rv = 1;
+                    break;
+                }
+            }
+            compressed = formats[i].func(content, len, level, &compressed_len);
+            if (compressed == NULL) {
+                bm_jobs_eprintf("blogc-make: error: failed to compress file "
+                    "(%s)\n", path);
+                free(path);
+                rv = 1;
+                break;
+            }
+        }
+
+        if (compressed == NULL || compressed_len >= len) {
+            if (0 != unlink(path) && errno != ENOENT) {
+                bm_jobs_eprintf("blogc-make: error: failed to remove file "
+                    "(%s): %s\n", path, strerror(errno));
+                rv = 1;
+            }
+            free(compressed);
+            free(path);
+            if (rv != 0)
+                break;
+            continue;
+        }
+
+        if (ctx->verbose)
+            bm_jobs_printf("Compressing '%s'\n", path);
+
+        bc_error_t *err = NULL;
+        bc_file_write_if_changed(path, compressed, compressed_len, &err);
+        free(compressed);
+        free(path);
+        if (err != NULL) {
+            bm_jobs_error_print(err);
+            bc_error_free(err);
+            rv = 1;
+            break;
+        }
+    }
+
+    free(content);
+    return rv;
+}
+
+
+// removes the sidecars of an output being removed, if any.
+int
+bm_compress_rm_sidecars(bm_filectx_t *output, bool verbose)
+{
+    if (output == NULL)
+        return 0;
+
+    int rv = 0;
+    for (size_t i = 0; formats[i].setting != NULL; i++) {
+        char *path = bc_strdup_printf("%s%s", output->path, formats[i].ext);
+        if (0 != access(path, F_OK)) {
+            free(path);
+            continue;
+        }
+
+        if (verbose)
+            printf("Removing file '%s'\n", path);
+        else
+            printf("  CLEAN    %s%s\n", output->short_path, formats[i].ext);
+        fflush(stdout);
+
+        if (0 != unlink(path)) {
+            fprintf(stderr, "blogc-make: error: failed to remove file (%s): "
+                "%s\n", path, strerror(errno));
+            rv = 1;
+        }
+        free(path);
+        if (rv != 0)
+            break;
+    }
+    return rv;
+}
@@ -0,0 +1,23 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#ifndef _MAKE_COMPRESS_H
+#define _MAKE_COMPRESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ctx.h"
+#include "settings.h"
+#include "../common/error.h"
+
+void bm_compress_check_settings(bm_settings_t *settings, bc_error_t **err);
+uint64_t bm_compress_hash(bm_ctx_t *ctx, bm_filectx_t *output, bool copy);
+int bm_compress_sidecars(bm_ctx_t *ctx, bm_filectx_t *output, bool copy);
+int bm_compress_rm_sidecars(bm_filectx_t *output, bool verbose);
+
+#endif /* _MAKE_COMPRESS_H */
@@ -10,8 +10,10 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <libgen.h>
 #include <limits.h>
+#include <pthread.h>
 #include <time.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -20,16 +22,49 @@
 #include "../common/error.h"
 #include "../common/file.h"
 #include "../common/utils.h"
+#include "../blogc/template-parser.h"
 #include "atom.h"
+#include "cache.h"
+#include "compress.h"
+#include "jobs.h"
+#include "manifest.h"
 #include "settings.h"
+#include "trace.h"
 #include "exec.h"
 #include "utils.h"
 #include "ctx.h"
 
 
+// lists shorter than this are stat'ed by the calling thread, as starting the
+// threads would cost more than the stat(2) calls themselves.
+#define BM_FILECTX_STAT_MIN 64
+#define BM_FILECTX_STAT_THREADS 16
+
+
+static void
+filectx_stat(bm_filectx_t *fctx, struct stat *st)
+{
+    struct stat buf;
+
+    if (st == NULL) {
+        if (0 != stat(fctx->path, &buf)) {
+            fctx->tv_sec = 0;
+            fctx->tv_nsec = 0;
+            fctx->readable = false;
+            return;
+        }
+        st = &buf;
+    }
+
+    // if it isn't NULL the file exists for sure
+    fctx->tv_sec = st->st_mtim_tv_sec;
+    fctx->tv_nsec = st->st_mtim_tv_nsec;
+    fctx->readable = true;
+}
+
+
 bm_filectx_t*
-bm_filectx_new(bm_ctx_t *ctx, const char *filename, const char *slug,
-    struct stat *st)
+bm_filectx_new_lazy(bm_ctx_t *ctx, const char *filename, const char *slug)
 {
     if (ctx == NULL || filename == NULL)
         return NULL;
@@ -41,25 +76,215 @@ bm_filectx_new(bm_ctx_t *ctx, const char *filename, const char *slug,
     rv->path = f;
     rv->short_path = bc_strdup(filename);
     rv->slug = bc_strdup(slug);
+    rv->tv_sec = 0;
+    rv->tv_nsec = 0;
+    rv->readable = false;
+    return rv;
+}
 
-    if (st == NULL) {
-        struct stat buf;
 
-        if (0 != stat(f, &buf)) {
-            rv->tv_sec = 0;
-            rv->tv_nsec = 0;
-            rv->readable = false;
-            return rv;
+bm_filectx_t*
+bm_filectx_new(bm_ctx_t *ctx, const char *filename, const char *slug,
+    struct stat *st)
+{
+    bm_filectx_t *rv = bm_filectx_new_lazy(ctx, filename, slug);
+    if (rv != NULL)
+        filectx_stat(rv, st);
+    return rv;
+}
+
+
+typedef struct {
+    bm_filectx_t **fctxs;
+    size_t len;
+    size_t next;
+    pthread_mutex_t mutex;
+} filectx_stat_batch_t;
+
+
+static void*
+filectx_stat_worker(void *arg)
+{
+    filectx_stat_batch_t *batch = arg;
+
+    while (true) {
+        pthread_mutex_lock(&batch->mutex);
+        size_t i = batch->next++;
+        pthread_mutex_unlock(&batch->mutex);
+        if (i >= batch->len)
+            break;
+        filectx_stat(batch->fctxs[i], NULL);
+    }
+
+    return NULL;
+}
+
+
+// stats the files of a list of contexts created by bm_filectx_new_lazy(),
+// skipping the contexts already known to be readable. the stat(2) calls are
+// issued concurrently by a few threads, as they are mostly waiting for the
+// filesystem, that is slow when it is a network filesystem.
+void
+bm_filectx_stat_list(bc_slist_t *l)
+{
+    size_t len = 0;
+    for (bc_slist_t *tmp = l; tmp != NULL; tmp = tmp->next) {
+        bm_filectx_t *fctx = tmp->data;
+        if (fctx != NULL && !fctx->readable)
+            len++;
+    }
+
+    if (len < BM_FILECTX_STAT_MIN) {
+        for (bc_slist_t *tmp = l; tmp != NULL; tmp = tmp->next) {
+            bm_filectx_t *fctx = tmp->data;
+            if (fctx != NULL && !fctx->readable)
+                filectx_stat(fctx, NULL);
         }
+        return;
+    }
 
-        st = &buf;
+    filectx_stat_batch_t batch;
+    batch.fctxs = bc_malloc(len * sizeof(bm_filectx_t*));
+    batch.len = 0;
+    batch.next = 0;
+    pthread_mutex_init(&batch.mutex, NULL);
+    for (bc_slist_t *tmp = l; tmp != NULL; tmp = tmp->next) {
+        bm_filectx_t *fctx = tmp->data;
+        if (fctx != NULL && !fctx->readable)
+            batch.fctxs[batch.len++] = fctx;
     }
 
-    // if it isn't NULL the file exists for sure
-    rv->tv_sec = st->st_mtim_tv_sec;
-    rv->tv_nsec = st->st_mtim_tv_nsec;
-    rv->readable = true;
-    return rv;
+    size_t num_threads = len / BM_FILECTX_STAT_MIN;
+    if (num_threads > BM_FILECTX_STAT_THREADS)
+        num_threads = BM_FILECTX_STAT_THREADS;
+
+    pthread_t threads[BM_FILECTX_STAT_THREADS];
+    size_t started = 0;
+    for (; started < num_threads; started++)
+        if (0 != pthread_create(&threads[started], NULL, filectx_stat_worker,
+                &batch))
+            break;
+
+    // the calling thread works too, and finishes the list by itself if no
+    // thread could be started.
+    filectx_stat_worker(&batch);
+
+    for (size_t i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_mutex_destroy(&batch.mutex);
+    free(batch.fctxs);
+}
+
+
+static void
+filectx_append(bc_slist_t **tail, bm_filectx_t *fctx)
+{
+    bc_slist_t *node = bc_malloc(sizeof(bc_slist_t));
+    node->next = NULL;
+    node->data = fctx;
+    (*tail)->next = node;
+    *tail = node;
+}
+
+
+static bm_cache_dir_t*
+filectx_read_dir(bm_ctx_t *ctx, int fd, const char *path, struct stat *st)
+{
+    bm_cache_dir_t *rv = bm_cache_get_dir(ctx->cache, path, st);
+    if (rv != NULL)
+        return rv;
+
+    // fdopendir(3) takes ownership of the file descriptor.
+    int dup_fd = dup(fd);
+    if (dup_fd < 0)
+        return NULL;
+    DIR *dir = fdopendir(dup_fd);
+    if (dir == NULL) {
+        close(dup_fd);
+        return NULL;
+    }
+
+    size_t len = 0;
+    size_t cap = 16;
+    bm_cache_dirent_t *entries = bc_malloc(cap * sizeof(bm_cache_dirent_t));
+
+    struct dirent *e;
+    while (NULL != (e = readdir(dir))) {
+        if ((0 == strcmp(e->d_name, ".")) || (0 == strcmp(e->d_name, "..")))
+            continue;
+        if (len == cap) {
+            cap *= 2;
+            entries = bc_realloc(entries, cap * sizeof(bm_cache_dirent_t));
+        }
+        entries[len].name = bc_strdup(e->d_name);
+        entries[len].type = e->d_type;
+        len++;
+    }
+    closedir(dir);
+
+    return bm_cache_set_dir(ctx->cache, path, st, entries, len);
+}
+
+
+// walks the directory relative to its parent file descriptor. stat(2) is
+// only called for files, whose mtimes are needed, and for entries whose type
+// is unknown or symbolic links. the list of entries of directories that
+// didn't change since the last scan is reused.
+static void
+filectx_scan_dir(bm_ctx_t *ctx, bc_slist_t **tail, int parent_fd,
+    const char *name, const char *filename)
+{
+    int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (0 != fstat(fd, &st)) {
+        close(fd);
+        return;
+    }
+
+    char *path = filename[0] == '/' ? bc_strdup(filename) :
+        bc_strdup_printf("%s/%s", ctx->root_dir, filename);
+    bm_cache_dir_t *dir = filectx_read_dir(ctx, fd, path, &st);
+    free(path);
+    if (dir == NULL) {
+        close(fd);
+        return;
+    }
+
+    for (size_t i = 0; i < dir->len; i++) {
+        bm_cache_dirent_t *e = &dir->entries[i];
+        char *tmp = bc_strdup_printf("%s/%s", filename, e->name);
+
+        if (e->type == DT_DIR) {
+            filectx_scan_dir(ctx, tail, fd, e->name, tmp);
+            free(tmp);
+            continue;
+        }
+
+        // regular files are stat'ed later, in a batch.
+        if (e->type == DT_REG) {
+            filectx_append(tail, bm_filectx_new_lazy(ctx, tmp, NULL));
+            free(tmp);
+            continue;
+        }
+
+        struct stat buf;
+        if (0 != fstatat(fd, e->name, &buf, 0)) {
+            free(tmp);
+            continue;
+        }
+
+        if (S_ISDIR(buf.st_mode))
+            filectx_scan_dir(ctx, tail, fd, e->name, tmp);
+        else
+            filectx_append(tail, bm_filectx_new(ctx, tmp, NULL, &buf));
+        free(tmp);
+    }
+
+    close(fd);
 }
 
 
@@ -78,30 +303,38 @@ bm_filectx_new_r(bc_slist_t *l, bm_ctx_t *ctx, const char *filename)
         return l;
     }
 
-    if (S_ISDIR(buf.st_mode)) {
-        DIR *dir = opendir(f);
-        if (dir == NULL) {
-            free(f);
-            return l;
-        }
+    // appending to the tail directly, walking the list only once. the
+    // sentinel node avoids special casing empty lists.
+    bc_slist_t sentinel = {l, NULL};
+    bc_slist_t *tail = &sentinel;
+    while (tail->next != NULL)
+        tail = tail->next;
 
-        struct dirent *e;
-        while (NULL != (e = readdir(dir))) {
-            if ((0 == strcmp(e->d_name, ".")) || (0 == strcmp(e->d_name, "..")))
+    if (S_ISDIR(buf.st_mode)) {
+        bc_slist_t *last = tail;
+        filectx_scan_dir(ctx, &tail, AT_FDCWD, f, filename);
+        bm_filectx_stat_list(last->next);
+
+        // files removed after the directory was read are skipped, as they
+        // would be if stat'ed while scanning.
+        while (last->next != NULL) {
+            bc_slist_t *node = last->next;
+            bm_filectx_t *fctx = node->data;
+            if (fctx->readable) {
+                last = node;
                 continue;
-            char *tmp = bc_strdup_printf("%s/%s", filename, e->d_name);
-            l = bm_filectx_new_r(l, ctx, tmp);
-            free(tmp);
+            }
+            last->next = node->next;
+            bm_filectx_free(fctx);
+            free(node);
         }
-
-        closedir(dir);
-        free(f);
-        return l;
+    }
+    else {
+        filectx_append(&tail, bm_filectx_new(ctx, filename, NULL, &buf));
     }
 
-    l = bc_slist_append(l, bm_filectx_new(ctx, filename, NULL, &buf));
     free(f);
-    return l;
+    return sentinel.next;
 }
 
 
@@ -185,7 +418,10 @@ bm_ctx_new(bm_ctx_t *base, const char *settings_file, const char *argv0,
         return NULL;
     }
 
+    bm_trace_span_t span;
+    bm_trace_begin(&span);
     bm_settings_t *settings = bm_settings_parse(content, content_len, err);
+    bm_trace_end(&span, "ctx", "parse settings", NULL);
     if (settings == NULL || *err != NULL) {
         free(abs_filename);
         free(content);
@@ -193,22 +429,43 @@ bm_ctx_new(bm_ctx_t *base, const char *settings_file, const char *argv0,
     }
     free(content);
 
+    bm_compress_check_settings(settings, err);
+    if (*err != NULL) {
+        free(abs_filename);
+        bm_settings_free(settings);
+        return NULL;
+    }
+
     const char *template_dir = bc_trie_lookup(settings->settings, "template_dir");
     if (template_dir == NULL)
         template_dir = "";
 
+    bool blogc_native = base != NULL ? base->blogc_native :
+        bm_exec_use_native_blogc();
+
     char *atom_template = NULL;
     bool atom_template_tmp = false;
+    bc_slist_t *atom_template_ast = NULL;
+    uint64_t atom_template_hash = 0;
     const char *atom_template_conf = bc_trie_lookup(settings->settings,
         "atom_template");
     if (atom_template_conf != NULL) {
         atom_template = bc_strdup_printf("%s/%s", template_dir, atom_template_conf);
     }
     else {
-        atom_template = bm_atom_deploy(settings, err);
+        // the external blogc binary can only read templates from files.
+        if (blogc_native) {
+            atom_template_ast = bm_atom_parse(settings, &atom_template_hash,
+                err);
+            atom_template = bc_strdup(":atom_template");
+        }
+        else {
+            atom_template = bm_atom_deploy(settings, err);
+        }
         atom_template_tmp = true;
         if (*err != NULL) {
             free(abs_filename);
+            free(atom_template);
             bm_settings_free(settings);
             return NULL;
         }
@@ -218,10 +475,19 @@ bm_ctx_new(bm_ctx_t *base, const char *settings_file, const char *argv0,
     if (base == NULL) {
         rv = bc_malloc(sizeof(bm_ctx_t));
         rv->blogc = bm_exec_find_binary(argv0, "blogc", "BLOGC");
+        rv->blogc_native = blogc_native;
+        rv->artifacts = NULL;
+        rv->cache = bm_cache_new();
+        rv->jobs = NULL;
+        rv->changed = NULL;
+        rv->settings_changed = 0;
+        rv->tags_posts = NULL;
         rv->blogc_runserver = bm_exec_find_binary(argv0, "blogc-runserver",
             "BLOGC_RUNSERVER");
         rv->dev = false;
         rv->verbose = false;
+        rv->shard = 0;
+        rv->shards = 0;
     }
     else {
         bm_ctx_free_internal(base);
@@ -244,6 +510,9 @@ bm_ctx_new(bm_ctx_t *base, const char *settings_file, const char *argv0,
             rv->short_output_dir);
     }
 
+    rv->manifest = bm_manifest_new(rv->output_dir);
+    bm_manifest_set_shard(rv->manifest, rv->shard, rv->shards);
+
     // can't return null and set error after this!
 
     char *main_template = bc_strdup_printf("%s/%s", template_dir,
@@ -252,6 +521,8 @@ bm_ctx_new(bm_ctx_t *base, const char *settings_file, const char *argv0,
     free(main_template);
 
     rv->atom_template_tmp = atom_template_tmp;
+    rv->atom_template = atom_template_ast;
+    rv->atom_template_hash = atom_template_hash;
     rv->atom_template_fctx = bm_filectx_new(rv, atom_template, NULL, NULL);
     free(atom_template);
 
@@ -273,10 +544,11 @@ bm_ctx_new(bm_ctx_t *base, const char *settings_file, const char *argv0,
             char *f = bm_generate_filename(content_dir, post_prefix,
                 settings->posts[i], source_ext);
             rv->posts_fctx = bc_slist_append(rv->posts_fctx,
-                bm_filectx_new(rv, f, settings->posts[i], NULL));
+                bm_filectx_new_lazy(rv, f, settings->posts[i]));
             free(f);
         }
     }
+    bm_filectx_stat_list(rv->posts_fctx);
 
     rv->pages_fctx = NULL;
     if (settings->pages != NULL) {
@@ -284,10 +556,11 @@ bm_ctx_new(bm_ctx_t *base, const char *settings_file, const char *argv0,
             char *f = bm_generate_filename(content_dir, NULL, settings->pages[i],
                 source_ext);
             rv->pages_fctx = bc_slist_append(rv->pages_fctx,
-                bm_filectx_new(rv, f, settings->pages[i], NULL));
+                bm_filectx_new_lazy(rv, f, settings->pages[i]));
             free(f);
         }
     }
+    bm_filectx_stat_list(rv->pages_fctx);
 
     rv->copy_fctx = NULL;
     if (settings->copy != NULL) {
@@ -301,42 +574,193 @@ bm_ctx_new(bm_ctx_t *base, const char *settings_file, const char *argv0,
 }
 
 
-bool
-bm_ctx_reload(bm_ctx_t **ctx)
+static void
+filectx_reload(bm_filectx_t *fctx, bc_trie_t *changed)
 {
-    if (*ctx == NULL || (*ctx)->settings_fctx == NULL)
+    if (fctx == NULL)
+        return;
+    if (changed == NULL || NULL != bc_trie_lookup(changed, fctx->path))
+        bm_filectx_reload(fctx);
+}
+
+
+// builds the file contexts for a list of slugs, reusing the contexts from the
+// old list, that are freed.
+static bc_slist_t*
+filectx_list_update(bm_ctx_t *ctx, bc_slist_t *old, char **slugs,
+    const char *prefix)
+{
+    const char *content_dir = bm_ctx_settings_lookup(ctx, "content_dir");
+    const char *source_ext = bm_ctx_settings_lookup(ctx, "source_ext");
+
+    bc_trie_t *nodes = bc_trie_new(NULL);
+    for (bc_slist_t *l = old; l != NULL; l = l->next) {
+        bm_filectx_t *fctx = l->data;
+        if (NULL == bc_trie_lookup(nodes, fctx->short_path))
+            bc_trie_insert(nodes, fctx->short_path, l);
+    }
+
+    bc_slist_t *rv = NULL;
+    for (size_t i = 0; slugs != NULL && slugs[i] != NULL; i++) {
+        char *f = bm_generate_filename(content_dir, prefix, slugs[i],
+            source_ext);
+        bc_slist_t *node = bc_trie_lookup(nodes, f);
+        if (node != NULL && node->data != NULL) {
+            rv = bc_slist_append(rv, node->data);
+            node->data = NULL;
+        }
+        else {
+            rv = bc_slist_append(rv, bm_filectx_new(ctx, f, slugs[i], NULL));
+        }
+        free(f);
+    }
+
+    bc_trie_free(nodes);
+    bc_slist_free_full(old, (bc_free_func_t) bm_filectx_free);
+    return rv;
+}
+
+
+// same as filectx_list_update, but for copy entries. only the new entries
+// are scanned.
+static bc_slist_t*
+filectx_copy_update(bm_ctx_t *ctx, bc_slist_t *old, char **old_copy,
+    char **copy)
+{
+    bc_slist_t *rv = NULL;
+    for (size_t i = 0; copy != NULL && copy[i] != NULL; i++) {
+        bool found = false;
+        for (size_t j = 0; old_copy != NULL && old_copy[j] != NULL; j++) {
+            if (0 == strcmp(copy[i], old_copy[j])) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            rv = bm_filectx_new_r(rv, ctx, copy[i]);
+            continue;
+        }
+
+        size_t len = strlen(copy[i]);
+        for (bc_slist_t *l = old; l != NULL; l = l->next) {
+            bm_filectx_t *fctx = l->data;
+            if (fctx == NULL || 0 != strncmp(fctx->short_path, copy[i], len))
+                continue;
+            if (fctx->short_path[len] == '\0' || fctx->short_path[len] == '/') {
+                rv = bc_slist_append(rv, fctx);
+                l->data = NULL;
+            }
+        }
+    }
+
+    bc_slist_free_full(old, (bc_free_func_t) bm_filectx_free);
+    return rv;
+}
+
+
+static bool
+settings_reload(bm_ctx_t **ctx)
+{
+    bm_ctx_t *c = *ctx;
+    time_t tv_sec;
+    long tv_nsec;
+
+    if (!bm_filectx_changed(c->settings_fctx, &tv_sec, &tv_nsec))
+        return true;
+
+    bc_error_t *err = NULL;
+    size_t content_len;
+    char *content = bc_file_get_contents(c->settings_fctx->path, true,
+        &content_len, &err);
+    bm_settings_t *settings = NULL;
+    if (err == NULL) {
+        bm_trace_span_t span;
+        bm_trace_begin(&span);
+        settings = bm_settings_parse(content, content_len, &err);
+        bm_trace_end(&span, "ctx", "parse settings", NULL);
+    }
+    free(content);
+    if (err != NULL) {
+        bc_error_print(err, "blogc-make");
+        bc_error_free(err);
         return false;
+    }
 
-    if (bm_filectx_changed((*ctx)->settings_fctx, NULL, NULL)) {
-        // reload everything! we could just reload settings_fctx, as this
-        // would force rebuilding everything, but we need to know new/deleted
-        // files
+    unsigned int diff = bm_settings_diff(c->settings, settings);
+
+    if (diff & BM_SETTINGS_CHANGED_SETTINGS) {
+        bm_settings_free(settings);
+
+        // reload everything! paths and templates may have changed.
 
         // needs to dup path, because it may be freed when reloading.
-        char *tmp = bc_strdup((*ctx)->settings_fctx->path);
-        bc_error_t *err = NULL;
-        *ctx = bm_ctx_new(*ctx, tmp, NULL, &err);
+        char *tmp = bc_strdup(c->settings_fctx->path);
+        bm_ctx_t *rv = bm_ctx_new(c, tmp, NULL, &err);
         free(tmp);
         if (err != NULL) {
             bc_error_print(err, "blogc-make");
             bc_error_free(err);
             return false;
         }
+        *ctx = rv;
+        rv->settings_changed = BM_SETTINGS_CHANGED_ALL;
         return true;
     }
 
-    bm_filectx_reload((*ctx)->main_template_fctx);
-    bm_filectx_reload((*ctx)->atom_template_fctx);
-    bm_filectx_reload((*ctx)->listing_entry_fctx);
+    // only the lists of files changed, if any. the file contexts that are
+    // still listed are kept, and new copy entries are scanned.
+    if (diff & BM_SETTINGS_CHANGED_POSTS)
+        c->posts_fctx = filectx_list_update(c, c->posts_fctx, settings->posts,
+            bm_ctx_settings_lookup(c, "post_prefix"));
+    if (diff & BM_SETTINGS_CHANGED_PAGES)
+        c->pages_fctx = filectx_list_update(c, c->pages_fctx, settings->pages,
+            NULL);
+    if (diff & BM_SETTINGS_CHANGED_COPY)
+        c->copy_fctx = filectx_copy_update(c, c->copy_fctx, c->settings->copy,
+            settings->copy);
+
+    bm_settings_free(c->settings);
+    c->settings = settings;
+    c->settings_changed = diff;
+
+    c->settings_fctx->tv_sec = tv_sec;
+    c->settings_fctx->tv_nsec = tv_nsec;
+    c->settings_fctx->readable = true;
+    return true;
+}
+
+
+// if changed isn't NULL, only the files included in it (by full path) are
+// checked for changes.
+bool
+bm_ctx_reload(bm_ctx_t **ctx, bc_trie_t *changed)
+{
+    if (*ctx == NULL || (*ctx)->settings_fctx == NULL)
+        return false;
+
+    (*ctx)->settings_changed = 0;
+
+    if (changed == NULL ||
+        NULL != bc_trie_lookup(changed, (*ctx)->settings_fctx->path))
+    {
+        if (!settings_reload(ctx))
+            return false;
+        if ((*ctx)->settings_changed & BM_SETTINGS_CHANGED_SETTINGS)
+            return true;
+    }
+
+    filectx_reload((*ctx)->main_template_fctx, changed);
+    filectx_reload((*ctx)->atom_template_fctx, changed);
+    filectx_reload((*ctx)->listing_entry_fctx, changed);
 
     for (bc_slist_t *tmp = (*ctx)->posts_fctx; tmp != NULL; tmp = tmp->next)
-        bm_filectx_reload((bm_filectx_t*) tmp->data);
+        filectx_reload((bm_filectx_t*) tmp->data, changed);
 
     for (bc_slist_t *tmp = (*ctx)->pages_fctx; tmp != NULL; tmp = tmp->next)
-        bm_filectx_reload((bm_filectx_t*) tmp->data);
+        filectx_reload((bm_filectx_t*) tmp->data, changed);
 
     for (bc_slist_t *tmp = (*ctx)->copy_fctx; tmp != NULL; tmp = tmp->next)
-        bm_filectx_reload((bm_filectx_t*) tmp->data);
+        filectx_reload((bm_filectx_t*) tmp->data, changed);
 
     return true;
 }
@@ -358,9 +782,14 @@ bm_ctx_free_internal(bm_ctx_t *ctx)
     free(ctx->output_dir);
     ctx->output_dir = NULL;
 
-    if (ctx->atom_template_tmp)
+    bm_manifest_free(ctx->manifest);
+    ctx->manifest = NULL;
+
+    if (ctx->atom_template_tmp && ctx->atom_template == NULL)
         bm_atom_destroy(ctx->atom_template_fctx->path);
     ctx->atom_template_tmp = false;
+    blogc_template_free_ast(ctx->atom_template);
+    ctx->atom_template = NULL;
 
     bm_filectx_free(ctx->main_template_fctx);
     ctx->main_template_fctx = NULL;
@@ -377,6 +806,9 @@ bm_ctx_free_internal(bm_ctx_t *ctx)
     ctx->pages_fctx = NULL;
     bc_slist_free_full(ctx->copy_fctx, (bc_free_func_t) bm_filectx_free);
     ctx->copy_fctx = NULL;
+
+    bc_trie_free(ctx->tags_posts);
+    ctx->tags_posts = NULL;
 }
 
 
@@ -388,6 +820,9 @@ bm_ctx_free(bm_ctx_t *ctx)
     bm_ctx_free_internal(ctx);
     free(ctx->blogc);
     free(ctx->blogc_runserver);
+    bm_jobs_free(ctx->jobs);
+    bm_cache_free(ctx->cache);
+    bm_artifacts_free(ctx->artifacts);
     free(ctx);
 }
 
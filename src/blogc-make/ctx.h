@@ -11,28 +11,18 @@
 
 #include <sys/stat.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
+#include "artifacts.h"
+#include "cache.h"
+#include "jobs.h"
+#include "manifest.h"
 #include "settings.h"
 #include "../common/error.h"
+#include "../common/file.h"
 #include "../common/utils.h"
 
-#ifdef __APPLE__
-#define st_mtim_tv_sec st_mtimespec.tv_sec
-#define st_mtim_tv_nsec st_mtimespec.tv_nsec
-#endif
-
-#ifdef __ANDROID__
-#define st_mtim_tv_sec st_mtime
-#define st_mtim_tv_nsec st_mtime_nsec
-#endif
-
-#ifndef st_mtim_tv_sec
-#define st_mtim_tv_sec st_mtim.tv_sec
-#endif
-#ifndef st_mtim_tv_nsec
-#define st_mtim_tv_nsec st_mtim.tv_nsec
-#endif
-
 
 typedef struct {
     char *path;
@@ -47,10 +37,34 @@ typedef struct {
     char *blogc;
     char *blogc_runserver;
 
+    bm_artifacts_t *artifacts;
+    bm_cache_t *cache;
+    bm_jobs_t *jobs;
+    bm_manifest_t *manifest;
+
+    // files changed since the last build, set by the reloader. NULL means
+    // that anything may have changed.
+    bc_trie_t *changed;
+
+    // sections of the settings file changed by the last reload, as
+    // bm_settings_changed_t flags.
+    unsigned int settings_changed;
+
+    bool blogc_native;
     bool dev;
     bool verbose;
+
+    // only outputs of this shard (0-based) are built. 0 shards means that the
+    // whole site is built.
+    size_t shard;
+    size_t shards;
     bool atom_template_tmp;
 
+    // default atom template, parsed in memory when blogc runs in-process.
+    // otherwise it is deployed to a temporary file.
+    bc_slist_t *atom_template;
+    uint64_t atom_template_hash;
+
     bm_settings_t *settings;
 
     char *root_dir;
@@ -65,17 +79,24 @@ typedef struct {
     bc_slist_t *posts_fctx;
     bc_slist_t *pages_fctx;
     bc_slist_t *copy_fctx;
+
+    // posts of each tag, built from the metadata of the posts when needed by
+    // the tags rules, and released after each rule execution.
+    bc_trie_t *tags_posts;
 } bm_ctx_t;
 
 bm_filectx_t* bm_filectx_new(bm_ctx_t *ctx, const char *filename, const char *slug,
     struct stat *st);
+bm_filectx_t* bm_filectx_new_lazy(bm_ctx_t *ctx, const char *filename,
+    const char *slug);
+void bm_filectx_stat_list(bc_slist_t *l);
 bc_slist_t* bm_filectx_new_r(bc_slist_t *l, bm_ctx_t *ctx, const char *filename);
 bool bm_filectx_changed(bm_filectx_t *ctx, time_t *tv_sec, long *tv_nsec);
 void bm_filectx_reload(bm_filectx_t *ctx);
 void bm_filectx_free(bm_filectx_t *fctx);
 bm_ctx_t* bm_ctx_new(bm_ctx_t *base, const char *settings_file,
     const char *argv0, bc_error_t **err);
-bool bm_ctx_reload(bm_ctx_t **ctx);
+bool bm_ctx_reload(bm_ctx_t **ctx, bc_trie_t *changed);
 void bm_ctx_free_internal(bm_ctx_t *ctx);
 void bm_ctx_free(bm_ctx_t *ctx);
 const char* bm_ctx_settings_lookup(bm_ctx_t *ctx, const char *key);
@@ -6,87 +6,227 @@
  * See the file LICENSE.
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/types.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <libgen.h>
+#include <locale.h>
 #include <errno.h>
+#include "../blogc/loader.h"
+#include "../blogc/minifier.h"
+#include "../blogc/renderer.h"
+#include "../blogc/template-parser.h"
 #include "../common/error.h"
 #include "../common/file.h"
 #include "../common/utils.h"
-#include "exec-native.h"
+#include "cache.h"
+#include "compress.h"
 #include "ctx.h"
+#include "jobs.h"
+#include "exec-native.h"
 
+#ifdef HAVE_LINUX_FS_H
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif /* HAVE_LINUX_FS_H */
 
-int
-bm_exec_native_cp(bm_filectx_t *source, bm_filectx_t *dest, bool verbose)
+#ifndef PACKAGE_VERSION
+#define PACKAGE_VERSION "Unknown"
+#endif
+
+#define COPY_BUFFER_SIZE (128 * 1024)
+
+
+static int
+mkdir_recursive(bm_ctx_t *ctx, const char *filename)
 {
-    if (verbose)
-        printf("Copying '%s' to '%s'\n", source->path, dest->path);
-    else
-        printf("  COPY     %s\n", dest->short_path);
-    fflush(stdout);
+    char *fname = bc_strdup(filename);
+    char *sep = strrchr(fname, '/');
+    if (sep == NULL) {
+        free(fname);
+        return 0;
+    }
+    *sep = '\0';
+    if (bm_cache_has_dir(ctx->cache, fname)) {
+        free(fname);
+        return 0;
+    }
+    *sep = '/';
 
-    char *fname = bc_strdup(dest->path);
     for (char *tmp = fname; *tmp != '\0'; tmp++) {
         if (*tmp != '/' && *tmp != '\\')
             continue;
         char bkp = *tmp;
         *tmp = '\0';
         if ((strlen(fname) > 0) &&
-            (-1 == mkdir(fname, 0777)) &&
-            (errno != EEXIST))
+            !bm_cache_has_dir(ctx->cache, fname))
         {
-            fprintf(stderr, "blogc-make: error: failed to create output "
-                "directory (%s): %s\n", fname, strerror(errno));
-            free(fname);
-            return 1;
+            if ((-1 == mkdir(fname, 0777)) && (errno != EEXIST)) {
+                bm_jobs_eprintf("blogc-make: error: failed to create output "
+                    "directory (%s): %s\n", fname, strerror(errno));
+                free(fname);
+                return 1;
+            }
+            bm_cache_add_dir(ctx->cache, fname);
         }
         *tmp = bkp;
     }
     free(fname);
+    return 0;
+}
 
-    int fd_from = open(source->path, O_RDONLY);
-    if (fd_from < 0) {
-        fprintf(stderr, "blogc-make: error: failed to open source file to copy "
-            " (%s): %s\n", source->path, strerror(errno));
-        return 1;
-    }
 
-    int fd_to = open(dest->path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-    if (fd_to < 0) {
-        fprintf(stderr, "blogc-make: error: failed to open destination file to "
-            "copy (%s): %s\n", dest->path, strerror(errno));
-        close(fd_from);
-        return 1;
+// copies the content of fd_from to fd_to, trying to avoid copying data
+// through userspace: reflinks share the blocks of the source file, if
+// supported by the filesystem, and copy_file_range(2) copies inside the
+// kernel. the buffered copy finishes the job if these are not available.
+static int
+copy_fd(int fd_from, int fd_to, const char *source, const char *dest)
+{
+#ifdef FICLONE
+    if (0 == ioctl(fd_to, FICLONE, fd_from))
+        return 0;
+#endif /* FICLONE */
+
+#ifdef HAVE_COPY_FILE_RANGE
+    struct stat st;
+    if (0 == fstat(fd_from, &st)) {
+        off_t remaining = st.st_size;
+        while (remaining > 0) {
+            ssize_t n = copy_file_range(fd_from, NULL, fd_to, NULL, remaining,
+                0);
+            if (n < 0) {
+                if (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+                    errno == EOPNOTSUPP || errno == EPERM)
+                    break;
+                bm_jobs_eprintf("blogc-make: error: failed to write to "
+                    "destination file (%s): %s\n", dest, strerror(errno));
+                return 1;
+            }
+            if (n == 0)
+                break;
+            remaining -= n;
+        }
     }
+#endif /* HAVE_COPY_FILE_RANGE */
 
+    // file offsets were advanced by copy_file_range(2), if it was used, then
+    // this copies whatever is left.
+    char *buffer = bc_malloc(COPY_BUFFER_SIZE);
     ssize_t nread;
-    char buffer[BC_FILE_CHUNK_SIZE];
-    while (0 < (nread = read(fd_from, buffer, BC_FILE_CHUNK_SIZE))) {
+    while (0 < (nread = read(fd_from, buffer, COPY_BUFFER_SIZE))) {
         char *out_ptr = buffer;
         do {
             ssize_t nwritten = write(fd_to, out_ptr, nread);
             if (nwritten == -1) {
-                fprintf(stderr, "blogc-make: error: failed to write to "
-                    "destination file (%s): %s\n", dest->path, strerror(errno));
-                close(fd_from);
-                close(fd_to);
+                bm_jobs_eprintf("blogc-make: error: failed to write to "
+                    "destination file (%s): %s\n", dest, strerror(errno));
+                free(buffer);
                 return 1;
             }
             nread -= nwritten;
             out_ptr += nwritten;
         } while (nread > 0);
     }
+    free(buffer);
+
+    if (nread < 0) {
+        bm_jobs_eprintf("blogc-make: error: failed to read from source file "
+            "(%s): %s\n", source, strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int
+bm_exec_native_cp(bm_ctx_t *ctx, bm_filectx_t *source, bm_filectx_t *dest)
+{
+    if (ctx->verbose)
+        bm_jobs_printf("Copying '%s' to '%s'\n", source->path, dest->path);
+    else
+        bm_jobs_printf("  COPY     %s\n", dest->short_path);
+
+    if (0 != mkdir_recursive(ctx, dest->path))
+        return 1;
+
+    // the destination must be replaced, not written to, otherwise the source
+    // file could be modified through a hard link created previously.
+    if (0 != unlink(dest->path) && errno != ENOENT) {
+        bm_jobs_eprintf("blogc-make: error: failed to remove destination "
+            "file (%s): %s\n", dest->path, strerror(errno));
+        return 1;
+    }
+
+    const char *copy_mode = bm_ctx_settings_lookup(ctx, "copy_mode");
+    if (copy_mode != NULL && 0 == strcmp(copy_mode, "hardlink")) {
+        if (0 == link(source->path, dest->path))
+            return 0;
+
+        // e.g. output directory in another filesystem.
+        if (errno != EXDEV && errno != EPERM && errno != EMLINK) {
+            bm_jobs_eprintf("blogc-make: error: failed to link destination "
+                "file (%s): %s\n", dest->path, strerror(errno));
+            return 1;
+        }
+    }
+
+    int fd_from = open(source->path, O_RDONLY | O_CLOEXEC);
+    if (fd_from < 0) {
+        bm_jobs_eprintf("blogc-make: error: failed to open source file to copy "
+            " (%s): %s\n", source->path, strerror(errno));
+        return 1;
+    }
+
+    int fd_to = open(dest->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+        0666);
+    if (fd_to < 0) {
+        bm_jobs_eprintf("blogc-make: error: failed to open destination file to "
+            "copy (%s): %s\n", dest->path, strerror(errno));
+        close(fd_from);
+        return 1;
+    }
+
+    int rv = copy_fd(fd_from, fd_to, source->path, dest->path);
 
     close(fd_from);
     close(fd_to);
 
+    return rv;
+}
+
+
+// writes an output restored from the artifact cache.
+int
+bm_exec_native_restore(bm_ctx_t *ctx, bm_filectx_t *output, const char *content,
+    size_t len)
+{
+    if (ctx->verbose)
+        bm_jobs_printf("Restoring '%s' from artifact cache\n", output->path);
+    else
+        bm_jobs_printf("  CACHED   %s\n", output->short_path);
+
+    if (0 != mkdir_recursive(ctx, output->path))
+        return 1;
+
+    bc_error_t *err = NULL;
+    bc_file_write_if_changed(output->path, content, len, &err);
+    if (err != NULL) {
+        bm_jobs_error_print(err);
+        bc_error_free(err);
+        return 1;
+    }
     return 0;
 }
 
@@ -127,66 +267,367 @@ bm_exec_native_is_empty_dir(const char *dir, bc_error_t **err)
 }
 
 
-int
-bm_exec_native_rm(const char *output_dir, bm_filectx_t *dest, bool verbose)
+static void
+list_dirs(const char *dir, void *data, bc_slist_t **dirs)
 {
-    if (verbose)
-        printf("Removing file '%s'\n", dest->path);
-    else
-        printf("  CLEAN    %s\n", dest->short_path);
-    fflush(stdout);
+    *dirs = bc_slist_prepend(*dirs, bc_strdup(dir));
+}
+
+
+static int
+cmp_dirs(const void *a, const void *b)
+{
+    // parent directories are always shorter than their children.
+    size_t len_a = strlen(*(char* const*) a);
+    size_t len_b = strlen(*(char* const*) b);
+    return len_a < len_b ? 1 : (len_a > len_b ? -1 : 0);
+}
 
-    if (0 != unlink(dest->path)) {
-        fprintf(stderr, "blogc-make: error: failed to remove file (%s): %s\n",
-            dest->path, strerror(errno));
-        return 1;
-    }
 
+// removes the files, and then the directories left empty by them, up to the
+// output directory. each directory is only checked once, by trying to remove
+// it, deepest first, after all the files are gone.
+int
+bm_exec_native_rm(const char *output_dir, bc_slist_t *files, bool verbose)
+{
     int rv = 0;
+    bc_trie_t *dirs = bc_trie_new(NULL);
 
-    // blame freebsd's libc for all of those memory allocations around dirname
-    // calls!
-    char *short_dir = bc_strdup(dirname(dest->short_path));
-    char *dir = bc_strdup(dirname(dest->path));
+    for (bc_slist_t *l = files; l != NULL; l = l->next) {
+        bm_filectx_t *dest = l->data;
+        if (dest == NULL || !dest->readable)
+            continue;
 
-    bc_error_t *err = NULL;
+        if (verbose)
+            printf("Removing file '%s'\n", dest->path);
+        else
+            printf("  CLEAN    %s\n", dest->short_path);
+        fflush(stdout);
 
-    while ((0 != strcmp(short_dir, ".")) && (0 != strcmp(short_dir, "/"))) {
-        bool empty = bm_exec_native_is_empty_dir(dir, &err);
-        if (err != NULL) {
-            fprintf(stderr, "blogc-make: error: %s\n", err->msg);
-            bc_error_free(err);
+        if (0 != unlink(dest->path)) {
+            fprintf(stderr, "blogc-make: error: failed to remove file (%s): %s\n",
+                dest->path, strerror(errno));
             rv = 1;
             break;
         }
-        if (!empty) {
+
+        rv = bm_compress_rm_sidecars(dest, verbose);
+        if (rv != 0)
             break;
+
+        // blame freebsd's libc for all of those memory allocations around
+        // dirname calls!
+        char *tmp = bc_strdup(dest->short_path);
+        char *short_dir = bc_strdup(dirname(tmp));
+        free(tmp);
+        tmp = bc_strdup(dest->path);
+        char *dir = bc_strdup(dirname(tmp));
+        free(tmp);
+
+        while ((0 != strcmp(short_dir, ".")) && (0 != strcmp(short_dir, "/"))) {
+            // the parents were added by a previous file.
+            if (NULL != bc_trie_lookup(dirs, dir))
+                break;
+            bc_trie_insert(dirs, dir, (void*) 1);
+            if (0 == strcmp(dir, output_dir))
+                break;
+
+            tmp = short_dir;
+            short_dir = bc_strdup(dirname(short_dir));
+            free(tmp);
+            tmp = dir;
+            dir = bc_strdup(dirname(dir));
+            free(tmp);
         }
-        if (verbose) {
-            printf("Removing directory '%s'\n", dir);
+
+        free(short_dir);
+        free(dir);
+    }
+
+    bc_slist_t *l = NULL;
+    bc_trie_foreach(dirs, (bc_trie_foreach_func_t) list_dirs, &l);
+    bc_trie_free(dirs);
+
+    size_t len = bc_slist_length(l);
+    char **d = bc_malloc(len * sizeof(char*));
+    size_t i = 0;
+    for (bc_slist_t *tmp = l; tmp != NULL; tmp = tmp->next)
+        d[i++] = tmp->data;
+    bc_slist_free(l);
+    qsort(d, len, sizeof(char*), cmp_dirs);
+
+    for (i = 0; i < len; i++) {
+        if (rv == 0 && 0 != rmdir(d[i])) {
+            // not empty, that is fine.
+            if (errno != ENOTEMPTY && errno != EEXIST && errno != ENOENT) {
+                fprintf(stderr,
+                    "blogc-make: error: failed to remove directory(%s): %s\n",
+                    d[i], strerror(errno));
+                rv = 1;
+            }
+        }
+        else if (rv == 0 && verbose) {
+            printf("Removing directory '%s'\n", d[i]);
             fflush(stdout);
         }
-        if (0 != rmdir(dir)) {
-            fprintf(stderr,
-                "blogc-make: error: failed to remove directory(%s): %s\n",
-                dir, strerror(errno));
-            rv = 1;
-            break;
+        free(d[i]);
+    }
+    free(d);
+
+    return rv;
+}
+
+
+static void
+config_insert(const char *key, const char *value, bc_trie_t *config)
+{
+    bc_trie_insert(config, key, bc_strdup(value));
+}
+
+
+bc_trie_t*
+bm_exec_native_build_config(bm_ctx_t *ctx, bc_trie_t *global_variables,
+    bc_trie_t *local_variables)
+{
+    // this must match the variables set by bm_exec_build_blogc_cmd(), in the
+    // same order, so rendering in-process is equivalent to calling blogc.
+    bc_trie_t *rv = bc_trie_new(free);
+    bc_trie_insert(rv, "BLOGC_VERSION", bc_strdup(PACKAGE_VERSION));
+
+    if (ctx->settings != NULL) {
+        if (ctx->settings->tags != NULL)
+            bc_trie_insert(rv, "MAKE_TAGS", bc_strv_join(ctx->settings->tags, " "));
+        bc_trie_foreach(ctx->settings->global,
+            (bc_trie_foreach_func_t) config_insert, rv);
+    }
+
+    bc_trie_foreach(global_variables, (bc_trie_foreach_func_t) config_insert, rv);
+    bc_trie_foreach(local_variables, (bc_trie_foreach_func_t) config_insert, rv);
+
+    if (ctx->dev) {
+        bc_trie_insert(rv, "MAKE_ENV_DEV", bc_strdup("1"));
+        bc_trie_insert(rv, "MAKE_ENV", bc_strdup("dev"));
+    }
+
+    return rv;
+}
+
+
+// parsed sources are unique while the cache lives, so their addresses can be
+// used to find the file context of each source after filtering.
+#define SOURCE_KEY_SIZE (2 * sizeof(void*) + 3)
+
+
+// parsed sources are owned by the cache, and file paths are owned by the file
+// contexts, so the returned lists must be released with bc_slist_free only.
+// if metadata is true, the content of the sources is not parsed. if fctxs
+// isn't NULL, the file context of each parsed source is added to it.
+static bc_slist_t*
+build_sources(bm_ctx_t *ctx, bc_trie_t *config, bc_slist_t *sources,
+    bool only_first_source, bool metadata, bc_trie_t *fctxs, bc_error_t **err)
+{
+    bc_slist_t *s = NULL;
+    bc_slist_t *files = NULL;
+    for (bc_slist_t *l = sources; l != NULL; l = l->next) {
+        bm_filectx_t *fctx = l->data;
+        bc_error_t *tmp_err = NULL;
+        bc_trie_t *src = metadata ?
+            bm_cache_get_metadata(ctx->cache, fctx->path, &tmp_err) :
+            bm_cache_get_source(ctx->cache, config, fctx->path, &tmp_err);
+        if (src == NULL) {
+            *err = bc_error_new_printf(BLOGC_ERROR_LOADER,
+                "An error occurred while parsing source file: %s\n\n%s",
+                fctx->path, tmp_err->msg);
+            bc_error_free(tmp_err);
+            bc_slist_free(s);
+            bc_slist_free(files);
+            return NULL;
+        }
+        s = bc_slist_append(s, src);
+        files = bc_slist_append(files, fctx->path);
+        if (fctxs != NULL) {
+            char key[SOURCE_KEY_SIZE];
+            snprintf(key, sizeof(key), "%p", (void*) src);
+            bc_trie_insert(fctxs, key, fctx);
         }
-        if (0 == strcmp(dir, output_dir)) {
+        if (only_first_source)
             break;
+    }
+
+    bc_slist_t *rv = blogc_source_filter(config, s, files, err);
+    bc_slist_free(s);
+    bc_slist_free(files);
+    return rv;
+}
+
+
+// returns the file contexts of the sources that would be listed by blogc, in
+// the same order, and the variables after filtering (with pagination
+// variables and such). the returned list must be released with bc_slist_free
+// only.
+bc_slist_t*
+bm_exec_native_filter_sources(bm_ctx_t *ctx, bc_trie_t *global_variables,
+    bc_trie_t *local_variables, bc_slist_t *sources, bc_trie_t **config,
+    bc_error_t **err)
+{
+    if (ctx == NULL || config == NULL || err == NULL || *err != NULL)
+        return NULL;
+
+    *config = bm_exec_native_build_config(ctx, global_variables,
+        local_variables);
+
+    bc_trie_t *fctxs = bc_trie_new(NULL);
+    bc_slist_t *s = build_sources(ctx, *config, sources, false, true, fctxs,
+        err);
+
+    bc_slist_t *rv = NULL;
+    for (bc_slist_t *l = s; l != NULL; l = l->next) {
+        char key[SOURCE_KEY_SIZE];
+        snprintf(key, sizeof(key), "%p", l->data);
+        bm_filectx_t *fctx = bc_trie_lookup(fctxs, key);
+        if (fctx != NULL)
+            rv = bc_slist_append(rv, fctx);
+    }
+
+    bc_slist_free(s);
+    bc_trie_free(fctxs);
+    return rv;
+}
+
+
+// setlocale() affects the whole process, so it can't be called from
+// concurrent jobs. the locale is set once by the rule executor instead.
+char*
+bm_exec_native_set_locale(bm_ctx_t *ctx)
+{
+    const char *locale = bm_ctx_settings_lookup(ctx, "locale");
+    if (locale == NULL)
+        return NULL;
+
+    char *rv = bc_strdup(setlocale(LC_ALL, NULL));
+    setlocale(LC_ALL, locale);
+    return rv;
+}
+
+
+void
+bm_exec_native_restore_locale(char *locale)
+{
+    if (locale == NULL)
+        return;
+    setlocale(LC_ALL, locale);
+    free(locale);
+}
+
+
+int
+bm_exec_native_blogc(bm_ctx_t *ctx, bc_trie_t *global_variables,
+    bc_trie_t *local_variables, bool listing, bm_filectx_t *listing_entry,
+    bm_filectx_t *template, bm_filectx_t *output, bc_slist_t *sources,
+    bool only_first_source, bool minify)
+{
+    if (ctx == NULL || template == NULL || output == NULL)
+        return 1;
+
+    if (ctx->verbose)
+        bm_jobs_printf("Rendering '%s' with template '%s'\n", output->path,
+            template->path);
+    else
+        bm_jobs_printf("  BLOGC    %s\n", output->short_path);
+
+    int rv = 0;
+    bc_trie_t *config = bm_exec_native_build_config(ctx, global_variables,
+        local_variables);
+    bc_slist_t *entries = NULL;
+    bc_slist_t *tmpl = NULL;
+    char *out = NULL;
+    bc_error_t *err = NULL;
+
+    bc_slist_t *s = build_sources(ctx, config, sources, only_first_source, false,
+        NULL, &err);
+    if (err != NULL) {
+        rv = 1;
+        goto cleanup;
+    }
+
+    if (listing && listing_entry != NULL) {
+        bc_trie_t *e = bm_cache_get_source(ctx->cache, config,
+            listing_entry->path, &err);
+        if (err != NULL) {
+            rv = 1;
+            goto cleanup;
         }
+        entries = bc_slist_append(entries, e);
+    }
 
-        char *tmp = short_dir;
-        short_dir = bc_strdup(dirname(short_dir));
-        free(tmp);
-        tmp = dir;
-        dir = bc_strdup(dirname(dir));
+    if (ctx->atom_template != NULL && template == ctx->atom_template_fctx)
+        tmpl = ctx->atom_template;
+    else
+        tmpl = bm_cache_get_template(ctx->cache, template->path, &err);
+    if (err != NULL) {
+        rv = 1;
+        goto cleanup;
+    }
+
+    out = blogc_render(tmpl, s, entries, config, listing);
+
+    if (minify) {
+        char *tmp = out;
+        out = blogc_minify(tmp);
         free(tmp);
     }
 
-    free(short_dir);
-    free(dir);
+    if (0 != mkdir_recursive(ctx, output->path)) {
+        rv = 1;
+        goto cleanup;
+    }
+
+    // outputs with the same content are not rewritten, to keep their mtimes.
+    bc_file_write_if_changed(output->path, out, out != NULL ? strlen(out) : 0,
+        &err);
+    if (err != NULL)
+        rv = 1;
+
+cleanup:
+    if (err != NULL) {
+        bm_jobs_error_print(err);
+        bc_error_free(err);
+    }
+    free(out);
+    bc_slist_free(entries);
+    bc_slist_free(s);
+    bc_trie_free(config);
+    return rv;
+}
+
+
+// computes the number of pages of a listing from the metadata of the sources
+// only, without parsing their content, and without calling blogc. returns -1
+// on error.
+long
+bm_exec_native_count_pages(bm_ctx_t *ctx, bc_trie_t *global_variables,
+    bc_trie_t *local_variables, bc_slist_t *sources)
+{
+    if (ctx == NULL)
+        return -1;
+
+    bc_trie_t *config = bm_exec_native_build_config(ctx, global_variables,
+        local_variables);
+    bc_error_t *err = NULL;
+
+    bc_slist_t *s = build_sources(ctx, config, sources, false, true, NULL, &err);
+    if (err != NULL) {
+        bc_error_print(err, "blogc-make");
+        bc_error_free(err);
+        bc_trie_free(config);
+        return -1;
+    }
+
+    // not set if there are no pages
+    const char *last_page = bc_trie_lookup(config, "LAST_PAGE");
+    long rv = last_page != NULL ? strtol(last_page, NULL, 10) : 0;
 
+    bc_slist_free(s);
+    bc_trie_free(config);
     return rv;
 }
@@ -10,11 +10,28 @@
 #define _MAKE_EXEC_NATIVE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "../common/error.h"
+#include "../common/utils.h"
 #include "ctx.h"
 
-int bm_exec_native_cp(bm_filectx_t *source, bm_filectx_t *dest, bool verbose);
+int bm_exec_native_cp(bm_ctx_t *ctx, bm_filectx_t *source, bm_filectx_t *dest);
+int bm_exec_native_restore(bm_ctx_t *ctx, bm_filectx_t *output,
+    const char *content, size_t len);
 bool bm_exec_native_is_empty_dir(const char *dir, bc_error_t **err);
-int bm_exec_native_rm(const char *output_dir, bm_filectx_t *dest, bool verbose);
+int bm_exec_native_rm(const char *output_dir, bc_slist_t *files, bool verbose);
+int bm_exec_native_blogc(bm_ctx_t *ctx, bc_trie_t *global_variables,
+    bc_trie_t *local_variables, bool listing, bm_filectx_t *listing_entry,
+    bm_filectx_t *template, bm_filectx_t *output, bc_slist_t *sources,
+    bool only_first_source, bool minify);
+bc_trie_t* bm_exec_native_build_config(bm_ctx_t *ctx,
+    bc_trie_t *global_variables, bc_trie_t *local_variables);
+bc_slist_t* bm_exec_native_filter_sources(bm_ctx_t *ctx,
+    bc_trie_t *global_variables, bc_trie_t *local_variables,
+    bc_slist_t *sources, bc_trie_t **config, bc_error_t **err);
+char* bm_exec_native_set_locale(bm_ctx_t *ctx);
+void bm_exec_native_restore_locale(char *locale);
+long bm_exec_native_count_pages(bm_ctx_t *ctx, bc_trie_t *global_variables,
+    bc_trie_t *local_variables, bc_slist_t *sources);
 
 #endif /* _MAKE_EXEC_NATIVE_H */
@@ -10,18 +10,20 @@
 #include <config.h>
 #endif /* HAVE_CONFIG_H */
 
-#ifdef HAVE_SYSEXITS_H
-#include <sysexits.h>
-#else
-#define EX_CONFIG 78
-#endif /* HAVE_SYSEXITS_H */
-
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
 #include <sys/wait.h>
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif /* HAVE_SYS_RESOURCE_H */
 #include <errno.h>
 #include <libgen.h>
 #include "../common/compat.h"
@@ -30,7 +32,16 @@
 #include "../common/utils.h"
 #include "ctx.h"
 #include "exec.h"
+#include "exec-native.h"
+#include "jobs.h"
 #include "settings.h"
+#include "trace.h"
+
+// variables are passed to external blogc binaries in the command line. if
+// they are too big for it, the job is passed to blogc's batch mode by stdin.
+#define BM_EXEC_MAX_ARGV_LEN (64 * 1024)
+
+extern char **environ;
 
 
 char*
@@ -41,14 +52,14 @@ bm_exec_find_binary(const char *argv0, const char *bin, const char *env)
     // argv0, because the static binary may not be named `blogc`, and we
     // prefer to use our own `blogc` instead of some other version around.
     if (argv0 != NULL && bin != NULL && (0 == strcmp(bin, "blogc"))) {
-        return bc_shell_quote(argv0);
+        return bc_strdup(argv0);
     }
 #endif
 
     // first try: env var
     const char *env_bin = getenv(env);
     if (env_bin != NULL) {
-        return bc_shell_quote(env_bin);
+        return bc_strdup(env_bin);
     }
 
     // second try: same dir as current exec
@@ -65,11 +76,8 @@ bm_exec_find_binary(const char *argv0, const char *bin, const char *env)
         free(path);
         char *tmp = bc_strdup_printf("%s/%s", dir, bin);
         free(dir);
-        if (0 == access(tmp, X_OK)) {
-            char *rv = bc_shell_quote(tmp);
-            free(tmp);
-            return rv;
-        }
+        if (0 == access(tmp, X_OK))
+            return tmp;
         free(tmp);
     }
 
@@ -78,138 +86,245 @@ bm_exec_find_binary(const char *argv0, const char *bin, const char *env)
 }
 
 
+bool
+bm_exec_use_native_blogc(void)
+{
+#ifdef MAKE_EMBEDDED
+    // embedded blogc-make is part of the blogc binary, the external binary
+    // would be ourselves anyway.
+    return true;
+#else
+    // if user asked for a specific blogc binary, we call it for each output.
+    // otherwise we render in-process, using the same code linked into blogc.
+    return getenv("BLOGC") == NULL;
+#endif
+}
+
+
+// concurrent jobs may spawn at the same time, so pipes are created with
+// FD_CLOEXEC set, and under a lock, to avoid leaking them to other children,
+// that would keep them open and block the readers.
+static pthread_mutex_t mutex_fork = PTHREAD_MUTEX_INITIALIZER;
+
+
+static int
+create_pipe(int fd[2])
+{
+    if (-1 == pipe(fd))
+        return -1;
+    fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+}
+
+
 int
-bm_exec_command(const char *cmd, const char *input, char **output,
-    char **error, bc_error_t **err)
+bm_exec_command(char *const argv[], char *const envp[], const char *input,
+    char **output, char **error, bc_error_t **err)
 {
-    if (err == NULL || *err != NULL)
+    if (argv == NULL || argv[0] == NULL || err == NULL || *err != NULL)
         return 1;
 
+    bm_trace_span_t span;
+    bm_trace_begin(&span);
+
+    pthread_mutex_lock(&mutex_fork);
+
     int fd_in[2];
-    if (-1 == pipe(fd_in)) {
+    if (-1 == create_pipe(fd_in)) {
         *err = bc_error_new_printf(BLOGC_MAKE_ERROR_EXEC,
             "Failed to create stdin pipe: %s", strerror(errno));
+        pthread_mutex_unlock(&mutex_fork);
         return 1;
     }
 
     int fd_out[2];
-    if (-1 == pipe(fd_out)) {
+    if (-1 == create_pipe(fd_out)) {
         *err = bc_error_new_printf(BLOGC_MAKE_ERROR_EXEC,
             "Failed to create stdout pipe: %s", strerror(errno));
         close(fd_in[0]);
         close(fd_in[1]);
+        pthread_mutex_unlock(&mutex_fork);
         return 1;
     }
 
     int fd_err[2];
-    if (-1 == pipe(fd_err)) {
+    if (-1 == create_pipe(fd_err)) {
         *err = bc_error_new_printf(BLOGC_MAKE_ERROR_EXEC,
             "Failed to create stderr pipe: %s", strerror(errno));
         close(fd_in[0]);
         close(fd_in[1]);
         close(fd_out[0]);
         close(fd_out[1]);
+        pthread_mutex_unlock(&mutex_fork);
         return 1;
     }
 
-    pid_t pid = fork();
-    if (pid == -1) {
+    // the duplicated file descriptors don't have FD_CLOEXEC set, so only
+    // these ones are inherited by the child.
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fd_in[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fd_out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fd_err[1], STDERR_FILENO);
+
+    // SIGPIPE is ignored by blogc-make, but the child should get the
+    // default behavior.
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t sigdefault;
+    sigemptyset(&sigdefault);
+    sigaddset(&sigdefault, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &sigdefault);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+    // binaries without a directory are looked up in $PATH.
+    pid_t pid;
+    int spawn_errno = posix_spawnp(&pid, argv[0], &actions, &attr, argv,
+        envp != NULL ? envp : environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    pthread_mutex_unlock(&mutex_fork);
+
+    close(fd_in[0]);
+    close(fd_out[1]);
+    close(fd_err[1]);
+
+    if (spawn_errno != 0) {
         *err = bc_error_new_printf(BLOGC_MAKE_ERROR_EXEC,
-            "Failed to fork: %s", strerror(errno));
-        close(fd_in[0]);
+            "Failed to execute command (%s): %s", argv[0],
+            strerror(spawn_errno));
         close(fd_in[1]);
         close(fd_out[0]);
-        close(fd_out[1]);
         close(fd_err[0]);
-        close(fd_err[1]);
         return 1;
     }
 
-    // child
-    if (pid == 0) {
-        close(fd_in[1]);
-        close(fd_out[0]);
-        close(fd_err[0]);
-
-        dup2(fd_in[0], STDIN_FILENO);
-        dup2(fd_out[1], STDOUT_FILENO);
-        dup2(fd_err[1], STDERR_FILENO);
-
-        char *const argv[] = {
-            "/bin/sh",
-            "-c",
-            (char*) cmd,
-            NULL,
-        };
-
-        execv(argv[0], argv);
+    // stdin is written while stdout and stderr are read, so a child that
+    // fills one of the pipes before reading all its input (or before writing
+    // to the other pipe) can't block us.
+    size_t input_len = input != NULL ? strlen(input) : 0;
+    size_t input_offset = 0;
+    bc_string_t *out = NULL;
+    bc_string_t *out_err = NULL;
+    char buffer[BC_FILE_CHUNK_SIZE];
 
-        exit(1);
+    if (input_len == 0) {
+        close(fd_in[1]);
+        fd_in[1] = -1;
+    }
+    else {
+        fcntl(fd_in[1], F_SETFL, fcntl(fd_in[1], F_GETFL) | O_NONBLOCK);
     }
 
-    // parent
-    close(fd_in[0]);
-    close(fd_out[1]);
-    close(fd_err[1]);
+    struct pollfd fds[3] = {
+        {.fd = fd_in[1], .events = POLLOUT},
+        {.fd = fd_out[0], .events = POLLIN},
+        {.fd = fd_err[0], .events = POLLIN},
+    };
 
-    if (input != NULL) {
-        if (-1 == write(fd_in[1], input, strlen(input))) {
+    while (fds[0].fd >= 0 || fds[1].fd >= 0 || fds[2].fd >= 0) {
+        if (-1 == poll(fds, 3, -1)) {
+            if (errno == EINTR)
+                continue;
             *err = bc_error_new_printf(BLOGC_MAKE_ERROR_EXEC,
-                "Failed to write to stdin pipe: %s", strerror(errno));
-            close(fd_in[1]);
-            close(fd_out[0]);
-            close(fd_err[0]);
-            return 1;
+                "Failed to poll pipes: %s", strerror(errno));
+            break;
         }
-    }
 
-    close(fd_in[1]);
-
-    char buffer[BC_FILE_CHUNK_SIZE];
-    ssize_t s;
-
-    bc_string_t *out = NULL;
-    while(0 != (s = read(fd_out[0], buffer, BC_FILE_CHUNK_SIZE))) {
-        if (s == -1) {
-            *err = bc_error_new_printf(BLOGC_MAKE_ERROR_EXEC,
-                "Failed to read from stdout pipe: %s", strerror(errno));
-            close(fd_out[0]);
-            close(fd_err[0]);
-            bc_string_free(out, true);
-            return 1;
+        // a pipe without reader reports POLLERR together with POLLOUT, so
+        // the errors are checked first. the child closed its stdin without
+        // reading everything, and its exit status tells what happened.
+        if (fds[0].fd >= 0 && (fds[0].revents & (POLLERR | POLLHUP))) {
+            close(fds[0].fd);
+            fds[0].fd = -1;
         }
-        if (out == NULL) {
-            out = bc_string_new();
+        else if (fds[0].fd >= 0 && (fds[0].revents & POLLOUT)) {
+            ssize_t s = write(fds[0].fd, input + input_offset,
+                input_len - input_offset);
+            if (s == -1 && errno == EPIPE) {
+                close(fds[0].fd);
+                fds[0].fd = -1;
+            }
+            else if (s == -1 && errno != EAGAIN && errno != EINTR) {
+                *err = bc_error_new_printf(BLOGC_MAKE_ERROR_EXEC,
+                    "Failed to write to stdin pipe: %s", strerror(errno));
+                break;
+            }
+            if (s > 0)
+                input_offset += s;
+            if (fds[0].fd >= 0 && input_offset == input_len) {
+                close(fds[0].fd);
+                fds[0].fd = -1;
+            }
+        }
+        else if (fds[0].fd >= 0 && fds[0].revents != 0) {
+            close(fds[0].fd);
+            fds[0].fd = -1;
         }
-        bc_string_append_len(out, buffer, s);
-    }
-    if (out != NULL) {
-        *output = bc_string_free(out, false);
-    }
-    close(fd_out[0]);
 
-    out = NULL;
-    while(0 != (s = read(fd_err[0], buffer, BC_FILE_CHUNK_SIZE))) {
-        if (s == -1) {
-            *err = bc_error_new_printf(BLOGC_MAKE_ERROR_EXEC,
-                "Failed to read from stderr pipe: %s", strerror(errno));
-            close(fd_err[0]);
-            bc_string_free(out, true);
-            return 1;
+        for (size_t i = 1; i < 3; i++) {
+            if (fds[i].fd < 0 || fds[i].revents == 0)
+                continue;
+            ssize_t s = read(fds[i].fd, buffer, BC_FILE_CHUNK_SIZE);
+            if (s == -1 && errno == EINTR)
+                continue;
+            if (s == -1) {
+                *err = bc_error_new_printf(BLOGC_MAKE_ERROR_EXEC,
+                    "Failed to read from %s pipe: %s",
+                    i == 1 ? "stdout" : "stderr", strerror(errno));
+                break;
+            }
+            if (s == 0) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                continue;
+            }
+            bc_string_t **str = i == 1 ? &out : &out_err;
+            if (*str == NULL)
+                *str = bc_string_new();
+            bc_string_append_len(*str, buffer, s);
         }
-        if (out == NULL)
-            out = bc_string_new();
-        bc_string_append_len(out, buffer, s);
-    }
-    if (out != NULL) {
-        *error = bc_string_free(out, false);
+        if (*err != NULL)
+            break;
     }
-    close(fd_err[0]);
+
+    for (size_t i = 0; i < 3; i++)
+        if (fds[i].fd >= 0)
+            close(fds[i].fd);
 
     int status;
+    long long cpu = 0;
+#if defined(HAVE_WAIT4) && defined(HAVE_SYS_RESOURCE_H)
+    struct rusage usage;
+    if (pid == wait4(pid, &status, 0, &usage))
+        cpu = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL +
+            usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#else
     waitpid(pid, &status, 0);
+#endif
+
+    if (*err != NULL) {
+        bc_string_free(out, true);
+        bc_string_free(out_err, true);
+        return 1;
+    }
+
+    if (out != NULL)
+        *output = bc_string_free(out, false);
+    if (out_err != NULL)
+        *error = bc_string_free(out_err, false);
+
+    int rv = bc_compat_status_code(status);
+
+    // cpu_us of the event is the time spent by this thread, waiting for the
+    // child process. the time spent by the child is child_cpu_us.
+    bm_trace_end(&span, "exec", argv[0],
+        "\"pid\": %ld, \"status\": %d, \"child_cpu_us\": %lld",
+        (long) pid, rv, cpu);
 
-    return bc_compat_status_code(status);
+    return rv;
 }
 
 
@@ -226,7 +341,7 @@ char*
 bm_exec_build_blogc_cmd(const char *blogc_bin, bm_settings_t *settings,
     bc_trie_t *global_variables, bc_trie_t *local_variables, const char *print,
     bool listing, const char *listing_entry, const char *template,
-    const char *output, bool dev, bool sources_stdin)
+    const char *output, bool dev, bool minify, bool sources_stdin)
 {
     bc_string_t *rv = bc_string_new();
 
@@ -285,6 +400,10 @@ bm_exec_build_blogc_cmd(const char *blogc_bin, bm_settings_t *settings,
         free(tmp);
     }
 
+    if (minify) {
+        bc_string_append(rv, " -M");
+    }
+
     if (sources_stdin) {
         bc_string_append(rv, " -i");
     }
@@ -293,14 +412,120 @@ bm_exec_build_blogc_cmd(const char *blogc_bin, bm_settings_t *settings,
 }
 
 
+static void
+list_variables_argv(const char *key, const char *value, bc_slist_t **args)
+{
+    *args = bc_slist_append(*args, bc_strdup("-D"));
+    *args = bc_slist_append(*args, bc_strdup_printf("%s=%s", key, value));
+}
+
+
+// same arguments of bm_exec_build_blogc_cmd(), but as an argument vector, to
+// be executed without a shell. the locale must be set in the environment.
+char**
+bm_exec_build_blogc_argv(const char *blogc_bin, bm_settings_t *settings,
+    bc_trie_t *global_variables, bc_trie_t *local_variables, bool listing,
+    const char *listing_entry, const char *template, const char *output,
+    bool dev, bool minify, bool sources_stdin)
+{
+    bc_slist_t *args = bc_slist_append(NULL, bc_strdup(blogc_bin));
+
+    if (settings != NULL) {
+        if (settings->tags != NULL) {
+            char *tags = bc_strv_join(settings->tags, " ");
+            args = bc_slist_append(args, bc_strdup("-D"));
+            args = bc_slist_append(args, bc_strdup_printf("MAKE_TAGS=%s", tags));
+            free(tags);
+        }
+
+        bc_trie_foreach(settings->global,
+            (bc_trie_foreach_func_t) list_variables_argv, &args);
+    }
+
+    bc_trie_foreach(global_variables,
+        (bc_trie_foreach_func_t) list_variables_argv, &args);
+    bc_trie_foreach(local_variables,
+        (bc_trie_foreach_func_t) list_variables_argv, &args);
+
+    if (dev) {
+        list_variables_argv("MAKE_ENV_DEV", "1", &args);
+        list_variables_argv("MAKE_ENV", "dev", &args);
+    }
+
+    if (listing) {
+        args = bc_slist_append(args, bc_strdup("-l"));
+        if (listing_entry != NULL) {
+            args = bc_slist_append(args, bc_strdup("-e"));
+            args = bc_slist_append(args, bc_strdup(listing_entry));
+        }
+    }
+
+    if (template != NULL) {
+        args = bc_slist_append(args, bc_strdup("-t"));
+        args = bc_slist_append(args, bc_strdup(template));
+    }
+
+    if (output != NULL) {
+        args = bc_slist_append(args, bc_strdup("-o"));
+        args = bc_slist_append(args, bc_strdup(output));
+    }
+
+    if (minify)
+        args = bc_slist_append(args, bc_strdup("-M"));
+
+    if (sources_stdin)
+        args = bc_slist_append(args, bc_strdup("-i"));
+
+    char **rv = bc_malloc(sizeof(char*) * (bc_slist_length(args) + 1));
+    size_t i = 0;
+    for (bc_slist_t *tmp = args; tmp != NULL; tmp = tmp->next)
+        rv[i++] = tmp->data;
+    rv[i] = NULL;
+    bc_slist_free(args);
+    return rv;
+}
+
+
+// environment for external blogc binaries, with the locale from the
+// settings. returns NULL to use our own environment.
+static char**
+build_envp(bm_settings_t *settings)
+{
+    const char *locale = NULL;
+    if (settings != NULL)
+        locale = bc_trie_lookup(settings->settings, "locale");
+    if (locale == NULL)
+        return NULL;
+
+    size_t len = 0;
+    for (char **e = environ; *e != NULL; e++)
+        len++;
+
+    char **rv = bc_malloc(sizeof(char*) * (len + 2));
+    size_t i = 0;
+    for (char **e = environ; *e != NULL; e++)
+        if (0 != strncmp(*e, "LC_ALL=", 7))
+            rv[i++] = bc_strdup(*e);
+    rv[i++] = bc_strdup_printf("LC_ALL=%s", locale);
+    rv[i] = NULL;
+    return rv;
+}
+
+
 int
 bm_exec_blogc(bm_ctx_t *ctx, bc_trie_t *global_variables, bc_trie_t *local_variables,
     bool listing, bm_filectx_t *listing_entry, bm_filectx_t *template,
-    bm_filectx_t *output, bc_slist_t *sources, bool only_first_source)
+    bm_filectx_t *output, bc_slist_t *sources, bool only_first_source,
+    bool minify)
 {
     if (ctx == NULL)
         return 1;
 
+    if (ctx->blogc_native)
+        return bm_exec_native_blogc(ctx, global_variables, local_variables,
+            listing, listing_entry, template, output, sources, only_first_source,
+            minify);
+
     bc_string_t *input = bc_string_new();
     for (bc_slist_t *l = sources; l != NULL; l = l->next) {
         bc_string_append_printf(input, "%s\n", ((bm_filectx_t*) l->data)->path);
@@ -308,25 +533,79 @@ bm_exec_blogc(bm_ctx_t *ctx, bc_trie_t *global_variables, bc_trie_t *local_varia
             break;
     }
 
-    char *cmd = bm_exec_build_blogc_cmd(ctx->blogc, ctx->settings, global_variables,
-        local_variables, NULL, listing, listing_entry == NULL ? NULL : listing_entry->path,
-        template->path, output->path, ctx->dev, input->len > 0);
+    char **argv = bm_exec_build_blogc_argv(ctx->blogc, ctx->settings,
+        global_variables, local_variables, listing,
+        listing_entry == NULL ? NULL : listing_entry->path, template->path,
+        output->path, ctx->dev, minify, false);
 
-    if (ctx->verbose)
-        printf("%s\n", cmd);
-    else
-        printf("  BLOGC    %s\n", output->short_path);
-    fflush(stdout);
+    size_t argv_len = 0;
+    for (size_t i = 0; argv[i] != NULL; i++)
+        argv_len += strlen(argv[i]) + 1;
+
+    if (argv_len > BM_EXEC_MAX_ARGV_LEN) {
+        // everything but the binary goes to a job line, quoted as for the
+        // shell, followed by the sources.
+        bc_string_t *job = bc_string_new();
+        for (size_t i = 1; argv[i] != NULL; i++) {
+            char *tmp = bc_shell_quote(argv[i]);
+            bc_string_append_printf(job, "%s ", tmp);
+            free(tmp);
+        }
+        for (bc_slist_t *l = sources; l != NULL; l = l->next) {
+            char *tmp = bc_shell_quote(((bm_filectx_t*) l->data)->path);
+            bc_string_append_printf(job, "%s ", tmp);
+            free(tmp);
+            if (only_first_source)
+                break;
+        }
+        bc_string_append_c(job, '\n');
+        bc_string_free(input, true);
+        input = job;
+
+        char *bin = argv[0];
+        for (size_t i = 1; argv[i] != NULL; i++)
+            free(argv[i]);
+        free(argv);
+        argv = bc_malloc(sizeof(char*) * 4);
+        argv[0] = bin;
+        argv[1] = bc_strdup("-b");
+        argv[2] = bc_strdup("-");
+        argv[3] = NULL;
+    }
+    else if (input->len > 0) {
+        size_t len = bc_strv_length(argv);
+        argv = bc_realloc(argv, sizeof(char*) * (len + 2));
+        argv[len] = bc_strdup("-i");
+        argv[len + 1] = NULL;
+    }
+
+    char **envp = build_envp(ctx->settings);
+
+    if (ctx->verbose) {
+        char *bin = bc_shell_quote(ctx->blogc);
+        char *cmd = bm_exec_build_blogc_cmd(bin, ctx->settings,
+            global_variables, local_variables, NULL, listing,
+            listing_entry == NULL ? NULL : listing_entry->path, template->path,
+            output->path, ctx->dev, minify, input->len > 0);
+        bm_jobs_printf("%s\n", cmd);
+        free(cmd);
+        free(bin);
+    }
+    else {
+        bm_jobs_printf("  BLOGC    %s\n", output->short_path);
+    }
 
     char *out = NULL;
     char *err = NULL;
     bc_error_t *error = NULL;
 
-    int rv = bm_exec_command(cmd, input->str, &out, &err, &error);
+    int rv = bm_exec_command(argv, envp, input->str, &out, &err, &error);
+
+    bc_strv_free(argv);
+    bc_strv_free(envp);
 
     if (error != NULL) {
-        bc_error_print(error, "blogc-make");
-        free(cmd);
+        bm_jobs_error_print(error);
         free(out);
         free(err);
         bc_string_free(input, true);
@@ -335,39 +614,38 @@ bm_exec_blogc(bm_ctx_t *ctx, bc_trie_t *global_variables, bc_trie_t *local_varia
     }
 
     if (rv != 0 && ctx->verbose) {
-        fprintf(stderr,
+        bm_jobs_eprintf(
             "blogc-make: error: Failed to execute command.\n"
             "\n"
             "STATUS CODE: %d\n", rv);
         if (input->len > 0) {
-            fprintf(stderr, "\nSTDIN:\n"
+            bm_jobs_eprintf("\nSTDIN:\n"
                 "----------------------------->8-----------------------------\n"
                 "%s\n"
                 "----------------------------->8-----------------------------\n",
                 bc_str_strip(input->str));
         }
         if (out != NULL) {
-            fprintf(stderr, "\nSTDOUT:\n"
+            bm_jobs_eprintf("\nSTDOUT:\n"
                 "----------------------------->8-----------------------------\n"
                 "%s\n"
                 "----------------------------->8-----------------------------\n",
                 bc_str_strip(out));
         }
         if (err != NULL) {
-            fprintf(stderr, "\nSTDERR:\n"
+            bm_jobs_eprintf("\nSTDERR:\n"
                 "----------------------------->8-----------------------------\n"
                 "%s\n"
                 "----------------------------->8-----------------------------\n",
                 bc_str_strip(err));
         }
-        fprintf(stderr, "\n");
+        bm_jobs_eprintf("\n");
     }
     else if (err != NULL) {
-        fprintf(stderr, "%s\n", err);
+        bm_jobs_eprintf("%s\n", err);
     }
 
     bc_string_free(input, true);
-    free(cmd);
     free(out);
     free(err);
 
@@ -375,67 +653,6 @@ bm_exec_blogc(bm_ctx_t *ctx, bc_trie_t *global_variables, bc_trie_t *local_varia
 }
 
 
-char*
-bm_exec_blogc_get_variable(bm_ctx_t *ctx, bc_trie_t *global_variables,
-    bc_trie_t *local_variables, const char *variable, bool listing,
-    bc_slist_t *sources, bool only_first_source)
-{
-    if (ctx == NULL)
-        return NULL;
-
-    bc_string_t *input = bc_string_new();
-    for (bc_slist_t *l = sources; l != NULL; l = l->next) {
-        bc_string_append_printf(input, "%s\n", ((bm_filectx_t*) l->data)->path);
-        if (only_first_source)
-            break;
-    }
-
-    char *cmd = bm_exec_build_blogc_cmd(ctx->blogc, ctx->settings, global_variables,
-        local_variables, variable, listing, NULL, NULL, NULL, ctx->dev, input->len > 0);
-
-    if (ctx->verbose)
-        printf("%s\n", cmd);
-    fflush(stdout);
-
-    char *out = NULL;
-    char *err = NULL;
-    bc_error_t *error = NULL;
-
-    int rv = bm_exec_command(cmd, input->str, &out, &err, &error);
-
-    if (error != NULL) {
-        bc_error_print(error, "blogc-make");
-        bc_error_free(error);
-        bc_string_free(input, true);
-        free(cmd);
-        free(out);
-        free(err);
-        return NULL;
-    }
-
-    if (rv != 0) {
-        if (rv != EX_CONFIG)
-            fprintf(stderr, "blogc-make: error: %s\n", bc_str_strip(err));
-        bc_string_free(input, true);
-        free(cmd);
-        free(out);
-        free(err);
-        return NULL;
-    }
-
-    char *val = NULL;
-    if (out != NULL)
-        val = bc_strndup(out, strlen(out) - 1);
-
-    bc_string_free(input, true);
-    free(cmd);
-    free(out);
-    free(err);
-
-    return val;
-}
-
-
 int
 bm_exec_blogc_runserver(bm_ctx_t *ctx, const char *host, const char *port,
     const char *threads)
@@ -445,7 +662,9 @@ bm_exec_blogc_runserver(bm_ctx_t *ctx, const char *host, const char *port,
 
     bc_string_t *cmd = bc_string_new();
 
-    bc_string_append(cmd, ctx->blogc_runserver);
+    char *bin = bc_shell_quote(ctx->blogc_runserver);
+    bc_string_append(cmd, bin);
+    free(bin);
 
     if (host != NULL) {
         char *tmp = bc_shell_quote(host);
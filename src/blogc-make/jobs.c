@@ -0,0 +1,283 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../common/error.h"
+#include "../common/utils.h"
+#include "jobs.h"
+
+// jobs running in the pool write their log lines to buffers, that are
+// printed at once when the job finishes, to avoid interleaving the output of
+// concurrent jobs. outside of the pool we just print directly.
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key_job;
+static pthread_mutex_t mutex_output = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void
+key_create(void)
+{
+    pthread_key_create(&key_job, NULL);
+}
+
+
+static void
+job_free(bm_job_t *job)
+{
+    if (job == NULL)
+        return;
+    if (job->free_func != NULL)
+        job->free_func(job->data);
+    bc_string_free(job->out, true);
+    bc_string_free(job->err, true);
+    free(job);
+}
+
+
+static void
+job_flush(bm_job_t *job)
+{
+    pthread_mutex_lock(&mutex_output);
+    if (job->out->len > 0) {
+        fputs(job->out->str, stdout);
+        fflush(stdout);
+    }
+    if (job->err->len > 0) {
+        fputs(job->err->str, stderr);
+        fflush(stderr);
+    }
+    pthread_mutex_unlock(&mutex_output);
+}
+
+
+static void*
+worker(void *arg)
+{
+    bm_jobs_t *jobs = arg;
+
+    while (true) {
+        pthread_mutex_lock(&jobs->mutex);
+        while (jobs->queue == NULL && !jobs->stop)
+            pthread_cond_wait(&jobs->cond_queue, &jobs->mutex);
+        if (jobs->queue == NULL) {  // stopping
+            pthread_mutex_unlock(&jobs->mutex);
+            break;
+        }
+        bc_slist_t *head = jobs->queue;
+        jobs->queue = head->next;
+        if (jobs->queue == NULL)
+            jobs->queue_tail = NULL;
+        bm_job_t *job = head->data;
+        free(head);
+
+        // after a failure we just drain the queue, without running anything
+        bool skip = jobs->failed;
+        pthread_mutex_unlock(&jobs->mutex);
+
+        int rv = 0;
+        if (!skip) {
+            job->out = bc_string_new();
+            job->err = bc_string_new();
+            pthread_setspecific(key_job, job);
+            rv = job->func(job->data);
+            pthread_setspecific(key_job, NULL);
+            job_flush(job);
+        }
+        job_free(job);
+
+        pthread_mutex_lock(&jobs->mutex);
+        if (rv != 0)
+            jobs->failed = true;
+        if (--jobs->pending == 0)
+            pthread_cond_broadcast(&jobs->cond_done);
+        pthread_mutex_unlock(&jobs->mutex);
+    }
+
+    return NULL;
+}
+
+
+bm_jobs_t*
+bm_jobs_new(size_t num_threads)
+{
+    if (num_threads == 0)
+        return NULL;
+
+    pthread_once(&key_once, key_create);
+
+    bm_jobs_t *rv = bc_malloc(sizeof(bm_jobs_t));
+    rv->threads = bc_malloc(num_threads * sizeof(pthread_t));
+    rv->num_threads = 0;
+    rv->queue = NULL;
+    rv->queue_tail = NULL;
+    rv->pending = 0;
+    rv->failed = false;
+    rv->stop = false;
+    pthread_mutex_init(&rv->mutex, NULL);
+    pthread_cond_init(&rv->cond_queue, NULL);
+    pthread_cond_init(&rv->cond_done, NULL);
+
+    for (size_t i = 0; i < num_threads; i++) {
+        if (0 != pthread_create(&rv->threads[i], NULL, worker, rv))
+            break;
+        rv->num_threads++;
+    }
+
+    if (rv->num_threads == 0) {
+        bm_jobs_free(rv);
+        return NULL;
+    }
+
+    return rv;
+}
+
+
+void
+bm_jobs_free(bm_jobs_t *jobs)
+{
+    if (jobs == NULL)
+        return;
+
+    pthread_mutex_lock(&jobs->mutex);
+    jobs->stop = true;
+    pthread_cond_broadcast(&jobs->cond_queue);
+    pthread_mutex_unlock(&jobs->mutex);
+
+    for (size_t i = 0; i < jobs->num_threads; i++)
+        pthread_join(jobs->threads[i], NULL);
+
+    pthread_cond_destroy(&jobs->cond_done);
+    pthread_cond_destroy(&jobs->cond_queue);
+    pthread_mutex_destroy(&jobs->mutex);
+    free(jobs->threads);
+    free(jobs);
+}
+
+
+// runs the job right away if there's no pool. returns non-zero if the job
+// failed, or if some job in the pool failed already, meaning that the caller
+// should stop submitting jobs.
+int
+bm_jobs_submit(bm_jobs_t *jobs, bm_job_func_t func, void *data,
+    bc_free_func_t free_func)
+{
+    if (func == NULL)
+        return 1;
+
+    if (jobs == NULL) {
+        int rv = func(data);
+        if (free_func != NULL)
+            free_func(data);
+        return rv;
+    }
+
+    bm_job_t *job = bc_malloc(sizeof(bm_job_t));
+    job->func = func;
+    job->data = data;
+    job->free_func = free_func;
+    job->out = NULL;
+    job->err = NULL;
+
+    pthread_mutex_lock(&jobs->mutex);
+
+    if (jobs->failed) {
+        pthread_mutex_unlock(&jobs->mutex);
+        job_free(job);
+        return 1;
+    }
+
+    bc_slist_t *l = bc_malloc(sizeof(bc_slist_t));
+    l->data = job;
+    l->next = NULL;
+    if (jobs->queue_tail == NULL)
+        jobs->queue = l;
+    else
+        jobs->queue_tail->next = l;
+    jobs->queue_tail = l;
+    jobs->pending++;
+
+    pthread_cond_signal(&jobs->cond_queue);
+    pthread_mutex_unlock(&jobs->mutex);
+
+    return 0;
+}
+
+
+// waits for all the submitted jobs, returning non-zero if any of them failed.
+int
+bm_jobs_wait(bm_jobs_t *jobs)
+{
+    if (jobs == NULL)
+        return 0;
+
+    pthread_mutex_lock(&jobs->mutex);
+    while (jobs->pending > 0)
+        pthread_cond_wait(&jobs->cond_done, &jobs->mutex);
+    int rv = jobs->failed ? 1 : 0;
+    jobs->failed = false;
+    pthread_mutex_unlock(&jobs->mutex);
+
+    return rv;
+}
+
+
+static void
+jobs_vprintf(bool error, const char *format, va_list ap)
+{
+    bm_job_t *job = NULL;
+    pthread_once(&key_once, key_create);
+    job = pthread_getspecific(key_job);
+
+    char *tmp = bc_strdup_vprintf(format, ap);
+    if (job != NULL) {
+        bc_string_append(error ? job->err : job->out, tmp);
+    }
+    else {
+        pthread_mutex_lock(&mutex_output);
+        fputs(tmp, error ? stderr : stdout);
+        fflush(error ? stderr : stdout);
+        pthread_mutex_unlock(&mutex_output);
+    }
+    free(tmp);
+}
+
+
+void
+bm_jobs_printf(const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    jobs_vprintf(false, format, ap);
+    va_end(ap);
+}
+
+
+void
+bm_jobs_eprintf(const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    jobs_vprintf(true, format, ap);
+    va_end(ap);
+}
+
+
+void
+bm_jobs_error_print(bc_error_t *err)
+{
+    char *tmp = bc_error_to_string(err, "blogc-make");
+    if (tmp == NULL)
+        return;
+    bm_jobs_eprintf("%s\n", tmp);
+    free(tmp);
+}
@@ -0,0 +1,50 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#ifndef _MAKE_JOBS_H
+#define _MAKE_JOBS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../common/error.h"
+#include "../common/utils.h"
+
+typedef int (*bm_job_func_t) (void *data);
+
+typedef struct {
+    bm_job_func_t func;
+    void *data;
+    bc_free_func_t free_func;
+    bc_string_t *out;
+    bc_string_t *err;
+} bm_job_t;
+
+typedef struct {
+    pthread_t *threads;
+    size_t num_threads;
+    bc_slist_t *queue;
+    bc_slist_t *queue_tail;
+    size_t pending;
+    bool failed;
+    bool stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_queue;
+    pthread_cond_t cond_done;
+} bm_jobs_t;
+
+bm_jobs_t* bm_jobs_new(size_t num_threads);
+void bm_jobs_free(bm_jobs_t *jobs);
+int bm_jobs_submit(bm_jobs_t *jobs, bm_job_func_t func, void *data,
+    bc_free_func_t free_func);
+int bm_jobs_wait(bm_jobs_t *jobs);
+void bm_jobs_printf(const char *format, ...);
+void bm_jobs_eprintf(const char *format, ...);
+void bm_jobs_error_print(bc_error_t *err);
+
+#endif /* _MAKE_JOBS_H */
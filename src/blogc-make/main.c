@@ -11,13 +11,18 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <locale.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "../common/error.h"
 #include "../common/utils.h"
+#include "artifacts.h"
 #include "ctx.h"
+#include "jobs.h"
+#include "manifest.h"
 #include "rules.h"
+#include "trace.h"
 
 
 static void
@@ -25,7 +30,8 @@ print_help(void)
 {
     printf(
         "usage:\n"
-        "    blogc-make [-h] [-v] [-D] [-V] [-f FILE] [RULE ...]\n"
+        "    blogc-make [-h] [-v] [-D] [-V] [-j JOBS] [-f FILE] [-t FILE]\n"
+        "               [-s SHARD] [-c DIR] [RULE ...]\n"
         "               - A simple build tool for blogc.\n"
         "\n"
         "positional arguments:\n"
@@ -38,7 +44,15 @@ print_help(void)
         "    -v               show version and exit\n"
         "    -D               build for development environment\n"
         "    -V               be verbose when executing commands\n"
-        "    -f FILE          read FILE as blogcfile\n");
+        "    -j JOBS          build up to JOBS outputs concurrently (default: 1)\n"
+        "    -f FILE          read FILE as blogcfile\n"
+        "    -t FILE          write a build trace to FILE, in chrome trace\n"
+        "                     event format\n"
+        "    -s SHARD         build only the outputs of SHARD, in the format I/N,\n"
+        "                     where N is the number of shards the outputs are\n"
+        "                     split into, and 1 <= I <= N\n"
+        "    -c DIR           restore outputs from and save them to the artifact\n"
+        "                     cache in DIR\n");
     bm_rule_print_help();
 }
 
@@ -46,7 +60,8 @@ print_help(void)
 static void
 print_usage(void)
 {
-    printf("usage: blogc-make [-h] [-v] [-D] [-V] [-f FILE] [RULE ...]\n");
+    printf("usage: blogc-make [-h] [-v] [-D] [-V] [-j JOBS] [-f FILE] "
+        "[-t FILE] [-s SHARD] [-c DIR] [RULE ...]\n");
 }
 
 
@@ -59,6 +74,14 @@ main(int argc, char **argv)
 {
     setlocale(LC_ALL, "");
 
+    // an external blogc that exits before reading all its input (from
+    // '-b -') must not kill us when we write to its stdin.
+    struct sigaction new_action;
+    new_action.sa_handler = SIG_IGN;
+    sigemptyset(&new_action.sa_mask);
+    new_action.sa_flags = 0;
+    sigaction(SIGPIPE, &new_action, NULL);
+
     int rv = 0;
     bc_error_t *err = NULL;
 
@@ -66,6 +89,11 @@ main(int argc, char **argv)
     bool verbose = false;
     bool dev = false;
     char *blogcfile = NULL;
+    char *trace = NULL;
+    char *artifacts = NULL;
+    long jobs = 1;
+    long shard = 0;
+    long shards = 0;
     bm_ctx_t *ctx = NULL;
 
     for (size_t i = 1; i < argc; i++) {
@@ -83,12 +111,66 @@ main(int argc, char **argv)
                 case 'V':
                     verbose = true;
                     break;
+                case 'j': {
+                    const char *j = NULL;
+                    if (argv[i][2] != '\0')
+                        j = argv[i] + 2;
+                    else if (i + 1 < argc)
+                        j = argv[++i];
+                    char *endptr = NULL;
+                    jobs = j != NULL ? strtol(j, &endptr, 10) : 0;
+                    if (j == NULL || *j == '\0' || *endptr != '\0' || jobs <= 0) {
+                        print_usage();
+                        fprintf(stderr, "blogc-make: error: invalid number of "
+                            "jobs: %s\n", j != NULL ? j : "");
+                        rv = 1;
+                        goto cleanup;
+                    }
+                    break;
+                }
                 case 'f':
                     if (argv[i][2] != '\0')
                         blogcfile = bc_strdup(argv[i] + 2);
                     else if (i + 1 < argc)
                         blogcfile = bc_strdup(argv[++i]);
                     break;
+                case 't':
+                    if (argv[i][2] != '\0')
+                        trace = bc_strdup(argv[i] + 2);
+                    else if (i + 1 < argc)
+                        trace = bc_strdup(argv[++i]);
+                    break;
+                case 'c':
+                    if (argv[i][2] != '\0')
+                        artifacts = bc_strdup(argv[i] + 2);
+                    else if (i + 1 < argc)
+                        artifacts = bc_strdup(argv[++i]);
+                    break;
+                case 's': {
+                    const char *s = NULL;
+                    if (argv[i][2] != '\0')
+                        s = argv[i] + 2;
+                    else if (i + 1 < argc)
+                        s = argv[++i];
+                    char *endptr = NULL;
+                    shard = s != NULL ? strtol(s, &endptr, 10) : 0;
+                    if (s != NULL && endptr != s && *endptr == '/') {
+                        const char *n = endptr + 1;
+                        shards = strtol(n, &endptr, 10);
+                        if (endptr == n)
+                            shards = 0;
+                    }
+                    if (s == NULL || *endptr != '\0' || shard <= 0 ||
+                        shards <= 0 || shard > shards)
+                    {
+                        print_usage();
+                        fprintf(stderr, "blogc-make: error: invalid shard: "
+                            "%s\n", s != NULL ? s : "");
+                        rv = 1;
+                        goto cleanup;
+                    }
+                    break;
+                }
 #ifdef MAKE_EMBEDDED
                 case 'm':
                     // no-op, for embedding into blogc binary.
@@ -111,8 +193,17 @@ main(int argc, char **argv)
         rules = bc_slist_append(rules, bc_strdup("all"));
     }
 
+    if (trace != NULL && !bm_trace_open(trace, &err)) {
+        bc_error_print(err, "blogc-make");
+        rv = 1;
+        goto cleanup;
+    }
+
+    bm_trace_span_t span;
+    bm_trace_begin(&span);
     ctx = bm_ctx_new(NULL, blogcfile ? blogcfile : "blogcfile",
         argc > 0 ? argv[0] : NULL, &err);
+    bm_trace_end(&span, "ctx", "load context", NULL);
     if (err != NULL) {
         bc_error_print(err, "blogc-make");
         rv = 1;
@@ -120,15 +211,33 @@ main(int argc, char **argv)
     }
     ctx->dev = dev;
     ctx->verbose = verbose;
+    if (shards > 0) {
+        ctx->shard = shard - 1;
+        ctx->shards = shards;
+        bm_manifest_set_shard(ctx->manifest, ctx->shard, ctx->shards);
+    }
+    if (jobs > 1) {
+        ctx->jobs = bm_jobs_new(jobs);
+        if (ctx->jobs == NULL)
+            fprintf(stderr, "blogc-make: warning: failed to start jobs, "
+                "building sequentially\n");
+    }
+
+    ctx->artifacts = bm_artifacts_new(artifacts,
+        ctx->blogc_native ? NULL : ctx->blogc);
 
     rv = bm_rule_executor(ctx, rules);
+    bm_artifacts_print_stats(ctx->artifacts);
 
 cleanup:
 
     bc_slist_free_full(rules, free);
     free(blogcfile);
+    free(trace);
+    free(artifacts);
     bm_ctx_free(ctx);
     bc_error_free(err);
+    bm_trace_close();
 
     return rv;
 }
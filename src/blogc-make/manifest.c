@@ -0,0 +1,822 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../common/error.h"
+#include "../common/file.h"
+#include "../common/utils.h"
+#include "manifest.h"
+#include "utils.h"
+
+// the manifest records, for each output file, the content hashes of the
+// input files used to build it, and a hash of the variables passed to blogc.
+// it also caches the content hashes of input files, that are only computed
+// again if the mtime of the file changed.
+//
+// listing outputs also record a combined hash of all the source files they
+// may list, and the members: the source files they actually list. as long as
+// the combined hash doesn't change, the members can be reused without
+// parsing any source file.
+//
+// it is stored in the output directory, in a simple line-based format:
+//
+//   blogc-make manifest 2
+//   F <hash> <mtime sec> <mtime nsec> <input file>
+//   O <variables hash> <sources hash> <output file>
+//   I <hash> <input file>
+//   M <hash> <member file>
+//
+// fields are separated by tabs, and "I" and "M" lines belong to the previous
+// "O" line. file names are relative to the blogcfile directory.
+//
+// sharded builds read the manifest of the whole site, but save only the
+// outputs of their shard, to a manifest of their own, named after the shard
+// (e.g. ".blogc-make-manifest.shard-1-of-4"). the shard manifests are
+// combined back into the main one by bm_manifest_merge_shards().
+
+#define MANIFEST_HEADER "blogc-make manifest 2"
+
+
+static void
+input_free(bm_manifest_input_t *input)
+{
+    if (input == NULL)
+        return;
+    free(input->path);
+    free(input);
+}
+
+
+void
+bm_manifest_entry_free(bm_manifest_entry_t *entry)
+{
+    if (entry == NULL)
+        return;
+    bc_slist_free_full(entry->inputs, (bc_free_func_t) input_free);
+    bc_slist_free_full(entry->members, (bc_free_func_t) input_free);
+    free(entry);
+}
+
+
+bm_manifest_entry_t*
+bm_manifest_entry_new(uint64_t variables)
+{
+    bm_manifest_entry_t *rv = bc_malloc(sizeof(bm_manifest_entry_t));
+    rv->variables = variables;
+    rv->sources = 0;
+    rv->inputs = NULL;
+    rv->members = NULL;
+    return rv;
+}
+
+
+static bc_slist_t*
+input_append(bc_slist_t *l, const char *path, uint64_t hash)
+{
+    bm_manifest_input_t *input = bc_malloc(sizeof(bm_manifest_input_t));
+    input->path = bc_strdup(path);
+    input->hash = hash;
+    return bc_slist_append(l, input);
+}
+
+
+static bool
+parse_hash(const char *str, uint64_t *hash)
+{
+    if (str == NULL || *str == '\0')
+        return false;
+    char *endptr;
+    errno = 0;
+    *hash = strtoull(str, &endptr, 16);
+    return errno == 0 && *endptr == '\0';
+}
+
+
+static void
+parse_manifest(bm_manifest_t *manifest, char *content)
+{
+    bm_manifest_entry_t *entry = NULL;
+    bool header = true;
+
+    char *line = content;
+    while (line != NULL && *line != '\0') {
+        char *next = strchr(line, '\n');
+        if (next != NULL)
+            *next++ = '\0';
+
+        if (header) {
+            // unknown format, just ignore the whole file
+            if (0 != strcmp(line, MANIFEST_HEADER))
+                return;
+            header = false;
+            line = next;
+            continue;
+        }
+
+        char **pieces = bc_str_split(line, '\t',
+            line[0] == 'F' ? 5 : (line[0] == 'O' ? 4 : 3));
+        size_t len = bc_strv_length(pieces);
+        uint64_t hash, sources;
+
+        if (len == 5 && 0 == strcmp(pieces[0], "F") &&
+            parse_hash(pieces[1], &hash))
+        {
+            bm_manifest_file_t *f = bc_malloc(sizeof(bm_manifest_file_t));
+            f->hash = hash;
+            f->tv_sec = strtoll(pieces[2], NULL, 10);
+            f->tv_nsec = strtol(pieces[3], NULL, 10);
+            bc_trie_insert(manifest->files, pieces[4], f);
+        }
+        else if (len == 4 && 0 == strcmp(pieces[0], "O") &&
+            parse_hash(pieces[1], &hash) && parse_hash(pieces[2], &sources))
+        {
+            entry = bm_manifest_entry_new(hash);
+            entry->sources = sources;
+            bc_trie_insert(manifest->outputs, pieces[3], entry);
+        }
+        else if (len == 3 && 0 == strcmp(pieces[0], "I") && entry != NULL &&
+            parse_hash(pieces[1], &hash))
+        {
+            entry->inputs = input_append(entry->inputs, pieces[2], hash);
+        }
+        else if (len == 3 && 0 == strcmp(pieces[0], "M") && entry != NULL &&
+            parse_hash(pieces[1], &hash))
+        {
+            entry->members = input_append(entry->members, pieces[2], hash);
+        }
+
+        bc_strv_free(pieces);
+        line = next;
+    }
+}
+
+
+static void
+load_manifest(bm_manifest_t *manifest, const char *path)
+{
+    // a missing or broken manifest is not an error, we'll just fallback to
+    // timestamps to decide what to rebuild.
+    size_t len;
+    bc_error_t *err = NULL;
+    char *content = bc_file_get_contents(path, false, &len, &err);
+    if (err != NULL) {
+        bc_error_free(err);
+        return;
+    }
+    parse_manifest(manifest, content);
+    free(content);
+}
+
+
+bm_manifest_t*
+bm_manifest_new(const char *output_dir)
+{
+    if (output_dir == NULL)
+        return NULL;
+
+    bm_manifest_t *rv = bc_malloc(sizeof(bm_manifest_t));
+    rv->path = bc_strdup_printf("%s/%s", output_dir, BM_MANIFEST_FILENAME);
+    rv->files = bc_trie_new(free);
+    rv->outputs = bc_trie_new((bc_free_func_t) bm_manifest_entry_free);
+    rv->changed = false;
+    rv->shard = 0;
+    rv->shards = 0;
+    pthread_mutex_init(&rv->mutex, NULL);
+    load_manifest(rv, rv->path);
+    return rv;
+}
+
+
+// the manifest of the shard is loaded on top of the main one, because it
+// is newer, if the shards were not merged yet.
+void
+bm_manifest_set_shard(bm_manifest_t *manifest, size_t shard, size_t shards)
+{
+    if (manifest == NULL || shards == 0)
+        return;
+
+    // the manifest path ends with BM_MANIFEST_FILENAME, and the shard names
+    // are 1-based, like the command line argument.
+    char *path = bc_strdup_printf("%s.shard-%zu-of-%zu", manifest->path,
+        shard + 1, shards);
+    free(manifest->path);
+    manifest->path = path;
+    manifest->shard = shard;
+    manifest->shards = shards;
+    load_manifest(manifest, manifest->path);
+}
+
+
+void
+bm_manifest_free(bm_manifest_t *manifest)
+{
+    if (manifest == NULL)
+        return;
+    free(manifest->path);
+    bc_trie_free(manifest->files);
+    bc_trie_free(manifest->outputs);
+    pthread_mutex_destroy(&manifest->mutex);
+    free(manifest);
+}
+
+
+// mtimes are the ones from the file contexts, that are loaded once (or
+// reloaded by the watcher), so we don't need to stat each input again for
+// every output that depends on it.
+//
+// the hash of the file is computed by the given function, and cached with the
+// key, that may differ from the file path if the same file is hashed by more
+// than one function.
+uint64_t
+bm_manifest_hash(bm_manifest_t *manifest, const char *path, const char *key,
+    time_t tv_sec, long tv_nsec, bm_manifest_hash_func_t func, void *user_data)
+{
+    if (manifest == NULL || path == NULL || key == NULL || func == NULL)
+        return 0;
+
+    pthread_mutex_lock(&manifest->mutex);
+    bm_manifest_file_t *f = bc_trie_lookup(manifest->files, key);
+    if (f != NULL && f->tv_sec == tv_sec && f->tv_nsec == tv_nsec) {
+        uint64_t rv = f->hash;
+        pthread_mutex_unlock(&manifest->mutex);
+        return rv;
+    }
+    pthread_mutex_unlock(&manifest->mutex);
+
+    // missing files hash to 0, and aren't cached.
+    bc_error_t *err = NULL;
+    uint64_t rv = func(path, user_data, &err);
+    if (err != NULL) {
+        bc_error_free(err);
+        return 0;
+    }
+
+    f = bc_malloc(sizeof(bm_manifest_file_t));
+    f->hash = rv;
+    f->tv_sec = tv_sec;
+    f->tv_nsec = tv_nsec;
+
+    pthread_mutex_lock(&manifest->mutex);
+    bc_trie_insert(manifest->files, key, f);
+    manifest->changed = true;
+    pthread_mutex_unlock(&manifest->mutex);
+
+    return rv;
+}
+
+
+static uint64_t
+hash_file(const char *path, void *user_data, bc_error_t **err)
+{
+    return bc_file_get_hash(path, err);
+}
+
+
+uint64_t
+bm_manifest_hash_file(bm_manifest_t *manifest, const char *path, const char *key,
+    time_t tv_sec, long tv_nsec)
+{
+    return bm_manifest_hash(manifest, path, key, tv_sec, tv_nsec, hash_file,
+        NULL);
+}
+
+
+void
+bm_manifest_entry_add_file(bm_manifest_t *manifest, bm_manifest_entry_t *entry,
+    const char *path, const char *key, time_t tv_sec, long tv_nsec)
+{
+    if (manifest == NULL || entry == NULL || path == NULL || key == NULL)
+        return;
+    entry->inputs = input_append(entry->inputs, key,
+        bm_manifest_hash_file(manifest, path, key, tv_sec, tv_nsec));
+}
+
+
+// adds an input that is not read from a file, e.g. a generated template.
+void
+bm_manifest_entry_add_hash(bm_manifest_entry_t *entry, const char *key,
+    uint64_t hash)
+{
+    if (entry == NULL || key == NULL)
+        return;
+    entry->inputs = input_append(entry->inputs, key, hash);
+}
+
+
+void
+bm_manifest_entry_add_member(bm_manifest_t *manifest, bm_manifest_entry_t *entry,
+    const char *path, const char *key, time_t tv_sec, long tv_nsec)
+{
+    if (manifest == NULL || entry == NULL || path == NULL || key == NULL)
+        return;
+    entry->members = input_append(entry->members, key,
+        bm_manifest_hash_file(manifest, path, key, tv_sec, tv_nsec));
+}
+
+
+void
+bm_manifest_entry_add_member_hash(bm_manifest_entry_t *entry, const char *key,
+    uint64_t hash)
+{
+    if (entry == NULL || key == NULL)
+        return;
+    entry->members = input_append(entry->members, key, hash);
+}
+
+
+bool
+bm_manifest_entry_reuse_members(bm_manifest_t *manifest, const char *output,
+    bm_manifest_entry_t *entry)
+{
+    if (manifest == NULL || output == NULL || entry == NULL)
+        return false;
+
+    bool rv = false;
+
+    pthread_mutex_lock(&manifest->mutex);
+    bm_manifest_entry_t *old = bc_trie_lookup(manifest->outputs, output);
+    if (old != NULL && old->variables == entry->variables &&
+        old->sources == entry->sources)
+    {
+        for (bc_slist_t *l = old->members; l != NULL; l = l->next) {
+            bm_manifest_input_t *member = l->data;
+            entry->members = input_append(entry->members, member->path,
+                member->hash);
+        }
+        rv = true;
+    }
+    pthread_mutex_unlock(&manifest->mutex);
+
+    return rv;
+}
+
+
+bool
+bm_manifest_contains(bm_manifest_t *manifest, const char *output)
+{
+    if (manifest == NULL || output == NULL)
+        return false;
+
+    pthread_mutex_lock(&manifest->mutex);
+    bool rv = NULL != bc_trie_lookup(manifest->outputs, output);
+    pthread_mutex_unlock(&manifest->mutex);
+    return rv;
+}
+
+
+static bool
+inputs_changed(bc_slist_t *old, bc_slist_t *new)
+{
+    bc_slist_t *o, *n;
+    for (o = old, n = new; o != NULL && n != NULL; o = o->next, n = n->next) {
+        bm_manifest_input_t *oi = o->data;
+        bm_manifest_input_t *ni = n->data;
+        if (oi->hash != ni->hash || 0 != strcmp(oi->path, ni->path))
+            return true;
+    }
+    return o != NULL || n != NULL;
+}
+
+
+bool
+bm_manifest_changed(bm_manifest_t *manifest, const char *output,
+    bm_manifest_entry_t *entry)
+{
+    if (manifest == NULL || output == NULL || entry == NULL)
+        return true;
+
+    bool rv = true;
+
+    pthread_mutex_lock(&manifest->mutex);
+
+    bm_manifest_entry_t *old = bc_trie_lookup(manifest->outputs, output);
+    // the sources hash is not compared, it is only used to reuse members.
+    if (old != NULL && old->variables == entry->variables) {
+        rv = inputs_changed(old->inputs, entry->inputs) ||
+            inputs_changed(old->members, entry->members);
+    }
+
+    pthread_mutex_unlock(&manifest->mutex);
+    return rv;
+}
+
+
+// takes ownership of entry. the manifest is only marked as changed if the
+// entry differs from the recorded one.
+void
+bm_manifest_update(bm_manifest_t *manifest, const char *output,
+    bm_manifest_entry_t *entry)
+{
+    if (manifest == NULL || output == NULL || entry == NULL) {
+        bm_manifest_entry_free(entry);
+        return;
+    }
+
+    pthread_mutex_lock(&manifest->mutex);
+    bm_manifest_entry_t *old = bc_trie_lookup(manifest->outputs, output);
+    if (old != NULL && old->variables == entry->variables &&
+        old->sources == entry->sources &&
+        !inputs_changed(old->inputs, entry->inputs) &&
+        !inputs_changed(old->members, entry->members))
+    {
+        bm_manifest_entry_free(entry);
+    }
+    else {
+        bc_trie_insert(manifest->outputs, output, entry);
+        manifest->changed = true;
+    }
+    pthread_mutex_unlock(&manifest->mutex);
+}
+
+
+typedef struct {
+    bm_manifest_t *manifest;
+    bc_string_t *str;
+    bc_trie_t *files;
+} manifest_writer_t;
+
+
+static void
+write_inputs(manifest_writer_t *w, const char *type, bc_slist_t *inputs)
+{
+    for (bc_slist_t *l = inputs; l != NULL; l = l->next) {
+        bm_manifest_input_t *input = l->data;
+        bc_string_append_printf(w->str, "%s\t%016" PRIx64 "\t%s\n", type,
+            input->hash, input->path);
+
+        // only files still used by some output are kept
+        bm_manifest_file_t *f = bc_trie_lookup(w->manifest->files, input->path);
+        if (f != NULL)
+            bc_trie_insert(w->files, input->path, f);
+    }
+}
+
+
+static void
+write_output(const char *output, bm_manifest_entry_t *entry,
+    manifest_writer_t *w)
+{
+    // entries of other shards come from the main manifest, and are kept
+    // there until the shards are merged.
+    if (!bm_shard_contains(output, w->manifest->shard, w->manifest->shards))
+        return;
+
+    bc_string_append_printf(w->str, "O\t%016" PRIx64 "\t%016" PRIx64 "\t%s\n",
+        entry->variables, entry->sources, output);
+    write_inputs(w, "I", entry->inputs);
+    write_inputs(w, "M", entry->members);
+}
+
+
+static void
+write_file(const char *path, bm_manifest_file_t *f, bc_string_t *str)
+{
+    bc_string_append_printf(str, "F\t%016" PRIx64 "\t%lld\t%ld\t%s\n",
+        f->hash, (long long) f->tv_sec, f->tv_nsec, path);
+}
+
+
+// must be called when no jobs are running.
+int
+bm_manifest_save(bm_manifest_t *manifest)
+{
+    if (manifest == NULL || !manifest->changed)
+        return 0;
+
+    // nothing was built, no need to create a manifest (or the output
+    // directory).
+    if (bc_trie_size(manifest->outputs) == 0)
+        return 0;
+
+    bc_string_t *outputs = bc_string_new();
+    manifest_writer_t w = {
+        .manifest = manifest,
+        .str = outputs,
+        .files = bc_trie_new(NULL),
+    };
+    bc_trie_foreach(manifest->outputs, (bc_trie_foreach_func_t) write_output, &w);
+
+    bc_string_t *str = bc_string_new();
+    bc_string_append(str, MANIFEST_HEADER "\n");
+    bc_trie_foreach(w.files, (bc_trie_foreach_func_t) write_file, str);
+    bc_string_append_len(str, outputs->str, outputs->len);
+    bc_trie_free(w.files);
+    bc_string_free(outputs, true);
+
+    int rv = 0;
+
+    // write to a temporary file and rename it, so we never leave a truncated
+    // manifest behind.
+    char *tmp = bc_strdup_printf("%s.tmp", manifest->path);
+    FILE *fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "blogc-make: warning: failed to save manifest (%s): "
+            "%s\n", manifest->path, strerror(errno));
+        rv = 1;
+        goto cleanup;
+    }
+    bool ok = str->len == fwrite(str->str, sizeof(char), str->len, fp);
+    if (0 != fclose(fp) || !ok || 0 != rename(tmp, manifest->path)) {
+        fprintf(stderr, "blogc-make: warning: failed to save manifest (%s): "
+            "%s\n", manifest->path, strerror(errno));
+        unlink(tmp);
+        rv = 1;
+        goto cleanup;
+    }
+
+    manifest->changed = false;
+
+cleanup:
+    free(tmp);
+    bc_string_free(str, true);
+    return rv;
+}
+
+
+int
+bm_manifest_remove(bm_manifest_t *manifest, bool verbose)
+{
+    if (manifest == NULL)
+        return 0;
+
+    bc_trie_free(manifest->outputs);
+    manifest->outputs = bc_trie_new((bc_free_func_t) bm_manifest_entry_free);
+    manifest->changed = false;
+
+    if (0 != unlink(manifest->path)) {
+        if (errno == ENOENT)
+            return 0;
+        fprintf(stderr, "blogc-make: error: failed to remove manifest (%s): "
+            "%s\n", manifest->path, strerror(errno));
+        return 1;
+    }
+
+    if (verbose) {
+        printf("Removing file '%s'\n", manifest->path);
+        fflush(stdout);
+    }
+
+    return 0;
+}
+
+
+typedef struct {
+    bm_manifest_t *manifest;
+    bc_trie_t *keep;
+    bc_trie_t *outputs;
+    bc_slist_t *removed;
+} manifest_pruner_t;
+
+
+static void
+prune_output(const char *output, bm_manifest_entry_t *entry,
+    manifest_pruner_t *p)
+{
+    // entries of other shards are pruned by their own shard.
+    if (NULL != bc_trie_lookup(p->keep, output) ||
+        !bm_shard_contains(output, p->manifest->shard, p->manifest->shards))
+    {
+        bc_trie_insert(p->outputs, output, entry);
+        return;
+    }
+    p->removed = bc_slist_prepend(p->removed, bc_strdup(output));
+    bm_manifest_entry_free(entry);
+}
+
+
+// removes the entries of the outputs not found in the given trie, that are
+// the outputs built by previous runs, but not produced by the current
+// settings anymore. returns the list of removed outputs.
+bc_slist_t*
+bm_manifest_prune(bm_manifest_t *manifest, bc_trie_t *outputs)
+{
+    if (manifest == NULL || outputs == NULL)
+        return NULL;
+
+    manifest_pruner_t p = {
+        .manifest = manifest,
+        .keep = outputs,
+        .outputs = bc_trie_new((bc_free_func_t) bm_manifest_entry_free),
+        .removed = NULL,
+    };
+    bc_trie_foreach(manifest->outputs, (bc_trie_foreach_func_t) prune_output,
+        &p);
+
+    // the entries were all moved or freed already.
+    manifest->outputs->free_func = NULL;
+    bc_trie_free(manifest->outputs);
+    manifest->outputs = p.outputs;
+
+    if (p.removed != NULL)
+        manifest->changed = true;
+    return p.removed;
+}
+
+
+typedef struct {
+    bm_manifest_t *manifest;
+    bm_manifest_t *shards;
+    size_t len;
+    bc_trie_t *owners;
+    bc_trie_t *outputs;
+    const char *name;
+    int rv;
+} manifest_merger_t;
+
+
+// returns false if the name is not the name of a shard manifest.
+static bool
+parse_shard_name(const char *name, size_t *shard, size_t *shards)
+{
+    if (!bc_str_starts_with(name, BM_MANIFEST_SHARD_PREFIX))
+        return false;
+    const char *str = name + strlen(BM_MANIFEST_SHARD_PREFIX);
+    size_t k, n;
+    int end = 0;
+    if (2 != sscanf(str, "%zu-of-%zu%n", &k, &n, &end) || str[end] != '\0' ||
+        k == 0 || k > n)
+        return false;
+    *shard = k - 1;
+    *shards = n;
+    return true;
+}
+
+
+static void
+merge_check(const char *output, bm_manifest_entry_t *entry,
+    manifest_merger_t *m)
+{
+    // one conflict is enough to tell that the shards don't match.
+    if (m->rv != 0)
+        return;
+
+    const char *owner = bc_trie_lookup(m->owners, output);
+    if (owner != NULL) {
+        fprintf(stderr, "blogc-make: error: output built by more than one "
+            "shard (%s, %s): %s\n", owner, m->name, output);
+        m->rv = 1;
+        return;
+    }
+    bc_trie_insert(m->owners, output, (void*) m->name);
+}
+
+
+static void
+merge_keep(const char *output, bm_manifest_entry_t *entry,
+    manifest_merger_t *m)
+{
+    // outputs of the merged shards that none of them produces anymore (e.g.
+    // removed posts) are dropped. outputs of shards without a manifest (e.g.
+    // shards that had nothing to build) are kept.
+    bool merged = false;
+    for (size_t i = 0; i < m->len && !merged; i++)
+        merged = bm_shard_contains(output, m->shards[i].shard,
+            m->shards[i].shards);
+    if (merged && NULL == bc_trie_lookup(m->owners, output)) {
+        bm_manifest_entry_free(entry);
+        return;
+    }
+    bc_trie_insert(m->outputs, output, entry);
+}
+
+
+static void
+merge_file(const char *path, bm_manifest_file_t *f, manifest_merger_t *m)
+{
+    bc_trie_insert(m->manifest->files, path, f);
+}
+
+
+static void
+merge_output(const char *output, bm_manifest_entry_t *entry,
+    manifest_merger_t *m)
+{
+    bc_trie_insert(m->manifest->outputs, output, entry);
+}
+
+
+// combines the manifests saved by sharded builds into the main manifest, and
+// removes them. the same output built by more than one shard (e.g. stale
+// manifests from builds with a different number of shards) is an error, and
+// nothing is changed.
+int
+bm_manifest_merge_shards(bm_manifest_t *manifest, const char *output_dir,
+    bool verbose)
+{
+    if (manifest == NULL || output_dir == NULL)
+        return 0;
+
+    DIR *dir = opendir(output_dir);
+    if (dir == NULL) {
+        if (errno == ENOENT)
+            return 0;
+        fprintf(stderr, "blogc-make: error: failed to open output directory "
+            "(%s): %s\n", output_dir, strerror(errno));
+        return 1;
+    }
+
+    bc_slist_t *names = NULL;
+    struct dirent *e;
+    size_t shard, shards;
+    while (NULL != (e = readdir(dir))) {
+        if (!parse_shard_name(e->d_name, &shard, &shards))
+            continue;
+        names = bc_slist_append(names, bc_strdup(e->d_name));
+    }
+    closedir(dir);
+
+    if (names == NULL)
+        return 0;
+
+    size_t len = bc_slist_length(names);
+    manifest_merger_t m = {
+        .manifest = manifest,
+        .shards = bc_malloc(len * sizeof(bm_manifest_t)),
+        .len = len,
+        .owners = bc_trie_new(NULL),
+        .outputs = NULL,
+        .name = NULL,
+        .rv = 0,
+    };
+
+    // all the shard manifests are checked before touching the main one. their
+    // entries are only moved to it if there are no conflicts.
+    size_t i = 0;
+    for (bc_slist_t *l = names; l != NULL; l = l->next, i++) {
+        m.name = l->data;
+        parse_shard_name(m.name, &m.shards[i].shard, &m.shards[i].shards);
+        m.shards[i].files = bc_trie_new(free);
+        m.shards[i].outputs = bc_trie_new(
+            (bc_free_func_t) bm_manifest_entry_free);
+        char *path = bc_strdup_printf("%s/%s", output_dir, m.name);
+        load_manifest(&m.shards[i], path);
+        free(path);
+        bc_trie_foreach(m.shards[i].outputs,
+            (bc_trie_foreach_func_t) merge_check, &m);
+    }
+
+    if (m.rv == 0) {
+        m.outputs = bc_trie_new((bc_free_func_t) bm_manifest_entry_free);
+        bc_trie_foreach(manifest->outputs, (bc_trie_foreach_func_t) merge_keep,
+            &m);
+
+        // the entries were all moved or freed already.
+        manifest->outputs->free_func = NULL;
+        bc_trie_free(manifest->outputs);
+        manifest->outputs = m.outputs;
+    }
+
+    for (i = 0; i < len; i++) {
+        if (m.rv == 0) {
+            bc_trie_foreach(m.shards[i].files,
+                (bc_trie_foreach_func_t) merge_file, &m);
+            bc_trie_foreach(m.shards[i].outputs,
+                (bc_trie_foreach_func_t) merge_output, &m);
+
+            // the entries were all moved to the main manifest.
+            m.shards[i].files->free_func = NULL;
+            m.shards[i].outputs->free_func = NULL;
+        }
+        bc_trie_free(m.shards[i].files);
+        bc_trie_free(m.shards[i].outputs);
+    }
+    free(m.shards);
+    bc_trie_free(m.owners);
+
+    if (m.rv == 0) {
+        manifest->changed = true;
+        m.rv = bm_manifest_save(manifest);
+    }
+
+    for (bc_slist_t *l = names; l != NULL && m.rv == 0; l = l->next) {
+        char *path = bc_strdup_printf("%s/%s", output_dir, (char*) l->data);
+        if (0 != unlink(path)) {
+            fprintf(stderr, "blogc-make: error: failed to remove manifest "
+                "(%s): %s\n", path, strerror(errno));
+            m.rv = 1;
+        }
+        else if (verbose) {
+            printf("Removing file '%s'\n", path);
+            fflush(stdout);
+        }
+        free(path);
+    }
+
+    bc_slist_free_full(names, free);
+    return m.rv;
+}
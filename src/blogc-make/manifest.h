@@ -0,0 +1,88 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#ifndef _MAKE_MANIFEST_H
+#define _MAKE_MANIFEST_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "../common/error.h"
+#include "../common/utils.h"
+
+#define BM_MANIFEST_FILENAME ".blogc-make-manifest"
+#define BM_MANIFEST_SHARD_PREFIX BM_MANIFEST_FILENAME ".shard-"
+
+typedef struct {
+    char *path;
+    uint64_t hash;
+} bm_manifest_input_t;
+
+typedef struct {
+    uint64_t variables;
+    uint64_t sources;
+    bc_slist_t *inputs;
+    bc_slist_t *members;
+} bm_manifest_entry_t;
+
+typedef struct {
+    uint64_t hash;
+    time_t tv_sec;
+    long tv_nsec;
+} bm_manifest_file_t;
+
+typedef struct {
+    char *path;
+    bc_trie_t *files;
+    bc_trie_t *outputs;
+    bool changed;
+    size_t shard;
+    size_t shards;
+    pthread_mutex_t mutex;
+} bm_manifest_t;
+
+typedef uint64_t (*bm_manifest_hash_func_t) (const char *path, void *user_data,
+    bc_error_t **err);
+
+bm_manifest_t* bm_manifest_new(const char *output_dir);
+void bm_manifest_set_shard(bm_manifest_t *manifest, size_t shard,
+    size_t shards);
+void bm_manifest_free(bm_manifest_t *manifest);
+uint64_t bm_manifest_hash(bm_manifest_t *manifest, const char *path,
+    const char *key, time_t tv_sec, long tv_nsec, bm_manifest_hash_func_t func,
+    void *user_data);
+uint64_t bm_manifest_hash_file(bm_manifest_t *manifest, const char *path,
+    const char *key, time_t tv_sec, long tv_nsec);
+bm_manifest_entry_t* bm_manifest_entry_new(uint64_t variables);
+void bm_manifest_entry_add_file(bm_manifest_t *manifest,
+    bm_manifest_entry_t *entry, const char *path, const char *key,
+    time_t tv_sec, long tv_nsec);
+void bm_manifest_entry_add_hash(bm_manifest_entry_t *entry, const char *key,
+    uint64_t hash);
+void bm_manifest_entry_add_member(bm_manifest_t *manifest,
+    bm_manifest_entry_t *entry, const char *path, const char *key,
+    time_t tv_sec, long tv_nsec);
+void bm_manifest_entry_add_member_hash(bm_manifest_entry_t *entry,
+    const char *key, uint64_t hash);
+bool bm_manifest_entry_reuse_members(bm_manifest_t *manifest,
+    const char *output, bm_manifest_entry_t *entry);
+void bm_manifest_entry_free(bm_manifest_entry_t *entry);
+bool bm_manifest_contains(bm_manifest_t *manifest, const char *output);
+bool bm_manifest_changed(bm_manifest_t *manifest, const char *output,
+    bm_manifest_entry_t *entry);
+void bm_manifest_update(bm_manifest_t *manifest, const char *output,
+    bm_manifest_entry_t *entry);
+int bm_manifest_save(bm_manifest_t *manifest);
+int bm_manifest_remove(bm_manifest_t *manifest, bool verbose);
+bc_slist_t* bm_manifest_prune(bm_manifest_t *manifest, bc_trie_t *outputs);
+int bm_manifest_merge_shards(bm_manifest_t *manifest, const char *output_dir,
+    bool verbose);
+
+#endif /* _MAKE_MANIFEST_H */
@@ -6,6 +6,15 @@
  * See the file LICENSE.
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#include <poll.h>
+#endif /* HAVE_SYS_INOTIFY_H */
+
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,6 +26,7 @@
 #include "../common/utils.h"
 #include "ctx.h"
 #include "rules.h"
+#include "trace.h"
 #include "reloader.h"
 
 // we are not going to unit-test these functions, then printing errors
@@ -34,6 +44,210 @@ sig_handler(int signum)
 }
 
 
+#ifdef HAVE_SYS_INOTIFY_H
+
+// time waiting for events before checking if we are still running, and quiet
+// time after the last event before rebuilding. editors usually save files
+// with several operations (truncate + write, or write to temporary file +
+// rename), that should trigger a single rebuild.
+#define WATCHER_POLL_TIMEOUT 500
+#define WATCHER_DEBOUNCE_TIMEOUT 100
+
+#define WATCHER_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | \
+    IN_MOVED_FROM | IN_ATTRIB)
+
+typedef struct {
+    int fd;
+    bc_trie_t *dirs;  // watch descriptor -> list of directories
+} watcher_t;
+
+
+static void
+watcher_free_dirs(void *data)
+{
+    bc_slist_free_full(data, free);
+}
+
+
+static void
+watcher_free(watcher_t *w)
+{
+    if (w->fd >= 0)
+        close(w->fd);
+    w->fd = -1;
+    bc_trie_free(w->dirs);
+    w->dirs = NULL;
+}
+
+
+static bool
+watcher_add(watcher_t *w, bm_filectx_t *fctx)
+{
+    if (fctx == NULL)
+        return true;
+
+    // the directory is taken from the file path itself, so that the paths
+    // built from the events match the paths of the tracked files exactly.
+    char *dir = bc_strdup(fctx->path);
+    char *sep = strrchr(dir, '/');
+    if (sep == NULL) {
+        free(dir);
+        return true;
+    }
+    if (sep == dir)
+        sep++;
+    *sep = '\0';
+
+    int wd = inotify_add_watch(w->fd, dir, WATCHER_MASK);
+    if (wd < 0) {
+        fprintf(stderr, "blogc-make: warning: failed to watch directory "
+            "(%s): %s\n", dir, strerror(errno));
+        free(dir);
+        return false;
+    }
+
+    char *key = bc_strdup_printf("%d", wd);
+    bc_slist_t *dirs = bc_trie_lookup(w->dirs, key);
+    for (bc_slist_t *l = dirs; l != NULL; l = l->next) {
+        if (0 == strcmp(l->data, dir)) {
+            free(dir);
+            free(key);
+            return true;
+        }
+    }
+    if (dirs == NULL)
+        bc_trie_insert(w->dirs, key, bc_slist_append(NULL, dir));
+    else
+        bc_slist_append(dirs, dir);
+    free(key);
+    return true;
+}
+
+
+static bool
+watcher_add_list(watcher_t *w, bc_slist_t *l)
+{
+    for (; l != NULL; l = l->next)
+        if (!watcher_add(w, l->data))
+            return false;
+    return true;
+}
+
+
+static bool
+watcher_init(watcher_t *w, bm_ctx_t *ctx)
+{
+    watcher_free(w);
+
+    w->fd = inotify_init1(IN_CLOEXEC);
+    if (w->fd < 0) {
+        fprintf(stderr, "blogc-make: warning: failed to initialize inotify: "
+            "%s\n", strerror(errno));
+        return false;
+    }
+    w->dirs = bc_trie_new(watcher_free_dirs);
+
+    if (watcher_add(w, ctx->settings_fctx) &&
+        watcher_add(w, ctx->main_template_fctx) &&
+        (ctx->atom_template_tmp || watcher_add(w, ctx->atom_template_fctx)) &&
+        watcher_add(w, ctx->listing_entry_fctx) &&
+        watcher_add_list(w, ctx->posts_fctx) &&
+        watcher_add_list(w, ctx->pages_fctx) &&
+        watcher_add_list(w, ctx->copy_fctx))
+        return true;
+
+    watcher_free(w);
+    return false;
+}
+
+
+// reads pending events, adding changed files to `changed`. returns false if
+// some events were lost, and everything must be checked again.
+static bool
+watcher_read(watcher_t *w, bc_trie_t *changed)
+{
+    char buf[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    ssize_t len = read(w->fd, buf, sizeof(buf));
+    if (len <= 0)
+        return len == 0 || errno == EINTR || errno == EAGAIN;
+
+    bool rv = true;
+    for (char *ptr = buf; ptr < buf + len;) {
+        const struct inotify_event *event = (const struct inotify_event*) ptr;
+        ptr += sizeof(struct inotify_event) + event->len;
+
+        if (event->mask & (IN_Q_OVERFLOW | IN_IGNORED)) {
+            rv = false;
+            continue;
+        }
+        if (event->len == 0)
+            continue;
+
+        char *key = bc_strdup_printf("%d", event->wd);
+        bc_slist_t *dirs = bc_trie_lookup(w->dirs, key);
+        free(key);
+        for (bc_slist_t *l = dirs; l != NULL; l = l->next) {
+            const char *dir = l->data;
+            char *path = bc_strdup_printf("%s%s%s", dir,
+                dir[strlen(dir) - 1] == '/' ? "" : "/", event->name);
+            bc_trie_insert(changed, path, (void*) 1);
+            free(path);
+        }
+    }
+    return rv;
+}
+
+
+// waits for changes. returns 0 when something changed (`changed` is set to
+// NULL if everything must be checked), 1 when the reloader was stopped and
+// -1 on errors.
+static int
+watcher_wait(watcher_t *w, bc_trie_t **changed)
+{
+    struct pollfd pfd = {.fd = w->fd, .events = POLLIN};
+    bc_trie_t *rv = bc_trie_new(NULL);
+    bool full = false;
+    bool got_events = false;
+
+    while (running) {
+        int r = poll(&pfd, 1, got_events ? WATCHER_DEBOUNCE_TIMEOUT :
+            WATCHER_POLL_TIMEOUT);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "blogc-make: warning: failed to wait for "
+                "changes: %s\n", strerror(errno));
+            bc_trie_free(rv);
+            return -1;
+        }
+        if (r == 0) {
+            if (got_events)
+                break;
+            continue;
+        }
+        if (!watcher_read(w, rv))
+            full = true;
+        got_events = true;
+    }
+
+    if (!running) {
+        bc_trie_free(rv);
+        return 1;
+    }
+
+    if (full) {
+        bc_trie_free(rv);
+        rv = NULL;
+    }
+    *changed = rv;
+    return 0;
+}
+
+#endif /* HAVE_SYS_INOTIFY_H */
+
+
 int
 bm_reloader_run(bm_ctx_t **ctx, bm_rule_exec_func_t rule_exec,
     bc_slist_t *outputs, bc_trie_t *args)
@@ -66,22 +280,72 @@ bm_reloader_run(bm_ctx_t **ctx, bm_rule_exec_func_t rule_exec,
     running = true;
     pthread_mutex_unlock(&mutex_running);
 
+#ifdef HAVE_SYS_INOTIFY_H
+    watcher_t w = {.fd = -1, .dirs = NULL};
+    bool use_watcher = true;
+#endif /* HAVE_SYS_INOTIFY_H */
+
+    // files changed since last build. NULL means that everything must be
+    // checked, e.g. on first run or when falling back to polling.
+    bc_trie_t *changed = NULL;
+
     while (running) {
-        if (!bm_ctx_reload(ctx)) {
+        bm_trace_span_t span;
+        bm_trace_begin(&span);
+        bool reloaded = bm_ctx_reload(ctx, changed);
+        bm_trace_end(&span, "ctx", "reload context", NULL);
+        if (!reloaded) {
             fprintf(stderr, "blogc-make: warning: failed to reload context. "
                 "retrying in 5 seconds ...\n\n");
+            bc_trie_free(changed);
+            changed = NULL;
             sleep(5);
             continue;
         }
-        if (0 != rule_exec(*ctx, outputs, args)) {
+
+        // the list of files may change when the settings file changes.
+        bool full = changed == NULL || (*ctx)->settings_changed != 0;
+
+        (*ctx)->changed = changed;
+        int rv = rule_exec(*ctx, outputs, args);
+        (*ctx)->changed = NULL;
+        bc_trie_free(changed);
+        changed = NULL;
+
+        if (0 != rv) {
             fprintf(stderr, "blogc-make: warning: failed to rebuild website. "
                 "retrying in 5 seconds ...\n\n");
             sleep(5);
             continue;
         }
+
+#ifdef HAVE_SYS_INOTIFY_H
+        if (use_watcher && (full || w.fd < 0)) {
+            use_watcher = watcher_init(&w, *ctx);
+            if (!use_watcher)
+                fprintf(stderr, "blogc-make: warning: falling back to polling "
+                    "for changes\n");
+        }
+        if (use_watcher) {
+            int r = watcher_wait(&w, &changed);
+            if (r == 0)
+                continue;
+            if (r > 0)
+                break;
+            watcher_free(&w);
+            use_watcher = false;
+            fprintf(stderr, "blogc-make: warning: falling back to polling "
+                "for changes\n");
+        }
+#endif /* HAVE_SYS_INOTIFY_H */
+
         sleep(1);
     }
 
+#ifdef HAVE_SYS_INOTIFY_H
+    watcher_free(&w);
+#endif /* HAVE_SYS_INOTIFY_H */
+
     return reloader_status_code;
 }
 
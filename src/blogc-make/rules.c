@@ -6,19 +6,29 @@
  * See the file LICENSE.
  */
 
+#include <sys/stat.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include "../blogc/template-parser.h"
+#include "../common/error.h"
 #include "../common/utils.h"
+#include "artifacts.h"
 #include "atom.h"
+#include "cache.h"
+#include "compress.h"
 #include "ctx.h"
 #include "exec.h"
 #include "exec-native.h"
 #include "httpd.h"
+#include "jobs.h"
+#include "manifest.h"
 #include "reloader.h"
 #include "settings.h"
+#include "trace.h"
 #include "utils.h"
 #include "rules.h"
 
@@ -58,6 +68,16 @@ posts_pagination(bm_ctx_t *ctx, bc_trie_t *variables, const char *variable)
 }
 
 
+static bool
+output_minify(bm_ctx_t *ctx, const char *variable)
+{
+    if (ctx == NULL)
+        return false;
+
+    return bc_str_to_bool(bm_ctx_settings_lookup(ctx, variable));
+}
+
+
 static bool
 posts_pagination_enabled(bm_ctx_t *ctx, const  char *variable)
 {
@@ -69,6 +89,660 @@ posts_pagination_enabled(bm_ctx_t *ctx, const  char *variable)
 }
 
 
+// JOBS
+//
+// when running with a job pool, each output is rendered/copied by a job. the
+// rule execution loops keep going while jobs run, so everything the jobs use
+// must be copied or live until bm_jobs_wait() returns.
+//
+// the decision to rebuild an output is made before submitting the job, using
+// the manifest (content hashes of the inputs and of the variables used to
+// build each output). outputs not found in the manifest fallback to comparing
+// timestamps. the manifest is only updated after an output is built
+// successfully.
+
+typedef struct {
+    bm_ctx_t *ctx;
+    bc_trie_t *global_variables;
+    bc_trie_t *local_variables;
+    bool listing;
+    bm_filectx_t *listing_entry;
+    bm_filectx_t *template;
+    bm_filectx_t *output;
+    bc_slist_t *sources;
+    bool only_first_source;
+    bool minify;
+    bm_manifest_entry_t *entry;
+    const char *reason;
+} bm_rule_blogc_job_t;
+
+typedef struct {
+    bm_ctx_t *ctx;
+    bm_filectx_t *source;
+    bm_filectx_t *dest;
+    bm_manifest_entry_t *entry;
+    const char *reason;
+} bm_rule_copy_job_t;
+
+
+static void
+copy_variable(const char *key, const char *value, bc_trie_t *dest)
+{
+    bc_trie_insert(dest, key, bc_strdup(value));
+}
+
+
+static bc_trie_t*
+copy_variables(bc_trie_t *variables)
+{
+    if (variables == NULL)
+        return NULL;
+    bc_trie_t *rv = bc_trie_new(free);
+    bc_trie_foreach(variables, (bc_trie_foreach_func_t) copy_variable, rv);
+    return rv;
+}
+
+
+typedef struct {
+    bm_cache_template_vars_t *vars;
+    bc_slist_t *keys;
+} variables_hash_t;
+
+
+static void
+collect_variable(const char *key, const char *value, variables_hash_t *h)
+{
+    // variables not read by the template can't change the output.
+    if (!bm_cache_template_vars_contains(h->vars, key))
+        return;
+
+    // keys are kept sorted, so the order they are stored in the trie doesn't
+    // matter.
+    bc_slist_t **l = &h->keys;
+    while (*l != NULL && strcmp((*l)->data, key) < 0)
+        l = &(*l)->next;
+    *l = bc_slist_prepend(*l, bc_strdup(key));
+}
+
+
+// folds the names and values of the variables into the hash, in order.
+static uint64_t
+hash_config(uint64_t hash, bc_trie_t *config, bm_cache_template_vars_t *vars)
+{
+    variables_hash_t h = {vars, NULL};
+    bc_trie_foreach(config, (bc_trie_foreach_func_t) collect_variable, &h);
+    for (bc_slist_t *l = h.keys; l != NULL; l = l->next) {
+        const char *value = bc_trie_lookup(config, l->data);
+        hash = bc_hash_update(hash, l->data, strlen(l->data) + 1);
+        hash = bc_hash_update(hash, value, strlen(value) + 1);
+    }
+    bc_slist_free_full(h.keys, free);
+    return hash;
+}
+
+
+// returns the variables read by the outputs of the given template, or NULL
+// if unknown, meaning that all of them must be considered. the result must
+// be released with template_vars_free().
+static bm_cache_template_vars_t*
+template_vars(bm_ctx_t *ctx, bm_filectx_t *template, bool listing)
+{
+    if (template == NULL)
+        return NULL;
+
+    // the default atom template may be generated in memory.
+    if (ctx->atom_template != NULL && template == ctx->atom_template_fctx)
+        return bm_cache_template_vars_new(ctx->atom_template, listing);
+
+    bc_error_t *err = NULL;
+    bm_cache_template_vars_t *rv = bm_cache_get_template_vars(ctx->cache,
+        template->path, listing, &err);
+    if (err != NULL) {
+        // blogc will fail and report the error.
+        bc_error_free(err);
+        return NULL;
+    }
+    return rv;
+}
+
+
+static void
+template_vars_free(bm_ctx_t *ctx, bm_filectx_t *template,
+    bm_cache_template_vars_t *vars)
+{
+    if (ctx->atom_template != NULL && template == ctx->atom_template_fctx)
+        bm_cache_template_vars_free(vars);
+}
+
+
+static uint64_t
+hash_variables(bm_ctx_t *ctx, bc_trie_t *global_variables,
+    bc_trie_t *local_variables, bm_cache_template_vars_t *vars, bool listing,
+    bool only_first_source)
+{
+    // same variables passed to blogc, either in-process or by command line.
+    bc_trie_t *config = bm_exec_native_build_config(ctx, global_variables,
+        local_variables);
+    uint64_t rv = hash_config(BC_HASH_INIT, config, vars);
+    bc_trie_free(config);
+
+    unsigned char flags[2] = {listing, only_first_source};
+    rv = bc_hash_update(rv, flags, sizeof(flags));
+
+    const char *locale = bm_ctx_settings_lookup(ctx, "locale");
+    if (locale != NULL)
+        rv = bc_hash_update(rv, locale, strlen(locale) + 1);
+
+    return rv;
+}
+
+
+static void
+entry_add_fctx(bm_ctx_t *ctx, bm_manifest_entry_t *entry, bm_filectx_t *fctx)
+{
+    if (fctx == NULL)
+        return;
+
+    // the default atom template is generated in memory, or in a temporary
+    // file with a random name.
+    const char *key = fctx->short_path;
+    if (ctx->atom_template_tmp && fctx == ctx->atom_template_fctx) {
+        key = ":atom_template";
+        if (ctx->atom_template != NULL) {
+            bm_manifest_entry_add_hash(entry, key, ctx->atom_template_hash);
+            return;
+        }
+    }
+
+    bm_manifest_entry_add_file(ctx->manifest, entry, fctx->path, key,
+        fctx->tv_sec, fctx->tv_nsec);
+}
+
+
+static uint64_t
+hash_template(const char *path, bm_ctx_t *ctx, bool listing, bc_error_t **err)
+{
+    bc_slist_t *tmpl = bm_cache_get_template(ctx->cache, path, err);
+    if (*err != NULL)
+        return 0;
+
+    // template blocks can't be nested, and any block other than "entry" is
+    // only rendered for listings.
+    uint64_t rv = BC_HASH_INIT;
+    bool skip = false;
+    for (bc_slist_t *l = tmpl; l != NULL; l = l->next) {
+        blogc_template_node_t *node = l->data;
+        if (node->type == BLOGC_TEMPLATE_NODE_BLOCK)
+            skip = listing == (0 == strcmp(node->data[0], "entry"));
+        if (!skip) {
+            unsigned char t[2] = {node->type, node->op};
+            rv = bc_hash_update(rv, t, sizeof(t));
+            for (size_t i = 0; i < 2; i++)
+                if (node->data[i] != NULL)
+                    rv = bc_hash_update(rv, node->data[i],
+                        strlen(node->data[i]) + 1);
+                else
+                    rv = bc_hash_update(rv, "", 1);
+        }
+        if (node->type == BLOGC_TEMPLATE_NODE_ENDBLOCK)
+            skip = false;
+    }
+    return rv;
+}
+
+
+static uint64_t
+hash_template_entry(const char *path, bm_ctx_t *ctx, bc_error_t **err)
+{
+    return hash_template(path, ctx, false, err);
+}
+
+
+static uint64_t
+hash_template_listing(const char *path, bm_ctx_t *ctx, bc_error_t **err)
+{
+    return hash_template(path, ctx, true, err);
+}
+
+
+// outputs only depend on the parts of the template they render: the content
+// outside of blocks, and either the "entry" block or the listing blocks. the
+// hashes of these parts are cached in the manifest, like the file hashes.
+static void
+entry_add_template(bm_ctx_t *ctx, bm_manifest_entry_t *entry,
+    bm_filectx_t *template, bool listing)
+{
+    if (template == NULL)
+        return;
+
+    if (ctx->atom_template_tmp && template == ctx->atom_template_fctx) {
+        entry_add_fctx(ctx, entry, template);
+        return;
+    }
+
+    char *key = bc_strdup_printf("%s:%s", template->short_path,
+        listing ? "listing" : "entry");
+    uint64_t h = bm_manifest_hash(ctx->manifest, template->path, key,
+        template->tv_sec, template->tv_nsec, (bm_manifest_hash_func_t)
+        (listing ? hash_template_listing : hash_template_entry), ctx);
+    bm_manifest_entry_add_hash(entry, key, h);
+    free(key);
+}
+
+
+// outputs with compressed sidecars are rebuilt when the compression settings
+// change, to write their sidecars again.
+static void
+entry_add_compress(bm_ctx_t *ctx, bm_manifest_entry_t *entry,
+    bm_filectx_t *output, bool copy)
+{
+    uint64_t h = bm_compress_hash(ctx, output, copy);
+    if (h != 0)
+        bm_manifest_entry_add_hash(entry, ":compress", h);
+}
+
+
+static uint64_t
+hash_sources(bm_ctx_t *ctx, bc_slist_t *sources)
+{
+    uint64_t rv = BC_HASH_INIT;
+    for (bc_slist_t *l = sources; l != NULL; l = l->next) {
+        bm_filectx_t *fctx = l->data;
+        uint64_t h = bm_manifest_hash_file(ctx->manifest, fctx->path,
+            fctx->short_path, fctx->tv_sec, fctx->tv_nsec);
+        rv = bc_hash_update(rv, fctx->short_path, strlen(fctx->short_path) + 1);
+        rv = bc_hash_update(rv, &h, sizeof(h));
+    }
+    return rv;
+}
+
+
+// listing outputs depend only on the sources they actually list, and on the
+// variables set by the filters (e.g. pagination). finding them requires
+// parsing all the sources, so this is only done if any source changed.
+static void
+entry_add_members(bm_ctx_t *ctx, bm_manifest_entry_t *entry,
+    bc_trie_t *global_variables, bc_trie_t *local_variables,
+    bm_cache_template_vars_t *vars, bc_slist_t *sources)
+{
+    bc_trie_t *config = NULL;
+    bc_error_t *err = NULL;
+    bc_slist_t *members = bm_exec_native_filter_sources(ctx, global_variables,
+        local_variables, sources, &config, &err);
+    if (err != NULL) {
+        // blogc will fail and report the error. the output is rebuilt,
+        // because the entry won't match any recorded entry.
+        bc_error_free(err);
+        bc_trie_free(config);
+        return;
+    }
+
+    for (bc_slist_t *l = members; l != NULL; l = l->next) {
+        bm_filectx_t *fctx = l->data;
+        bm_manifest_entry_add_member(ctx->manifest, entry, fctx->path,
+            fctx->short_path, fctx->tv_sec, fctx->tv_nsec);
+    }
+
+    bm_manifest_entry_add_member_hash(entry, ":filter",
+        hash_config(BC_HASH_INIT, config, vars));
+
+    bc_slist_free(members);
+    bc_trie_free(config);
+}
+
+
+// returns the reason to rebuild the output, for build traces, or NULL if it
+// is up to date.
+static const char*
+need_rebuild(bm_ctx_t *ctx, bm_manifest_entry_t *entry, bc_slist_t *sources,
+    bm_filectx_t *listing_entry, bm_filectx_t *template, bm_filectx_t *output,
+    bool only_first_source)
+{
+    if (!output->readable)
+        return "missing output";
+
+    if (bm_manifest_contains(ctx->manifest, output->short_path))
+        return bm_manifest_changed(ctx->manifest, output->short_path, entry) ?
+            "inputs changed" : NULL;
+
+    if (ctx->atom_template_tmp && template == ctx->atom_template_fctx)
+        template = NULL;
+
+    return bm_rule_need_rebuild(sources, ctx->settings_fctx, listing_entry,
+        template, output, only_first_source) ? "inputs newer" : NULL;
+}
+
+
+static void
+trace_output(bm_trace_span_t *span, bm_filectx_t *output, const char *reason,
+    int rv)
+{
+    if (!bm_trace_enabled())
+        return;
+
+    struct stat buf;
+    long long bytes = 0;
+    if (rv == 0 && 0 == stat(output->path, &buf))
+        bytes = buf.st_size;
+
+    bm_trace_end(span, "output", output->short_path,
+        "\"bytes\": %lld, \"reason\": \"%s\", \"status\": %d", bytes,
+        reason, rv);
+}
+
+
+static int
+blogc_job_run(bm_rule_blogc_job_t *job)
+{
+    bm_ctx_t *ctx = job->ctx;
+    bm_trace_span_t span;
+    bm_trace_begin(&span);
+
+    // outputs rendered before, by any build sharing the artifact cache, are
+    // restored without rendering.
+    char *key = NULL;
+    size_t len = 0;
+    char *artifact = NULL;
+    if (ctx->artifacts != NULL) {
+        key = bm_artifacts_key(ctx->artifacts, job->entry);
+        artifact = bm_artifacts_lookup(ctx->artifacts, key, &len);
+    }
+
+    int rv;
+    if (artifact != NULL) {
+        rv = bm_exec_native_restore(ctx, job->output, artifact, len);
+        free(artifact);
+    }
+    else {
+        rv = bm_exec_blogc(ctx, job->global_variables, job->local_variables,
+            job->listing, job->listing_entry, job->template, job->output,
+            job->sources, job->only_first_source, job->minify);
+        if (rv == 0)
+            bm_artifacts_store(ctx->artifacts, key, job->output->path);
+    }
+    free(key);
+
+    if (rv == 0)
+        rv = bm_compress_sidecars(ctx, job->output, false);
+
+    trace_output(&span, job->output, job->reason, rv);
+    if (rv == 0) {
+        bm_manifest_update(job->ctx->manifest, job->output->short_path,
+            job->entry);
+        job->entry = NULL;
+    }
+    return rv;
+}
+
+
+static void
+blogc_job_free(bm_rule_blogc_job_t *job)
+{
+    if (job == NULL)
+        return;
+    bc_trie_free(job->global_variables);
+    bc_trie_free(job->local_variables);
+    bm_manifest_entry_free(job->entry);
+    free(job);
+}
+
+
+// outputs of other shards are built by other blogc-make processes. the
+// short path is also the key of the output in the manifest.
+static bool
+in_shard(bm_ctx_t *ctx, bm_filectx_t *output)
+{
+    return bm_shard_contains(output->short_path, ctx->shard, ctx->shards);
+}
+
+
+// output lists are built without stat'ing the outputs, that are stat'ed here
+// at once. outputs of other shards aren't even looked at.
+static bc_slist_t*
+rule_outputlist(bm_ctx_t *ctx, const bm_rule_t *rule)
+{
+    bc_slist_t *rv = rule->outputlist_func(ctx);
+    if (ctx->shards == 0) {
+        bm_filectx_stat_list(rv);
+        return rv;
+    }
+
+    bc_slist_t *outputs = NULL;
+    for (bc_slist_t *l = rv; l != NULL; l = l->next) {
+        if (l->data != NULL && in_shard(ctx, l->data))
+            outputs = bc_slist_prepend(outputs, l->data);
+    }
+    bm_filectx_stat_list(outputs);
+    bc_slist_free(outputs);
+    return rv;
+}
+
+
+static int
+rule_blogc(bm_ctx_t *ctx, bc_trie_t *global_variables, bc_trie_t *local_variables,
+    bool listing, bm_filectx_t *listing_entry, bm_filectx_t *template,
+    bm_filectx_t *output, bc_slist_t *sources, bool only_first_source,
+    bool minify)
+{
+    if (!in_shard(ctx, output))
+        return 0;
+
+    bm_cache_template_vars_t *vars = template_vars(ctx, template, listing);
+    bm_manifest_entry_t *entry = bm_manifest_entry_new(hash_variables(ctx,
+        global_variables, local_variables, vars, listing, only_first_source));
+    if (listing) {
+        entry->sources = hash_sources(ctx, sources);
+        entry_add_fctx(ctx, entry, listing_entry);
+        entry_add_template(ctx, entry, template, true);
+        if (!bm_manifest_entry_reuse_members(ctx->manifest, output->short_path,
+                entry))
+            entry_add_members(ctx, entry, global_variables, local_variables,
+                vars, sources);
+    }
+    else {
+        for (bc_slist_t *l = sources; l != NULL; l = l->next) {
+            entry_add_fctx(ctx, entry, l->data);
+            if (only_first_source)
+                break;
+        }
+        entry_add_template(ctx, entry, template, false);
+    }
+    template_vars_free(ctx, template, vars);
+    if (minify)
+        bm_manifest_entry_add_hash(entry, ":minify", 1);
+    entry_add_compress(ctx, entry, output, false);
+
+    const char *reason = need_rebuild(ctx, entry, sources,
+        listing ? listing_entry : NULL, template, output, only_first_source);
+    if (reason == NULL) {
+        // outputs that are up to date by timestamps are added to the
+        // manifest, so next runs can rely on it. entries of listing outputs
+        // are also updated if their sources changed, to keep their members.
+        bm_manifest_update(ctx->manifest, output->short_path, entry);
+        return 0;
+    }
+
+    bm_rule_blogc_job_t *job = bc_malloc(sizeof(bm_rule_blogc_job_t));
+    job->ctx = ctx;
+    job->global_variables = NULL;
+    job->local_variables = NULL;
+    job->listing = listing;
+    job->listing_entry = listing_entry;
+    job->template = template;
+    job->output = output;
+    job->sources = sources;
+    job->only_first_source = only_first_source;
+    job->minify = minify;
+    job->entry = entry;
+    job->reason = reason;
+
+    if (ctx->jobs == NULL) {
+        job->global_variables = global_variables;
+        job->local_variables = local_variables;
+        int rv = blogc_job_run(job);
+        bm_manifest_entry_free(job->entry);
+        free(job);
+        return rv;
+    }
+
+    job->global_variables = copy_variables(global_variables);
+    job->local_variables = copy_variables(local_variables);
+
+    return bm_jobs_submit(ctx->jobs, (bm_job_func_t) blogc_job_run, job,
+        (bc_free_func_t) blogc_job_free);
+}
+
+
+static int
+copy_job_run(bm_rule_copy_job_t *job)
+{
+    bm_trace_span_t span;
+    bm_trace_begin(&span);
+    int rv = bm_exec_native_cp(job->ctx, job->source, job->dest);
+    if (rv == 0)
+        rv = bm_compress_sidecars(job->ctx, job->dest, true);
+    trace_output(&span, job->dest, job->reason, rv);
+    if (rv == 0) {
+        bm_manifest_update(job->ctx->manifest, job->dest->short_path,
+            job->entry);
+        job->entry = NULL;
+    }
+    return rv;
+}
+
+
+static void
+copy_job_free(bm_rule_copy_job_t *job)
+{
+    if (job == NULL)
+        return;
+    bm_manifest_entry_free(job->entry);
+    free(job);
+}
+
+
+static int
+rule_copy(bm_ctx_t *ctx, bc_slist_t *source, bm_filectx_t *dest)
+{
+    if (!in_shard(ctx, dest))
+        return 0;
+
+    // switching copy modes must replace all the copies.
+    const char *copy_mode = bm_ctx_settings_lookup(ctx, "copy_mode");
+    bm_manifest_entry_t *entry = bm_manifest_entry_new(
+        copy_mode != NULL ? bc_hash_str(copy_mode) : 0);
+    entry_add_fctx(ctx, entry, source->data);
+    entry_add_compress(ctx, entry, dest, true);
+
+    const char *reason = need_rebuild(ctx, entry, source, NULL, NULL, dest,
+        true);
+    if (reason == NULL) {
+        bm_manifest_update(ctx->manifest, dest->short_path, entry);
+        return 0;
+    }
+
+    bm_rule_copy_job_t *job = bc_malloc(sizeof(bm_rule_copy_job_t));
+    job->ctx = ctx;
+    job->source = source->data;
+    job->dest = dest;
+    job->entry = entry;
+    job->reason = reason;
+
+    // runs inline without a job pool.
+    return bm_jobs_submit(ctx->jobs, (bm_job_func_t) copy_job_run, job,
+        (bc_free_func_t) copy_job_free);
+}
+
+
+// TAGS INDEX
+//
+// tag listings get only the posts with the tag as sources, instead of all
+// the posts for blogc to filter by FILTER_TAG (that is still set, and keeps
+// working as before). the index is built once per rule execution, from the
+// metadata of the posts, and keeps their order.
+
+typedef struct {
+    bc_slist_t *posts;
+    bc_slist_t *tail;
+} bm_rule_tag_t;
+
+
+static void
+tag_free(bm_rule_tag_t *tag)
+{
+    if (tag == NULL)
+        return;
+    bc_slist_free(tag->posts);
+    free(tag);
+}
+
+
+static bc_trie_t*
+tags_index(bm_ctx_t *ctx)
+{
+    bc_trie_t *rv = bc_trie_new((bc_free_func_t) tag_free);
+
+    for (bc_slist_t *l = ctx->posts_fctx; l != NULL; l = l->next) {
+        bm_filectx_t *fctx = l->data;
+        bc_error_t *err = NULL;
+        bc_trie_t *src = bm_cache_get_metadata(ctx->cache, fctx->path, &err);
+        if (src == NULL) {
+            // blogc will fail and report the error.
+            bc_error_free(err);
+            bc_trie_free(rv);
+            return NULL;
+        }
+
+        // same parsing done by blogc for FILTER_TAG.
+        const char *tags_str = bc_trie_lookup(src, "TAGS");
+        if (tags_str == NULL)
+            continue;
+
+        char **tags = bc_str_split(tags_str, ' ', 0);
+        for (size_t i = 0; tags[i] != NULL; i++) {
+            if (tags[i][0] == '\0')
+                continue;
+            bm_rule_tag_t *tag = bc_trie_lookup(rv, tags[i]);
+            if (tag == NULL) {
+                tag = bc_malloc(sizeof(bm_rule_tag_t));
+                tag->posts = NULL;
+                tag->tail = NULL;
+                bc_trie_insert(rv, tags[i], tag);
+            }
+            else if (tag->tail->data == fctx) {
+                continue;  // tag repeated in the same post
+            }
+            bc_slist_t *node = bc_malloc(sizeof(bc_slist_t));
+            node->next = NULL;
+            node->data = fctx;
+            if (tag->tail == NULL)
+                tag->posts = node;
+            else
+                tag->tail->next = node;
+            tag->tail = node;
+        }
+        bc_strv_free(tags);
+    }
+
+    return rv;
+}
+
+
+static bc_slist_t*
+tag_posts(bm_ctx_t *ctx, const char *tag)
+{
+    if (ctx->tags_posts == NULL)
+        ctx->tags_posts = tags_index(ctx);
+
+    // if the index can't be built, all the posts are filtered by blogc.
+    if (ctx->tags_posts == NULL)
+        return ctx->posts_fctx;
+
+    bm_rule_tag_t *t = bc_trie_lookup(ctx->tags_posts, tag);
+    return t != NULL ? t->posts : NULL;
+}
+
+
 // INDEX RULE
 
 static bc_slist_t*
@@ -87,7 +761,7 @@ index_outputlist(bm_ctx_t *ctx)
 
     char *f = bm_generate_filename(ctx->short_output_dir, index_prefix, NULL,
         html_ext);
-    rv = bc_slist_append(rv, bm_filectx_new(ctx, f, NULL, NULL));
+    rv = bc_slist_append(rv, bm_filectx_new_lazy(ctx, f, NULL));
     free(f);
 
     return rv;
@@ -102,6 +776,7 @@ index_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
     int rv = 0;
 
     bc_trie_t *variables = bc_trie_new(free);
+    bool minify = output_minify(ctx, "html_minify");
     posts_pagination(ctx, variables, "posts_per_page");
     posts_ordering(ctx, variables, "html_order");
     bc_trie_insert(variables, "DATE_FORMAT",
@@ -113,14 +788,10 @@ index_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
         bm_filectx_t *fctx = l->data;
         if (fctx == NULL)
             continue;
-        if (bm_rule_need_rebuild(ctx->posts_fctx, ctx->settings_fctx,
-                ctx->listing_entry_fctx, ctx->main_template_fctx, fctx, false))
-        {
-            rv = bm_exec_blogc(ctx, variables, NULL, true, ctx->listing_entry_fctx,
-                ctx->main_template_fctx, fctx, ctx->posts_fctx, false);
-            if (rv != 0)
-                break;
-        }
+        rv = rule_blogc(ctx, variables, NULL, true, ctx->listing_entry_fctx,
+            ctx->main_template_fctx, fctx, ctx->posts_fctx, false, minify);
+        if (rv != 0)
+            break;
     }
 
     bc_trie_free(variables);
@@ -147,7 +818,7 @@ atom_outputlist(bm_ctx_t *ctx)
 
     char *f = bm_generate_filename(ctx->short_output_dir, atom_prefix, NULL,
         atom_ext);
-    rv = bc_slist_append(rv, bm_filectx_new(ctx, f, NULL, NULL));
+    rv = bc_slist_append(rv, bm_filectx_new_lazy(ctx, f, NULL));
     free(f);
 
     return rv;
@@ -162,6 +833,7 @@ atom_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
     int rv = 0;
 
     bc_trie_t *variables = bc_trie_new(free);
+    bool minify = output_minify(ctx, "atom_minify");
     posts_pagination(ctx, variables, "atom_posts_per_page");
     posts_ordering(ctx, variables, "atom_order");
     bc_trie_insert(variables, "DATE_FORMAT", bc_strdup("%Y-%m-%dT%H:%M:%SZ"));
@@ -172,15 +844,10 @@ atom_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
         bm_filectx_t *fctx = l->data;
         if (fctx == NULL)
             continue;
-        if (bm_rule_need_rebuild(ctx->posts_fctx, ctx->settings_fctx, NULL,
-                ctx->atom_template_tmp ? NULL : ctx->atom_template_fctx,
-                fctx, false))
-        {
-            rv = bm_exec_blogc(ctx, variables, NULL, true, NULL, ctx->atom_template_fctx,
-                fctx, ctx->posts_fctx, false);
-            if (rv != 0)
-                break;
-        }
+        rv = rule_blogc(ctx, variables, NULL, true, NULL, ctx->atom_template_fctx,
+            fctx, ctx->posts_fctx, false, minify);
+        if (rv != 0)
+            break;
     }
 
     bc_trie_free(variables);
@@ -208,7 +875,7 @@ atom_tags_outputlist(bm_ctx_t *ctx)
     for (size_t i = 0; ctx->settings->tags[i] != NULL; i++) {
         char *f = bm_generate_filename(ctx->short_output_dir, atom_prefix,
             ctx->settings->tags[i], atom_ext);
-        rv = bc_slist_append(rv, bm_filectx_new(ctx, f, NULL, NULL));
+        rv = bc_slist_append(rv, bm_filectx_new_lazy(ctx, f, NULL));
         free(f);
     }
 
@@ -225,6 +892,7 @@ atom_tags_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
     size_t i = 0;
 
     bc_trie_t *variables = bc_trie_new(free);
+    bool minify = output_minify(ctx, "atom_minify");
     posts_pagination(ctx, variables, "atom_posts_per_page");
     posts_ordering(ctx, variables, "atom_order");
     bc_trie_insert(variables, "DATE_FORMAT", bc_strdup("%Y-%m-%dT%H:%M:%SZ"));
@@ -239,15 +907,10 @@ atom_tags_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
         bc_trie_insert(variables, "FILTER_TAG",
             bc_strdup(ctx->settings->tags[i]));
 
-        if (bm_rule_need_rebuild(ctx->posts_fctx, ctx->settings_fctx, NULL,
-                ctx->atom_template_tmp ? NULL : ctx->atom_template_fctx,
-                fctx, false))
-        {
-            rv = bm_exec_blogc(ctx, variables, NULL, true, NULL, ctx->atom_template_fctx,
-                fctx, ctx->posts_fctx, false);
-            if (rv != 0)
-                break;
-        }
+        rv = rule_blogc(ctx, variables, NULL, true, NULL, ctx->atom_template_fctx,
+            fctx, tag_posts(ctx, ctx->settings->tags[i]), false, minify);
+        if (rv != 0)
+            break;
     }
 
     bc_trie_free(variables);
@@ -270,17 +933,14 @@ pagination_outputlist(bm_ctx_t *ctx)
     bc_trie_t *variables = bc_trie_new(free);
     posts_pagination(ctx, variables, "posts_per_page");
 
-    char *last_page = bm_exec_blogc_get_variable(ctx, variables, NULL, "LAST_PAGE",
-        true, ctx->posts_fctx, false);
+    long pages = bm_exec_native_count_pages(ctx, variables, NULL,
+        ctx->posts_fctx);
 
     bc_trie_free(variables);
 
-    if (last_page == NULL)
+    if (pages <= 0)
         return NULL;
 
-    long pages = strtol(last_page, NULL, 10);
-    free(last_page);
-
     bc_slist_t *rv = NULL;
 
     const char *pagination_prefix = bm_ctx_settings_lookup(ctx, "pagination_prefix");
@@ -290,7 +950,7 @@ pagination_outputlist(bm_ctx_t *ctx)
         char *j = bc_strdup_printf("%d", i + 1);
         char *f = bm_generate_filename(ctx->short_output_dir, pagination_prefix,
             j, html_ext);
-        rv = bc_slist_append(rv, bm_filectx_new(ctx, f, NULL, NULL));
+        rv = bc_slist_append(rv, bm_filectx_new_lazy(ctx, f, NULL));
         free(j);
         free(f);
     }
@@ -308,6 +968,7 @@ pagination_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
     size_t page = 1;
 
     bc_trie_t *variables = bc_trie_new(free);
+    bool minify = output_minify(ctx, "html_minify");
     // not using posts_pagination because we set FILTER_PAGE anyway, and the
     // first value inserted in that function would be useless
     bc_trie_insert(variables, "FILTER_PER_PAGE",
@@ -323,14 +984,10 @@ pagination_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
         if (fctx == NULL)
             continue;
         bc_trie_insert(variables, "FILTER_PAGE", bc_strdup_printf("%zu", page));
-        if (bm_rule_need_rebuild(ctx->posts_fctx, ctx->settings_fctx,
-                ctx->listing_entry_fctx, ctx->main_template_fctx, fctx, false))
-        {
-            rv = bm_exec_blogc(ctx, variables, NULL, true, ctx->listing_entry_fctx,
-                ctx->main_template_fctx, fctx, ctx->posts_fctx, false);
-            if (rv != 0)
-                break;
-        }
+        rv = rule_blogc(ctx, variables, NULL, true, ctx->listing_entry_fctx,
+            ctx->main_template_fctx, fctx, ctx->posts_fctx, false, minify);
+        if (rv != 0)
+            break;
     }
 
     bc_trie_free(variables);
@@ -363,22 +1020,19 @@ pagination_tags_outputlist(bm_ctx_t *ctx)
         bc_trie_t *local = bc_trie_new(free);
         bc_trie_insert(local, "FILTER_TAG", bc_strdup(ctx->settings->tags[k]));
 
-        char *last_page = bm_exec_blogc_get_variable(ctx, variables, local,
-            "LAST_PAGE", true, ctx->posts_fctx, false);
+        long pages = bm_exec_native_count_pages(ctx, variables, local,
+            tag_posts(ctx, ctx->settings->tags[k]));
 
         bc_trie_free(local);
 
-        if (last_page == NULL)
+        if (pages <= 0)
             continue;
 
-        long pages = strtol(last_page, NULL, 10);
-        free(last_page);
-
         for (size_t i = 0; i < pages; i++) {
             char *j = bc_strdup_printf("%d", i + 1);
             char *f = bm_generate_filename2(ctx->short_output_dir, tag_prefix,
                 ctx->settings->tags[k], pagination_prefix, j, html_ext);
-            rv = bc_slist_append(rv, bm_filectx_new(ctx, f, NULL, NULL));
+            rv = bc_slist_append(rv, bm_filectx_new_lazy(ctx, f, NULL));
             free(j);
             free(f);
         }
@@ -399,6 +1053,7 @@ pagination_tags_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
     size_t page = 1;
 
     bc_trie_t *variables = bc_trie_new(free);
+    bool minify = output_minify(ctx, "html_minify");
     // not using posts_pagination because we set FILTER_PAGE anyway, and the
     // first value inserted in that function would be useless
     bc_trie_insert(variables, "FILTER_PER_PAGE",
@@ -449,14 +1104,10 @@ pagination_tags_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
         bc_trie_insert(variables, "FILTER_TAG", bc_strdup(tag));
         bc_trie_insert(variables, "FILTER_PAGE", bc_strdup_printf("%zu", page));
 
-        if (bm_rule_need_rebuild(ctx->posts_fctx, ctx->settings_fctx,
-                ctx->listing_entry_fctx, ctx->main_template_fctx, fctx, false))
-        {
-            rv = bm_exec_blogc(ctx, variables, NULL, true, ctx->listing_entry_fctx,
-                ctx->main_template_fctx, fctx, ctx->posts_fctx, false);
-            if (rv != 0)
-                break;
-        }
+        rv = rule_blogc(ctx, variables, NULL, true, ctx->listing_entry_fctx,
+            ctx->main_template_fctx, fctx, tag_posts(ctx, tag), false, minify);
+        if (rv != 0)
+            break;
     }
 
     bc_trie_free(variables);
@@ -481,7 +1132,7 @@ posts_outputlist(bm_ctx_t *ctx)
     for (size_t i = 0; ctx->settings->posts[i] != NULL; i++) {
         char *f = bm_generate_filename(ctx->short_output_dir, post_prefix,
             ctx->settings->posts[i], html_ext);
-        rv = bc_slist_append(rv, bm_filectx_new(ctx, f, NULL, NULL));
+        rv = bc_slist_append(rv, bm_filectx_new_lazy(ctx, f, NULL));
         free(f);
     }
 
@@ -497,6 +1148,7 @@ posts_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
     int rv = 0;
 
     bc_trie_t *variables = bc_trie_new(free);
+    bool minify = output_minify(ctx, "html_minify");
     bc_trie_insert(variables, "IS_POST", bc_strdup("1"));
     bc_trie_insert(variables, "DATE_FORMAT",
         bc_strdup(bm_ctx_settings_lookup(ctx, "date_format")));
@@ -513,17 +1165,13 @@ posts_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
         bm_filectx_t *o_fctx = o->data;
         if (o_fctx == NULL)
             continue;
-        if (bm_rule_need_rebuild(s, ctx->settings_fctx, NULL,
-                ctx->main_template_fctx, o_fctx, true))
-        {
-            bc_trie_t *local = bc_trie_new(NULL);
-            bc_trie_insert(local, "MAKE_SLUG", s_fctx->slug);  // no need to copy
-            rv = bm_exec_blogc(ctx, variables, local, false, NULL, ctx->main_template_fctx,
-                o_fctx, s, true);
-            bc_trie_free(local);
-            if (rv != 0)
-                break;
-        }
+        bc_trie_t *local = bc_trie_new(NULL);
+        bc_trie_insert(local, "MAKE_SLUG", s_fctx->slug);  // no need to copy
+        rv = rule_blogc(ctx, variables, local, false, NULL, ctx->main_template_fctx,
+            o_fctx, s, true, minify);
+        bc_trie_free(local);
+        if (rv != 0)
+            break;
     }
 
     bc_trie_free(variables);
@@ -551,7 +1199,7 @@ tags_outputlist(bm_ctx_t *ctx)
     for (size_t i = 0; ctx->settings->tags[i] != NULL; i++) {
         char *f = bm_generate_filename(ctx->short_output_dir, tag_prefix,
             ctx->settings->tags[i], html_ext);
-        rv = bc_slist_append(rv, bm_filectx_new(ctx, f, NULL, NULL));
+        rv = bc_slist_append(rv, bm_filectx_new_lazy(ctx, f, NULL));
         free(f);
     }
 
@@ -568,6 +1216,7 @@ tags_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
     size_t i = 0;
 
     bc_trie_t *variables = bc_trie_new(free);
+    bool minify = output_minify(ctx, "html_minify");
     posts_pagination(ctx, variables, "posts_per_page");
     posts_ordering(ctx, variables, "html_order");
     bc_trie_insert(variables, "DATE_FORMAT",
@@ -583,14 +1232,11 @@ tags_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
         bc_trie_insert(variables, "FILTER_TAG",
             bc_strdup(ctx->settings->tags[i]));
 
-        if (bm_rule_need_rebuild(ctx->posts_fctx, ctx->settings_fctx,
-                ctx->listing_entry_fctx, ctx->main_template_fctx, fctx, false))
-        {
-            rv = bm_exec_blogc(ctx, variables, NULL, true, ctx->listing_entry_fctx,
-                ctx->main_template_fctx, fctx, ctx->posts_fctx, false);
-            if (rv != 0)
-                break;
-        }
+        rv = rule_blogc(ctx, variables, NULL, true, ctx->listing_entry_fctx,
+            ctx->main_template_fctx, fctx,
+            tag_posts(ctx, ctx->settings->tags[i]), false, minify);
+        if (rv != 0)
+            break;
     }
 
     bc_trie_free(variables);
@@ -614,7 +1260,7 @@ pages_outputlist(bm_ctx_t *ctx)
     for (size_t i = 0; ctx->settings->pages[i] != NULL; i++) {
         char *f = bm_generate_filename(ctx->short_output_dir, NULL,
             ctx->settings->pages[i], html_ext);
-        rv = bc_slist_append(rv, bm_filectx_new(ctx, f, NULL, NULL));
+        rv = bc_slist_append(rv, bm_filectx_new_lazy(ctx, f, NULL));
         free(f);
     }
 
@@ -630,6 +1276,7 @@ pages_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
     int rv = 0;
 
     bc_trie_t *variables = bc_trie_new(free);
+    bool minify = output_minify(ctx, "html_minify");
     bc_trie_insert(variables, "DATE_FORMAT",
         bc_strdup(bm_ctx_settings_lookup(ctx, "date_format")));
     bc_trie_insert(variables, "MAKE_RULE", bc_strdup("pages"));
@@ -644,17 +1291,13 @@ pages_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
         bm_filectx_t *o_fctx = o->data;
         if (o_fctx == NULL)
             continue;
-        if (bm_rule_need_rebuild(s, ctx->settings_fctx, NULL,
-                ctx->main_template_fctx, o_fctx, true))
-        {
-            bc_trie_t *local = bc_trie_new(NULL);
-            bc_trie_insert(local, "MAKE_SLUG", s_fctx->slug); // no need to copy
-            rv = bm_exec_blogc(ctx, variables, local, false, NULL, ctx->main_template_fctx,
-                o_fctx, s, true);
-            bc_trie_free(local);
-            if (rv != 0)
-                break;
-        }
+        bc_trie_t *local = bc_trie_new(NULL);
+        bc_trie_insert(local, "MAKE_SLUG", s_fctx->slug); // no need to copy
+        rv = rule_blogc(ctx, variables, local, false, NULL, ctx->main_template_fctx,
+            o_fctx, s, true, minify);
+        bc_trie_free(local);
+        if (rv != 0)
+            break;
     }
 
     bc_trie_free(variables);
@@ -678,7 +1321,7 @@ copy_outputlist(bm_ctx_t *ctx)
     for (bc_slist_t *s = ctx->copy_fctx; s != NULL; s = s->next) {
         char *f = bc_strdup_printf("%s/%s", ctx->short_output_dir,
             ((bm_filectx_t*) s->data)->short_path);
-        rv = bc_slist_append(rv, bm_filectx_new(ctx, f, NULL, NULL));
+        rv = bc_slist_append(rv, bm_filectx_new_lazy(ctx, f, NULL));
         free(f);
     }
 
@@ -702,11 +1345,9 @@ copy_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
         if (o_fctx == NULL)
             continue;
 
-        if (bm_rule_need_rebuild(s, ctx->settings_fctx, NULL, NULL, o_fctx, true)) {
-            rv = bm_exec_native_cp(s->data, o_fctx, ctx->verbose);
-            if (rv != 0)
-                break;
-        }
+        rv = rule_copy(ctx, s, o_fctx);
+        if (rv != 0)
+            break;
     }
 
     return rv;
@@ -715,26 +1356,59 @@ copy_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
 
 // CLEAN RULE
 
-static int
-clean_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
+static void
+outputs_add(bc_trie_t *outputs, bc_slist_t *l)
 {
-    int rv = 0;
-
-    bc_slist_t *files = bm_rule_list_built_files(ctx);
-    for (bc_slist_t *l = files; l != NULL; l = l->next) {
+    for (; l != NULL; l = l->next) {
         bm_filectx_t *fctx = l->data;
-        if (fctx == NULL)
-            continue;
+        if (fctx != NULL)
+            bc_trie_insert(outputs, fctx->short_path, (void*) 1);
+    }
+}
 
-        if (fctx->readable) {
-            rv = bm_exec_native_rm(ctx->output_dir, fctx, ctx->verbose);
-            if (rv != 0)
-                break;
-        }
+
+// lists the outputs recorded in the manifest by previous runs, that aren't
+// produced by the current settings anymore, and drops them from the manifest.
+// outputs outside of the output directory are never listed, whatever the
+// manifest says.
+static bc_slist_t*
+stale_outputs(bm_ctx_t *ctx, bc_trie_t *outputs)
+{
+    char *prefix = bc_strdup_printf("%s/", ctx->short_output_dir);
+
+    bc_slist_t *removed = bm_manifest_prune(ctx->manifest, outputs);
+    bc_slist_t *rv = NULL;
+    for (bc_slist_t *l = removed; l != NULL; l = l->next) {
+        if (bc_str_starts_with(l->data, prefix) && NULL == strstr(l->data, "/../"))
+            rv = bc_slist_prepend(rv, bm_filectx_new_lazy(ctx, l->data, NULL));
     }
+    bc_slist_free_full(removed, free);
+    free(prefix);
+
+    bm_filectx_stat_list(rv);
+    return rv;
+}
+
+
+static int
+clean_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
+{
+    // outputs built by previous runs with other settings are removed too.
+    bc_slist_t *files = bm_rule_list_built_files(ctx);
+    bc_trie_t *built = bc_trie_new(NULL);
+    outputs_add(built, files);
+    files = bc_slist_append_list(files, stale_outputs(ctx, built));
+    bc_trie_free(built);
+
+    // the manifest must go away first, otherwise the output directory won't
+    // be removed, because it is not empty.
+    int rv = bm_manifest_remove(ctx->manifest, ctx->verbose);
+    if (rv == 0)
+        rv = bm_exec_native_rm(ctx->output_dir, files, ctx->verbose);
     bc_slist_free_full(files, (bc_free_func_t) bm_filectx_free);
 
-    if (!bm_exec_native_is_empty_dir(ctx->output_dir, NULL)) {
+    // the other shards are still there.
+    if (ctx->shards == 0 && !bm_exec_native_is_empty_dir(ctx->output_dir, NULL)) {
         fprintf(stderr, "blogc-make: warning: output directory is not empty!\n");
     }
 
@@ -763,6 +1437,21 @@ watch_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
 }
 
 
+// MERGE SHARDS RULE
+
+static int
+merge_shards_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
+{
+    if (ctx->shards > 0) {
+        fprintf(stderr, "blogc-make: error: shards can't be merged by a "
+            "sharded build\n");
+        return 1;
+    }
+    return bm_manifest_merge_shards(ctx->manifest, ctx->output_dir,
+        ctx->verbose);
+}
+
+
 // ATOM DUMP RULE
 
 static int
@@ -789,54 +1478,63 @@ const bm_rule_t rules[] = {
         .help = "build website index from posts",
         .outputlist_func = index_outputlist,
         .exec_func = index_exec,
+        .inputs = BM_RULE_INPUT_TEMPLATES | BM_RULE_INPUT_POSTS,
     },
     {
         .name = "atom",
         .help = "build main atom feed from posts",
         .outputlist_func = atom_outputlist,
         .exec_func = atom_exec,
+        .inputs = BM_RULE_INPUT_TEMPLATES | BM_RULE_INPUT_POSTS,
     },
     {
         .name = "atom_tags",
         .help = "build atom feeds for each tag from posts",
         .outputlist_func = atom_tags_outputlist,
         .exec_func = atom_tags_exec,
+        .inputs = BM_RULE_INPUT_TEMPLATES | BM_RULE_INPUT_POSTS,
     },
     {
         .name = "pagination",
         .help = "build pagination pages from posts",
         .outputlist_func = pagination_outputlist,
         .exec_func = pagination_exec,
+        .inputs = BM_RULE_INPUT_TEMPLATES | BM_RULE_INPUT_POSTS,
     },
     {
         .name = "pagination_tags",
         .help = "build pagination pages for each tag from posts",
         .outputlist_func = pagination_tags_outputlist,
         .exec_func = pagination_tags_exec,
+        .inputs = BM_RULE_INPUT_TEMPLATES | BM_RULE_INPUT_POSTS,
     },
     {
         .name = "posts",
         .help = "build individual pages for each post",
         .outputlist_func = posts_outputlist,
         .exec_func = posts_exec,
+        .inputs = BM_RULE_INPUT_TEMPLATES | BM_RULE_INPUT_POSTS,
     },
     {
         .name = "tags",
         .help = "build post listings for each tag from posts",
         .outputlist_func = tags_outputlist,
         .exec_func = tags_exec,
+        .inputs = BM_RULE_INPUT_TEMPLATES | BM_RULE_INPUT_POSTS,
     },
     {
         .name = "pages",
         .help = "build individual pages for each page",
         .outputlist_func = pages_outputlist,
         .exec_func = pages_exec,
+        .inputs = BM_RULE_INPUT_TEMPLATES | BM_RULE_INPUT_PAGES,
     },
     {
         .name = "copy",
         .help = "copy static files from source directory to output directory",
         .outputlist_func = copy_outputlist,
         .exec_func = copy_exec,
+        .inputs = BM_RULE_INPUT_COPY,
     },
     {
         .name = "clean",
@@ -858,33 +1556,144 @@ const bm_rule_t rules[] = {
         .outputlist_func = NULL,
         .exec_func = watch_exec,
     },
+    {
+        .name = "merge_shards",
+        .help = "merge the manifests of sharded builds into the output directory\n"
+            "                     manifest",
+        .outputlist_func = NULL,
+        .exec_func = merge_shards_exec,
+    },
     {
         .name = "atom_dump",
         .help = "dump default Atom feed template based on current settings",
         .outputlist_func = NULL,
         .exec_func = atom_dump_exec,
     },
-    {NULL, NULL, NULL, NULL},
+    {NULL, NULL, NULL, NULL, 0},
 };
 
 
 // ALL RULE
 
+static bool
+changed_any(bc_trie_t *changed, bc_slist_t *fctxs)
+{
+    for (bc_slist_t *l = fctxs; l != NULL; l = l->next) {
+        bm_filectx_t *fctx = l->data;
+        if (NULL != bc_trie_lookup(changed, fctx->path))
+            return true;
+    }
+    return false;
+}
+
+
+static bool
+changed_one(bc_trie_t *changed, bm_filectx_t *fctx)
+{
+    return fctx != NULL && NULL != bc_trie_lookup(changed, fctx->path);
+}
+
+
+static unsigned int
+changed_inputs(bm_ctx_t *ctx)
+{
+    if (ctx->changed == NULL)
+        return ~0U;
+    if (ctx->settings_changed & (BM_SETTINGS_CHANGED_GLOBAL |
+        BM_SETTINGS_CHANGED_SETTINGS))
+        return ~0U;
+
+    unsigned int rv = 0;
+    if (ctx->settings_changed & (BM_SETTINGS_CHANGED_POSTS |
+        BM_SETTINGS_CHANGED_TAGS))
+        rv |= BM_RULE_INPUT_POSTS;
+    if (ctx->settings_changed & BM_SETTINGS_CHANGED_PAGES)
+        rv |= BM_RULE_INPUT_PAGES;
+    if (ctx->settings_changed & BM_SETTINGS_CHANGED_COPY)
+        rv |= BM_RULE_INPUT_COPY;
+    if (changed_one(ctx->changed, ctx->main_template_fctx) ||
+        changed_one(ctx->changed, ctx->atom_template_fctx) ||
+        changed_one(ctx->changed, ctx->listing_entry_fctx))
+        rv |= BM_RULE_INPUT_TEMPLATES;
+    if (changed_any(ctx->changed, ctx->posts_fctx))
+        rv |= BM_RULE_INPUT_POSTS;
+    if (changed_any(ctx->changed, ctx->pages_fctx))
+        rv |= BM_RULE_INPUT_PAGES;
+    if (changed_any(ctx->changed, ctx->copy_fctx))
+        rv |= BM_RULE_INPUT_COPY;
+    return rv;
+}
+
+
 static int
 all_exec(bm_ctx_t *ctx, bc_slist_t *outputs, bc_trie_t *args)
 {
+    int rv = 0;
+    char *locale = ctx->blogc_native ? bm_exec_native_set_locale(ctx) : NULL;
+
+    // rules don't depend on each other, so we let the jobs of all of them run
+    // together, and wait only once. the outputs must be kept until then.
+    bc_slist_t *rules_outputs = NULL;
+    unsigned int inputs = changed_inputs(ctx);
+
+    // all the outputs of the site, to prune the ones built by previous runs
+    // that aren't produced anymore.
+    bc_trie_t *built = bc_trie_new(NULL);
+
     for (size_t i = 0; rules[i].name != NULL; i++) {
         if (rules[i].outputlist_func == NULL) {
             continue;
         }
 
-        int rv = bm_rule_execute(ctx, &(rules[i]), NULL);
+        // when called by the watcher, only rules affected by the changed
+        // files need to run.
+        if (0 == (rules[i].inputs & inputs)) {
+            bc_slist_t *o = rules[i].outputlist_func(ctx);
+            outputs_add(built, o);
+            bc_slist_free_full(o, (bc_free_func_t) bm_filectx_free);
+            continue;
+        }
+
+        // with a job pool, this only covers submitting the jobs.
+        bm_trace_span_t span;
+        bm_trace_begin(&span);
+
+        bc_slist_t *o = rule_outputlist(ctx, &rules[i]);
+        rules_outputs = bc_slist_append(rules_outputs, o);
+        outputs_add(built, o);
+
+        rv = rules[i].exec_func(ctx, o, NULL);
+
+        bm_trace_end(&span, "rule", rules[i].name,
+            "\"outputs\": %zu, \"status\": %d", bc_slist_length(o), rv);
         if (rv != 0) {
-            return rv;
+            break;
         }
     }
 
-    return 0;
+    if (0 != bm_jobs_wait(ctx->jobs) && rv == 0)
+        rv = 1;
+
+    // a failed build may not know all of its outputs.
+    if (rv == 0) {
+        bc_slist_t *stale = stale_outputs(ctx, built);
+        rv = bm_exec_native_rm(ctx->output_dir, stale, ctx->verbose);
+        bc_slist_free_full(stale, (bc_free_func_t) bm_filectx_free);
+    }
+    bc_trie_free(built);
+
+    for (bc_slist_t *l = rules_outputs; l != NULL; l = l->next)
+        bc_slist_free_full(l->data, (bc_free_func_t) bm_filectx_free);
+    bc_slist_free(rules_outputs);
+
+    bc_trie_free(ctx->tags_posts);
+    ctx->tags_posts = NULL;
+
+    bm_manifest_save(ctx->manifest);
+    bm_cache_purge(ctx->cache);
+    bm_exec_native_restore_locale(locale);
+
+    return rv;
 }
 
 
@@ -974,15 +1783,36 @@ bm_rule_execute(bm_ctx_t *ctx, const bm_rule_t *rule, bc_trie_t *args)
     if (ctx == NULL || rule == NULL)
         return 1;
 
+    bm_trace_span_t span;
+    bm_trace_begin(&span);
+
+    char *locale = ctx->blogc_native ? bm_exec_native_set_locale(ctx) : NULL;
+
     bc_slist_t *outputs = NULL;
     if (rule->outputlist_func != NULL) {
-        outputs = rule->outputlist_func(ctx);
+        outputs = rule_outputlist(ctx, rule);
     }
+    size_t outputs_len = bc_slist_length(outputs);
 
     int rv = rule->exec_func(ctx, outputs, args);
 
+    // jobs submitted by the rule must finish before releasing its outputs.
+    // this also guarantees that rules run in the order they were requested.
+    if (0 != bm_jobs_wait(ctx->jobs) && rv == 0)
+        rv = 1;
+
     bc_slist_free_full(outputs, (bc_free_func_t) bm_filectx_free);
 
+    bc_trie_free(ctx->tags_posts);
+    ctx->tags_posts = NULL;
+
+    bm_manifest_save(ctx->manifest);
+    bm_cache_purge(ctx->cache);
+    bm_exec_native_restore_locale(locale);
+
+    bm_trace_end(&span, "rule", rule->name,
+        "\"outputs\": %zu, \"status\": %d", outputs_len, rv);
+
     return rv;
 }
 
@@ -1049,8 +1879,12 @@ bm_rule_list_built_files(bm_ctx_t *ctx)
             continue;
         }
 
-        bc_slist_t *o = rules[i].outputlist_func(ctx);
+        bc_slist_t *o = rule_outputlist(ctx, &rules[i]);
         for (bc_slist_t *l = o; l != NULL; l = l->next) {
+            if (l->data != NULL && !in_shard(ctx, l->data)) {
+                bm_filectx_free(l->data);
+                continue;
+            }
             rv = bc_slist_append(rv, l->data);
         }
         bc_slist_free(o);
@@ -17,11 +17,21 @@ typedef bc_slist_t* (*bm_rule_outputlist_func_t) (bm_ctx_t *ctx);
 typedef int (*bm_rule_exec_func_t) (bm_ctx_t *ctx, bc_slist_t *outputs,
     bc_trie_t *args);
 
+// kinds of input files used by build rules, to skip rules not affected by the
+// files changed in the watcher.
+typedef enum {
+    BM_RULE_INPUT_TEMPLATES = 1 << 0,
+    BM_RULE_INPUT_POSTS = 1 << 1,
+    BM_RULE_INPUT_PAGES = 1 << 2,
+    BM_RULE_INPUT_COPY = 1 << 3,
+} bm_rule_input_t;
+
 typedef struct {
     const char *name;
     const char *help;
     bm_rule_outputlist_func_t outputlist_func;
     bm_rule_exec_func_t exec_func;
+    unsigned int inputs;
 } bm_rule_t;
 
 bc_trie_t* bm_rule_parse_args(const char *sep);
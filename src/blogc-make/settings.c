@@ -9,6 +9,7 @@
 #include <libgen.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include "../common/config-parser.h"
 #include "../common/error.h"
 #include "../common/file.h"
@@ -29,6 +30,7 @@ static const struct default_settings_map {
     {"source_ext", ".txt"},
     {"listing_entry", NULL},
     {"posts_sort", NULL},
+    {"copy_mode", NULL},  // default: copy
 
     // pagination
     {"pagination_prefix", "page"},
@@ -41,12 +43,19 @@ static const struct default_settings_map {
     {"post_prefix", "post"},
     {"tag_prefix", "tag"},
     {"html_order", "DESC"},
+    {"html_minify", NULL},
 
     // atom
     {"atom_prefix", "atom"},
     {"atom_ext", ".xml"},
     {"atom_order", "DESC"},
     {"atom_legacy_entry_id", NULL},
+    {"atom_minify", NULL},
+
+    // compression
+    {"gzip_level", NULL},  // default: no gzip sidecars
+    {"brotli_level", NULL},  // default: no brotli sidecars
+    {"compress_ext", ".css .html .js .json .svg .txt .xml"},
 
     // generic
     {"date_format", "%b %d, %Y, %I:%M %p GMT"},
@@ -188,6 +197,72 @@ cleanup:
 }
 
 
+typedef struct {
+    bc_trie_t *other;
+    bool equal;
+} trie_equal_ctx_t;
+
+
+static void
+trie_equal_cb(const char *key, void *data, void *user_data)
+{
+    trie_equal_ctx_t *ctx = user_data;
+    if (!ctx->equal)
+        return;
+    const char *other = bc_trie_lookup(ctx->other, key);
+    ctx->equal = other != NULL && 0 == strcmp(data, other);
+}
+
+
+static bool
+trie_equal(bc_trie_t *a, bc_trie_t *b)
+{
+    if (bc_trie_size(a) != bc_trie_size(b))
+        return false;
+    trie_equal_ctx_t ctx = {.other = b, .equal = true};
+    bc_trie_foreach(a, trie_equal_cb, &ctx);
+    return ctx.equal;
+}
+
+
+static bool
+strv_equal(char **a, char **b)
+{
+    if (a == NULL || b == NULL)
+        return bc_strv_length(a) == bc_strv_length(b);
+    size_t i;
+    for (i = 0; a[i] != NULL && b[i] != NULL; i++)
+        if (0 != strcmp(a[i], b[i]))
+            return false;
+    return a[i] == NULL && b[i] == NULL;
+}
+
+
+// returns the sections that differ between two settings, as a combination of
+// bm_settings_changed_t flags.
+unsigned int
+bm_settings_diff(bm_settings_t *a, bm_settings_t *b)
+{
+    if (a == NULL || b == NULL)
+        return a == b ? 0 : BM_SETTINGS_CHANGED_ALL;
+
+    unsigned int rv = 0;
+    if (!trie_equal(a->global, b->global))
+        rv |= BM_SETTINGS_CHANGED_GLOBAL;
+    if (!trie_equal(a->settings, b->settings))
+        rv |= BM_SETTINGS_CHANGED_SETTINGS;
+    if (!strv_equal(a->posts, b->posts))
+        rv |= BM_SETTINGS_CHANGED_POSTS;
+    if (!strv_equal(a->pages, b->pages))
+        rv |= BM_SETTINGS_CHANGED_PAGES;
+    if (!strv_equal(a->copy, b->copy))
+        rv |= BM_SETTINGS_CHANGED_COPY;
+    if (!strv_equal(a->tags, b->tags))
+        rv |= BM_SETTINGS_CHANGED_TAGS;
+    return rv;
+}
+
+
 void
 bm_settings_free(bm_settings_t *settings)
 {
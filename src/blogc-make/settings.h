@@ -22,8 +22,20 @@ typedef struct {
     char **tags;
 } bm_settings_t;
 
+typedef enum {
+    BM_SETTINGS_CHANGED_GLOBAL = 1 << 0,
+    BM_SETTINGS_CHANGED_SETTINGS = 1 << 1,
+    BM_SETTINGS_CHANGED_POSTS = 1 << 2,
+    BM_SETTINGS_CHANGED_PAGES = 1 << 3,
+    BM_SETTINGS_CHANGED_COPY = 1 << 4,
+    BM_SETTINGS_CHANGED_TAGS = 1 << 5,
+} bm_settings_changed_t;
+
+#define BM_SETTINGS_CHANGED_ALL ((1 << 6) - 1)
+
 bm_settings_t* bm_settings_parse(const char *content, size_t content_len,
     bc_error_t **err);
+unsigned int bm_settings_diff(bm_settings_t *a, bm_settings_t *b);
 void bm_settings_free(bm_settings_t *settings);
 
 #endif /* _MAKE_SETTINGS_H */
@@ -0,0 +1,209 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../common/error.h"
+#include "../common/utils.h"
+#include "trace.h"
+
+// build traces are written in the chrome trace event format (json array
+// format), that can be loaded by chrome://tracing and perfetto. each span is
+// written as a complete event ("ph": "X") as soon as it ends, and the array
+// is only closed when the trace is closed. the viewers accept unterminated
+// arrays, so traces of interrupted builds (e.g. watch rule) are still usable.
+//
+// like the job output functions, the trace is global, because it must be
+// available before the context is created, and from the job threads.
+
+static FILE *trace_fp = NULL;
+static bool trace_first = true;
+static int trace_tids = 0;
+static int64_t trace_start = 0;
+static pthread_mutex_t mutex_trace = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key_tid;
+
+
+static void
+key_create(void)
+{
+    pthread_key_create(&key_tid, free);
+}
+
+
+static int64_t
+clock_us(clockid_t clock)
+{
+    struct timespec ts;
+    if (0 != clock_gettime(clock, &ts))
+        return 0;
+    return ((int64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static int64_t
+cpu_us(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    return clock_us(CLOCK_THREAD_CPUTIME_ID);
+#else
+    return 0;
+#endif
+}
+
+
+// must be called with the trace mutex locked.
+static int
+thread_id(void)
+{
+    pthread_once(&key_once, key_create);
+    int *tid = pthread_getspecific(key_tid);
+    if (tid == NULL) {
+        tid = bc_malloc(sizeof(int));
+        *tid = ++trace_tids;
+        pthread_setspecific(key_tid, tid);
+        // the main thread is always the first to write events.
+        fprintf(trace_fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", "
+            "\"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"",
+            trace_first ? "[\n" : ",\n", *tid);
+        if (*tid == 1)
+            fputs("main\"}}", trace_fp);
+        else
+            fprintf(trace_fp, "job %d\"}}", *tid - 1);
+        trace_first = false;
+    }
+    return *tid;
+}
+
+
+static void
+write_escaped(const char *str)
+{
+    for (const char *c = str; *c != '\0'; c++) {
+        switch (*c) {
+            case '"':
+            case '\\':
+                fputc('\\', trace_fp);
+                fputc(*c, trace_fp);
+                break;
+            default:
+                if ((unsigned char) *c < 0x20)
+                    fprintf(trace_fp, "\\u%04x", (unsigned char) *c);
+                else
+                    fputc(*c, trace_fp);
+        }
+    }
+}
+
+
+bool
+bm_trace_open(const char *filename, bc_error_t **err)
+{
+    if (filename == NULL || err == NULL || *err != NULL)
+        return false;
+
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL) {
+        *err = bc_error_new_printf(BLOGC_MAKE_ERROR_TRACE,
+            "Failed to open trace file (%s): %s", filename, strerror(errno));
+        return false;
+    }
+
+    pthread_mutex_lock(&mutex_trace);
+    if (trace_fp != NULL)
+        fclose(trace_fp);
+    trace_fp = fp;
+    trace_first = true;
+    trace_start = clock_us(CLOCK_MONOTONIC);
+    pthread_mutex_unlock(&mutex_trace);
+    return true;
+}
+
+
+void
+bm_trace_close(void)
+{
+    pthread_mutex_lock(&mutex_trace);
+    if (trace_fp != NULL) {
+        fputs(trace_first ? "[]\n" : "\n]\n", trace_fp);
+        fclose(trace_fp);
+        trace_fp = NULL;
+    }
+    pthread_mutex_unlock(&mutex_trace);
+}
+
+
+bool
+bm_trace_enabled(void)
+{
+    return trace_fp != NULL;
+}
+
+
+void
+bm_trace_begin(bm_trace_span_t *span)
+{
+    if (span == NULL)
+        return;
+    if (trace_fp == NULL) {
+        span->wall = -1;
+        return;
+    }
+    span->wall = clock_us(CLOCK_MONOTONIC);
+    span->cpu = cpu_us();
+}
+
+
+// args is a printf-like format for the members of the json object with the
+// arguments of the event (e.g. "\"bytes\": %zu"), or NULL. values are not
+// escaped.
+void
+bm_trace_end(bm_trace_span_t *span, const char *cat, const char *name,
+    const char *args, ...)
+{
+    if (span == NULL || span->wall < 0 || cat == NULL || name == NULL)
+        return;
+
+    int64_t wall = clock_us(CLOCK_MONOTONIC);
+    int64_t cpu = cpu_us();
+
+    char *tmp = NULL;
+    if (args != NULL) {
+        va_list ap;
+        va_start(ap, args);
+        tmp = bc_strdup_vprintf(args, ap);
+        va_end(ap);
+    }
+
+    pthread_mutex_lock(&mutex_trace);
+    if (trace_fp != NULL) {
+        int tid = thread_id();
+        fprintf(trace_fp, "%s{\"name\": \"", trace_first ? "[\n" : ",\n");
+        write_escaped(name);
+        fprintf(trace_fp, "\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, "
+            "\"tid\": %d, \"ts\": %" PRId64 ", \"dur\": %" PRId64 ", "
+            "\"tdur\": %" PRId64 ", \"args\": {\"cpu_us\": %" PRId64 "%s%s}}",
+            cat, tid, span->wall - trace_start, wall - span->wall,
+            cpu - span->cpu, cpu - span->cpu, tmp != NULL ? ", " : "",
+            tmp != NULL ? tmp : "");
+        trace_first = false;
+        fflush(trace_fp);
+    }
+    pthread_mutex_unlock(&mutex_trace);
+
+    free(tmp);
+}
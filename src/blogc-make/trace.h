@@ -0,0 +1,28 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#ifndef _MAKE_TRACE_H
+#define _MAKE_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../common/error.h"
+
+typedef struct {
+    int64_t wall;
+    int64_t cpu;
+} bm_trace_span_t;
+
+bool bm_trace_open(const char *filename, bc_error_t **err);
+void bm_trace_close(void);
+bool bm_trace_enabled(void);
+void bm_trace_begin(bm_trace_span_t *span);
+void bm_trace_end(bm_trace_span_t *span, const char *cat, const char *name,
+    const char *args, ...);
+
+#endif /* _MAKE_TRACE_H */
@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include "../common/error.h"
@@ -126,3 +127,15 @@ bm_abspath(const char *path, bc_error_t **err)
 
     return bc_strdup_printf("%s/%s", cwd, path);
 }
+
+
+// outputs are assigned to shards by the hash of their path relative to the
+// blogcfile directory, so every host splits the site the same way, no matter
+// the order the outputs are listed.
+bool
+bm_shard_contains(const char *output, size_t shard, size_t shards)
+{
+    if (shards == 0 || output == NULL)
+        return true;
+    return bc_hash_str(output) % shards == shard;
+}
@@ -9,6 +9,8 @@
 #ifndef _MAKE_UTILS_H
 #define _MAKE_UTILS_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include "../common/error.h"
 
 char* bm_generate_filename(const char *dir, const char *prefix, const char *fname,
@@ -16,5 +18,6 @@ char* bm_generate_filename(const char *dir, const char *prefix, const char *fnam
 char* bm_generate_filename2(const char *dir, const char *prefix, const char *fname,
     const char *prefix2, const char *fname2, const char *ext);
 char* bm_abspath(const char *path, bc_error_t **err);
+bool bm_shard_contains(const char *output, size_t shard, size_t shards);
 
 #endif /* _MAKE_UTILS_H */
@@ -6,9 +6,11 @@
  * See the file LICENSE.
  */
 
+#include <errno.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,6 +20,7 @@
 #include "loader.h"
 #include "../common/error.h"
 #include "../common/file.h"
+#include "../common/utf8.h"
 #include "../common/utils.h"
 #include "../common/sort.h"
 
@@ -111,18 +114,112 @@ blogc_source_parse_from_file(bc_trie_t *conf, const char *f, bc_error_t **err)
 }
 
 
-static int
-sort_source(const void *a, const void *b)
+// reads a source file up to the end of the content separator line, that is
+// all the source parser needs to find the metadata.
+static char*
+read_metadata(const char *f, size_t *len, bc_error_t **err)
 {
-    const char *ca = bc_trie_lookup((bc_trie_t*) a, "c");
-    const char *cb = bc_trie_lookup((bc_trie_t*) b, "c");
+    FILE *fp = fopen(f, "r");
+    if (fp == NULL) {
+        int tmp_errno = errno;
+        *err = bc_error_new_printf(BC_ERROR_FILE,
+            "Failed to open file (%s): %s", f, strerror(tmp_errno));
+        return NULL;
+    }
+
+    bc_string_t *str = bc_string_new();
+    char buffer[BC_FILE_CHUNK_SIZE];
+    bool blank = true;
+    bool separator = false;
+    bool found = false;
+
+    while (!found && !feof(fp)) {
+        size_t read_len = fread(buffer, sizeof(char), BC_FILE_CHUNK_SIZE, fp);
+
+        char *tmp = buffer;
+        if (str->len == 0 && read_len > 0) {
+            size_t skip = bc_utf8_skip_bom((uint8_t*) buffer, read_len);
+            read_len -= skip;
+            tmp += skip;
+        }
+
+        size_t start = str->len;
+        bc_string_append_len(str, tmp, read_len);
+
+        // the separator is the first line starting with '-', ignoring
+        // whitespaces, same as the source parser.
+        for (size_t i = start; i < str->len; i++) {
+            char c = str->str[i];
+            if (c == '\n' || c == '\r') {
+                if (separator) {
+                    str->len = i + 1;
+                    str->str[str->len] = '\0';
+                    found = true;
+                    break;
+                }
+                blank = true;
+                continue;
+            }
+            if (separator)
+                continue;
+            if (blank && c == '-')
+                separator = true;
+            else if (c != ' ' && c != '\t')
+                blank = false;
+        }
+    }
+    fclose(fp);
+
+    if (!bc_utf8_validate_str(str)) {
+        *err = bc_error_new_printf(BC_ERROR_FILE,
+            "File content is not valid UTF-8: %s", f);
+        bc_string_free(str, true);
+        return NULL;
+    }
+
+    *len = str->len;
+    return bc_string_free(str, false);
+}
+
+
+// parses only the metadata of a source file (the variables before the content
+// separator), that is enough to filter and paginate sources.
+bc_trie_t*
+blogc_source_parse_metadata_from_file(const char *f, bc_error_t **err)
+{
+    if (err == NULL || *err != NULL)
+        return NULL;
+
+    size_t len;
+    char *s = read_metadata(f, &len, err);
+    if (s == NULL)
+        return NULL;
+
+    bc_trie_t *rv = blogc_source_parse_metadata(s, len, err);
 
-    if (ca == NULL || cb == NULL) {
-        return 0;  // wat
+    // set FILENAME variable
+    if (rv != NULL) {
+        char *filename = blogc_get_filename(f);
+        if (filename != NULL)
+            bc_trie_insert(rv, "FILENAME", filename);
     }
 
-    unsigned long la = strtoul(ca, NULL, 10);
-    unsigned long lb = strtoul(cb, NULL, 10);
+    free(s);
+    return rv;
+}
+
+
+typedef struct {
+    bc_trie_t *source;
+    unsigned long timestamp;
+} blogc_source_item_t;
+
+
+static int
+sort_source(const void *a, const void *b)
+{
+    unsigned long la = ((const blogc_source_item_t*) a)->timestamp;
+    unsigned long lb = ((const blogc_source_item_t*) b)->timestamp;
 
     return (int) (lb - la);
 }
@@ -135,82 +232,86 @@ sort_source_reverse(const void *a, const void *b)
 }
 
 
-bc_slist_t*
-blogc_source_parse_from_files(bc_trie_t *conf, bc_slist_t *l, bc_error_t **err)
+static blogc_source_item_t*
+source_item_new(bc_trie_t *s, const char *f, bool sort, size_t *with_date,
+    bc_error_t **err)
 {
-    if (err == NULL || *err != NULL)
-        return NULL;
+    const char *date = bc_trie_lookup(s, "DATE");
+    if (date != NULL) {
+        (*with_date)++;
+    }
 
-    bool sort = bc_str_to_bool(bc_trie_lookup(conf, "FILTER_SORT"));
+    unsigned long timestamp = 0;
 
-    bc_slist_t* sources = NULL;
-    bc_error_t *tmp_err = NULL;
-    size_t with_date = 0;
-    for (bc_slist_t *tmp = l; tmp != NULL; tmp = tmp->next) {
-        char *f = tmp->data;
-        bc_trie_t *s = blogc_source_parse_from_file(conf, f, &tmp_err);
-        if (s == NULL) {
+    if (sort) {
+        if (date == NULL) {
             *err = bc_error_new_printf(BLOGC_ERROR_LOADER,
-                "An error occurred while parsing source file: %s\n\n%s",
-                f, tmp_err->msg);
-            bc_error_free(tmp_err);
-            bc_slist_free_full(sources, (bc_free_func_t) bc_trie_free);
+                "'FILTER_SORT' requires that 'DATE' variable is set for "
+                "every source file: %s", f);
             return NULL;
         }
 
-        const char *date = bc_trie_lookup(s, "DATE");
-        if (date != NULL) {
-            with_date++;
+        bc_error_t *tmp_err = NULL;
+        char *ts = blogc_convert_datetime(date, "%s", &tmp_err);
+        if (ts == NULL) {
+            *err = bc_error_new_printf(BLOGC_ERROR_LOADER,
+                "An error occurred while parsing 'DATE' variable: %s"
+                "\n\n%s", f, tmp_err->msg);
+            bc_error_free(tmp_err);
+            return NULL;
         }
+        timestamp = strtoul(ts, NULL, 10);
+        free(ts);
+    }
 
-        if (sort) {
-            if (date == NULL) {
-                *err = bc_error_new_printf(BLOGC_ERROR_LOADER,
-                    "'FILTER_SORT' requires that 'DATE' variable is set for "
-                    "every source file: %s", f);
-                bc_trie_free(s);
-                bc_slist_free_full(sources, (bc_free_func_t) bc_trie_free);
-                return NULL;
-            }
-
-            char *timestamp = blogc_convert_datetime(date, "%s", &tmp_err);
-            if (timestamp == NULL) {
-                *err = bc_error_new_printf(BLOGC_ERROR_LOADER,
-                    "An error occurred while parsing 'DATE' variable: %s"
-                    "\n\n%s", f, tmp_err->msg);
-                bc_error_free(tmp_err);
-                bc_trie_free(s);
-                bc_slist_free_full(sources, (bc_free_func_t) bc_trie_free);
-                return NULL;
-            }
+    blogc_source_item_t *rv = bc_malloc(sizeof(blogc_source_item_t));
+    rv->source = s;
+    rv->timestamp = timestamp;
+    return rv;
+}
 
-            bc_trie_insert(s, "c", timestamp);
-        }
 
-        sources = bc_slist_append(sources, s);
+static void
+source_items_free(bc_slist_t *items, bc_free_func_t free_func)
+{
+    for (bc_slist_t *tmp = items; tmp != NULL; tmp = tmp->next) {
+        blogc_source_item_t *item = tmp->data;
+        if (free_func != NULL)
+            free_func(item->source);
     }
+    bc_slist_free_full(items, free);
+}
 
-    if (with_date > 0 && with_date < bc_slist_length(l)) {
+
+// sorts, filters and paginates the items (that are consumed). sources not
+// selected are released with free_func, that may be NULL when the caller
+// still owns them.
+static bc_slist_t*
+source_filter(bc_trie_t *conf, bc_slist_t *items, size_t with_date,
+    bc_free_func_t free_func, bc_error_t **err)
+{
+    if (with_date > 0 && with_date < bc_slist_length(items)) {
         *err = bc_error_new_printf(BLOGC_ERROR_LOADER,
             "'DATE' variable provided for at least one source file, but not "
             "for all source files. It must be provided for all files.");
-        bc_slist_free_full(sources, (bc_free_func_t) bc_trie_free);
+        source_items_free(items, free_func);
         return NULL;
     }
 
+    bool sort = bc_str_to_bool(bc_trie_lookup(conf, "FILTER_SORT"));
     bool reverse = bc_str_to_bool(bc_trie_lookup(conf, "FILTER_REVERSE"));
 
     if (sort) {
-        sources = bc_slist_sort(sources,
+        items = bc_slist_sort(items,
             (bc_sort_func_t) (reverse ? sort_source_reverse : sort_source));
     }
     else if (reverse) {
-        bc_slist_t *tmp_sources = NULL;
-        for (bc_slist_t *tmp = sources; tmp != NULL; tmp = tmp->next) {
-            tmp_sources = bc_slist_prepend(tmp_sources, tmp->data);
+        bc_slist_t *tmp_items = NULL;
+        for (bc_slist_t *tmp = items; tmp != NULL; tmp = tmp->next) {
+            tmp_items = bc_slist_prepend(tmp_items, tmp->data);
         }
-        bc_slist_t *tmp = sources;
-        sources = tmp_sources;
+        bc_slist_t *tmp = items;
+        items = tmp_items;
         bc_slist_free(tmp);
     }
 
@@ -243,13 +344,14 @@ blogc_source_parse_from_files(bc_trie_t *conf, bc_slist_t *l, bc_error_t **err)
     size_t counter = 0;
 
     bc_slist_t *rv = NULL;
-    for (bc_slist_t *tmp = sources; tmp != NULL; tmp = tmp->next) {
-        bc_trie_t *s = tmp->data;
+    for (bc_slist_t *tmp = items; tmp != NULL; tmp = tmp->next) {
+        bc_trie_t *s = ((blogc_source_item_t*) tmp->data)->source;
         if (filter_tag != NULL) {
             const char *tags_str = bc_trie_lookup(s, "TAGS");
             // if user wants to filter by tag and no tag is provided, skip it
             if (tags_str == NULL) {
-                bc_trie_free(s);
+                if (free_func != NULL)
+                    free_func(s);
                 continue;
             }
             char **tags = bc_str_split(tags_str, ' ', 0);
@@ -262,14 +364,16 @@ blogc_source_parse_from_files(bc_trie_t *conf, bc_slist_t *l, bc_error_t **err)
             }
             bc_strv_free(tags);
             if (!found) {
-                bc_trie_free(s);
+                if (free_func != NULL)
+                    free_func(s);
                 continue;
             }
         }
         if (filter_page != NULL) {
             if (counter < start || counter >= end) {
                 counter++;
-                bc_trie_free(s);
+                if (free_func != NULL)
+                    free_func(s);
                 continue;
             }
             counter++;
@@ -277,7 +381,7 @@ blogc_source_parse_from_files(bc_trie_t *conf, bc_slist_t *l, bc_error_t **err)
         rv = bc_slist_append(rv, s);
     }
 
-    bc_slist_free(sources);
+    bc_slist_free_full(items, free);
 
     bool first = true;
     for (bc_slist_t *tmp = rv; tmp != NULL; tmp = tmp->next) {
@@ -316,3 +420,72 @@ blogc_source_parse_from_files(bc_trie_t *conf, bc_slist_t *l, bc_error_t **err)
 
     return rv;
 }
+
+
+bc_slist_t*
+blogc_source_parse_from_files(bc_trie_t *conf, bc_slist_t *l, bc_error_t **err)
+{
+    if (err == NULL || *err != NULL)
+        return NULL;
+
+    bool sort = bc_str_to_bool(bc_trie_lookup(conf, "FILTER_SORT"));
+
+    bc_slist_t* items = NULL;
+    bc_error_t *tmp_err = NULL;
+    size_t with_date = 0;
+    for (bc_slist_t *tmp = l; tmp != NULL; tmp = tmp->next) {
+        char *f = tmp->data;
+        bc_trie_t *s = blogc_source_parse_from_file(conf, f, &tmp_err);
+        if (s == NULL) {
+            *err = bc_error_new_printf(BLOGC_ERROR_LOADER,
+                "An error occurred while parsing source file: %s\n\n%s",
+                f, tmp_err->msg);
+            bc_error_free(tmp_err);
+            source_items_free(items, (bc_free_func_t) bc_trie_free);
+            return NULL;
+        }
+
+        blogc_source_item_t *item = source_item_new(s, f, sort, &with_date,
+            err);
+        if (item == NULL) {
+            bc_trie_free(s);
+            source_items_free(items, (bc_free_func_t) bc_trie_free);
+            return NULL;
+        }
+
+        items = bc_slist_append(items, item);
+    }
+
+    return source_filter(conf, items, with_date,
+        (bc_free_func_t) bc_trie_free, err);
+}
+
+
+bc_slist_t*
+blogc_source_filter(bc_trie_t *conf, bc_slist_t *sources, bc_slist_t *filenames,
+    bc_error_t **err)
+{
+    if (err == NULL || *err != NULL)
+        return NULL;
+
+    bool sort = bc_str_to_bool(bc_trie_lookup(conf, "FILTER_SORT"));
+
+    bc_slist_t* items = NULL;
+    size_t with_date = 0;
+    bc_slist_t *f = filenames;
+    for (bc_slist_t *tmp = sources; tmp != NULL; tmp = tmp->next) {
+        const char *filename = f != NULL ? f->data :
+            bc_trie_lookup(tmp->data, "FILENAME");
+        blogc_source_item_t *item = source_item_new(tmp->data, filename, sort,
+            &with_date, err);
+        if (item == NULL) {
+            source_items_free(items, NULL);
+            return NULL;
+        }
+        items = bc_slist_append(items, item);
+        if (f != NULL)
+            f = f->next;
+    }
+
+    return source_filter(conf, items, with_date, NULL, err);
+}
@@ -16,7 +16,11 @@ char* blogc_get_filename(const char *f);
 bc_slist_t* blogc_template_parse_from_file(const char *f, bc_error_t **err);
 bc_trie_t* blogc_source_parse_from_file(bc_trie_t *conf, const char *f,
     bc_error_t **err);
+bc_trie_t* blogc_source_parse_metadata_from_file(const char *f,
+    bc_error_t **err);
 bc_slist_t* blogc_source_parse_from_files(bc_trie_t *conf, bc_slist_t *l,
     bc_error_t **err);
+bc_slist_t* blogc_source_filter(bc_trie_t *conf, bc_slist_t *sources,
+    bc_slist_t *filenames, bc_error_t **err);
 
 #endif /* _LOADER_H */
@@ -32,8 +32,11 @@
 #include "filelist-parser.h"
 #include "template-parser.h"
 #include "loader.h"
+#include "minifier.h"
 #include "renderer.h"
+#include "template-cache.h"
 #include "../common/error.h"
+#include "../common/file.h"
 #include "../common/utf8.h"
 #include "../common/utils.h"
 #include "../common/stdin.h"
@@ -57,7 +60,7 @@ blogc_print_help(void)
         "[-m] "
 #endif
         "[-h] [-v] [-d] [-i] [-l [-e SOURCE]] [-D KEY=VALUE ...] [-p KEY]\n"
-        "          [-t TEMPLATE] [-o OUTPUT] [SOURCE ...] - A blog compiler.\n"
+        "          [-t TEMPLATE] [-o OUTPUT] [-M] [-b JOBFILE] [SOURCE ...] - A blog compiler.\n"
         "\n"
         "positional arguments:\n"
         "    SOURCE        source file(s)\n"
@@ -73,6 +76,8 @@ blogc_print_help(void)
         "    -p KEY        show the value of a variable after source parsing and exit\n"
         "    -t TEMPLATE   template file\n"
         "    -o OUTPUT     output file\n"
+        "    -M            minify output\n"
+        "    -b JOBFILE    run jobs from file ('-' for standard input), one per line\n"
 #ifdef MAKE_EMBEDDED
         "    -m            call and pass arguments to embedded blogc-make\n"
 #endif
@@ -89,7 +94,7 @@ blogc_print_usage(void)
         "[-m] "
 #endif
         "[-h] [-v] [-d] [-i] [-l [-e SOURCE]] [-D KEY=VALUE ...] [-p KEY]\n"
-        "             [-t TEMPLATE] [-o OUTPUT] [SOURCE ...]\n");
+        "             [-t TEMPLATE] [-o OUTPUT] [-M] [-b JOBFILE] [SOURCE ...]\n");
 }
 
 
@@ -128,6 +133,406 @@ blogc_mkdir_recursive(const char *filename)
 }
 
 
+static bool
+blogc_set_variable(bc_trie_t *config, const char *tmp)
+{
+    if (!bc_utf8_validate((uint8_t*) tmp, strlen(tmp))) {
+        fprintf(stderr, "blogc: error: invalid value for "
+            "-D (must be valid UTF-8 string): %s\n", tmp);
+        return false;
+    }
+    char **pieces = bc_str_split(tmp, '=', 2);
+    if (bc_strv_length(pieces) != 2) {
+        fprintf(stderr, "blogc: error: invalid value for "
+            "-D (must have an '='): %s\n", tmp);
+        bc_strv_free(pieces);
+        return false;
+    }
+    for (size_t j = 0; pieces[0][j] != '\0'; j++) {
+        char c = pieces[0][j];
+        if (j == 0) {
+            if (!(c >= 'A' && c <= 'Z')) {
+                fprintf(stderr, "blogc: error: invalid value "
+                    "for -D (first character in configuration "
+                    "key must be uppercase): %s\n", pieces[0]);
+                bc_strv_free(pieces);
+                return false;
+            }
+            continue;
+        }
+        if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_')) {
+            fprintf(stderr, "blogc: error: invalid value "
+                "for -D (configuration key must be uppercase "
+                "with '_' and digits after first character): %s\n",
+                pieces[0]);
+            bc_strv_free(pieces);
+            return false;
+        }
+    }
+    bc_trie_insert(config, pieces[0], bc_strdup(pieces[1]));
+    bc_strv_free(pieces);
+    return true;
+}
+
+
+static int
+blogc_write_output(bc_slist_t *tmpl, bc_slist_t *sources,
+    bc_slist_t *listing_entries, bc_trie_t *config, bool listing,
+    const char *output, bool minify)
+{
+    char *out = blogc_render(tmpl, sources, listing_entries, config, listing);
+
+    if (minify) {
+        char *tmp = out;
+        out = blogc_minify(tmp);
+        free(tmp);
+    }
+
+    if (output == NULL || (0 == strcmp(output, "-"))) {
+        if (out != NULL)
+            fprintf(stdout, "%s", out);
+        free(out);
+        return 0;
+    }
+
+    // outputs with the same content are not rewritten, to keep their mtimes.
+    blogc_mkdir_recursive(output);
+    bc_error_t *err = NULL;
+    bc_file_write_if_changed(output, out, out != NULL ? strlen(out) : 0, &err);
+    free(out);
+    if (err != NULL) {
+        bc_error_print(err, "blogc");
+        bc_error_free(err);
+        return 1;
+    }
+    return 0;
+}
+
+
+// batch mode: runs several jobs in the same process, parsing each template
+// and source file only once.
+
+typedef struct {
+    blogc_template_cache_t *templates;
+    bc_trie_t *sources;
+    bool debug;
+} blogc_batch_t;
+
+
+// splits the next job of a job file into arguments, and advances the given
+// pointer past it. jobs are separated by newlines and arguments by
+// whitespace. quotes, backslash escapes and comments work as in a shell, so
+// that arguments quoted for the shell can be used, even if they contain
+// newlines. lines ending with a backslash are continued in the next line.
+// returns an empty list for empty jobs.
+static char**
+blogc_batch_split(char **str, size_t *lineno, bc_error_t **err)
+{
+    bc_slist_t *args = NULL;
+    bc_string_t *arg = NULL;
+    char quote = '\0';
+    char *job = *str;
+
+    char *c = *str;
+    for (; *c != '\0'; c++) {
+        if (*c == '\n') {
+            (*lineno)++;
+            if (quote == '\0') {
+                c++;
+                break;
+            }
+        }
+        if (quote == '\0' && (*c == ' ' || *c == '\t' || *c == '\r')) {
+            if (arg != NULL)
+                args = bc_slist_append(args, bc_string_free(arg, false));
+            arg = NULL;
+            continue;
+        }
+        if (quote == '\0' && arg == NULL && args == NULL && *c == '#') {
+            while (*(c + 1) != '\0' && *(c + 1) != '\n')
+                c++;
+            continue;
+        }
+        if (quote != '\'' && *c == '\\' && *(c + 1) == '\n') {
+            (*lineno)++;
+            c++;
+            continue;
+        }
+
+        // inside double quotes, backslashes escape only the characters that
+        // are special there.
+        if (*c == '\\' && *(c + 1) != '\0' && (quote == '\0' ||
+            (quote == '"' && NULL != strchr("\"\\$`", *(c + 1)))))
+        {
+            if (arg == NULL)
+                arg = bc_string_new();
+            bc_string_append_c(arg, *(++c));
+            continue;
+        }
+        if (arg == NULL)
+            arg = bc_string_new();
+        if (quote == '\0' && (*c == '\'' || *c == '"')) {
+            quote = *c;
+            continue;
+        }
+        if (quote != '\0' && *c == quote) {
+            quote = '\0';
+            continue;
+        }
+        bc_string_append_c(arg, *c);
+    }
+    *str = c;
+
+    if (arg != NULL)
+        args = bc_slist_append(args, bc_string_free(arg, false));
+
+    if (quote != '\0') {
+        *err = bc_error_new_printf(BLOGC_ERROR_LOADER,
+            "Unterminated quote in job: %s", bc_str_strip(job));
+        bc_slist_free_full(args, free);
+        return NULL;
+    }
+
+    char **rv = bc_malloc(sizeof(char*) * (bc_slist_length(args) + 1));
+    size_t i = 0;
+    for (bc_slist_t *tmp = args; tmp != NULL; tmp = tmp->next)
+        rv[i++] = tmp->data;
+    rv[i] = NULL;
+    bc_slist_free(args);
+    return rv;
+}
+
+
+static bc_slist_t*
+blogc_batch_get_template(blogc_batch_t *b, const char *f, bc_error_t **err)
+{
+    bc_slist_t *rv = blogc_template_cache_get(b->templates, f, err);
+    if (rv != NULL && b->debug)
+        blogc_debug_template(rv);
+    return rv;
+}
+
+
+static bc_trie_t*
+blogc_batch_get_source(blogc_batch_t *b, bc_trie_t *config, const char *f,
+    bc_error_t **err)
+{
+    // the source parser depends on TOCTREE_MAXDEPTH, that may differ between
+    // jobs.
+    const char *maxdepth = bc_trie_lookup(config, "TOCTREE_MAXDEPTH");
+    char *key = bc_strdup_printf("%s:%s", maxdepth != NULL ? maxdepth : "", f);
+
+    bc_trie_t *rv = bc_trie_lookup(b->sources, key);
+    if (rv == NULL) {
+        bc_error_t *tmp_err = NULL;
+        rv = blogc_source_parse_from_file(config, f, &tmp_err);
+        if (rv == NULL) {
+            *err = bc_error_new_printf(BLOGC_ERROR_LOADER,
+                "An error occurred while parsing source file: %s\n\n%s",
+                f, tmp_err->msg);
+            bc_error_free(tmp_err);
+            free(key);
+            return NULL;
+        }
+        bc_trie_insert(b->sources, key, rv);
+    }
+
+    free(key);
+    return rv;
+}
+
+
+static void
+blogc_batch_copy_config(const char *key, void *data, void *user_data)
+{
+    bc_trie_insert(user_data, key, bc_strdup(data));
+}
+
+
+static int
+blogc_batch_run_job(blogc_batch_t *b, bc_trie_t *global, char **args)
+{
+    int rv = 0;
+    bool listing = false;
+    bool minify = false;
+    const char *template = NULL;
+    const char *output = NULL;
+    bc_slist_t *sources = NULL;
+    bc_slist_t *listing_entries = NULL;
+    bc_slist_t *parsed = NULL;
+    bc_slist_t *s = NULL;
+    bc_slist_t *listing_entries_source = NULL;
+    bc_error_t *err = NULL;
+
+    bc_trie_t *config = bc_trie_new(free);
+    bc_trie_foreach(global, blogc_batch_copy_config, config);
+
+    for (size_t i = 0; args[i] != NULL; i++) {
+        const char *tmp = NULL;
+        if (args[i][0] == '-') {
+            switch (args[i][1]) {
+                case 'l':
+                    listing = true;
+                    break;
+                case 'e':
+                    if (args[i][2] != '\0')
+                        listing_entries = bc_slist_append(listing_entries, args[i] + 2);
+                    else if (args[i + 1] != NULL)
+                        listing_entries = bc_slist_append(listing_entries, args[++i]);
+                    break;
+                case 't':
+                    if (args[i][2] != '\0')
+                        template = args[i] + 2;
+                    else if (args[i + 1] != NULL)
+                        template = args[++i];
+                    break;
+                case 'o':
+                    if (args[i][2] != '\0')
+                        output = args[i] + 2;
+                    else if (args[i + 1] != NULL)
+                        output = args[++i];
+                    break;
+                case 'M':
+                    minify = true;
+                    break;
+                case 'D':
+                    if (args[i][2] != '\0')
+                        tmp = args[i] + 2;
+                    else if (args[i + 1] != NULL)
+                        tmp = args[++i];
+                    if (tmp != NULL && !blogc_set_variable(config, tmp)) {
+                        rv = 1;
+                        goto cleanup;
+                    }
+                    break;
+                default:
+                    fprintf(stderr, "blogc: error: invalid argument for "
+                        "job: -%c\n", args[i][1]);
+                    rv = 1;
+                    goto cleanup;
+            }
+        }
+        else {
+            sources = bc_slist_append(sources, args[i]);
+        }
+    }
+
+    if (!listing && bc_slist_length(sources) != 1) {
+        fprintf(stderr, "blogc: error: exactly one source file should be "
+            "provided, if running without '-l'\n");
+        rv = 1;
+        goto cleanup;
+    }
+
+    if (template == NULL) {
+        fprintf(stderr, "blogc: error: argument -t is required when "
+            "rendering content\n");
+        rv = 1;
+        goto cleanup;
+    }
+
+    for (bc_slist_t *tmp = sources; tmp != NULL; tmp = tmp->next) {
+        bc_trie_t *src = blogc_batch_get_source(b, config, tmp->data, &err);
+        if (src == NULL)
+            goto cleanup;
+        parsed = bc_slist_append(parsed, src);
+    }
+
+    s = blogc_source_filter(config, parsed, sources, &err);
+    if (err != NULL)
+        goto cleanup;
+
+    if (listing) {
+        for (bc_slist_t *tmp = listing_entries; tmp != NULL; tmp = tmp->next) {
+            if (0 == strlen(tmp->data)) {
+                listing_entries_source = bc_slist_append(listing_entries_source, NULL);
+                continue;
+            }
+            bc_trie_t *e = blogc_batch_get_source(b, config, tmp->data, &err);
+            if (e == NULL)
+                goto cleanup;
+            listing_entries_source = bc_slist_append(listing_entries_source, e);
+        }
+    }
+
+    bc_slist_t *l = blogc_batch_get_template(b, template, &err);
+    if (l == NULL)
+        goto cleanup;
+
+    rv = blogc_write_output(l, s, listing_entries_source, config, listing,
+        output, minify);
+
+cleanup:
+    if (err != NULL) {
+        bc_error_print(err, "blogc");
+        bc_error_free(err);
+        rv = 1;
+    }
+    bc_slist_free(listing_entries_source);
+    bc_slist_free(s);
+    bc_slist_free(parsed);
+    bc_slist_free(listing_entries);
+    bc_slist_free(sources);
+    bc_trie_free(config);
+    return rv;
+}
+
+
+static int
+blogc_batch_run(const char *jobfile, bc_trie_t *config, bool debug)
+{
+    size_t len;
+    char *content = NULL;
+    if (0 == strcmp(jobfile, "-")) {
+        content = bc_stdin_read(&len);
+    }
+    else {
+        bc_error_t *err = NULL;
+        content = bc_file_get_contents(jobfile, true, &len, &err);
+        if (err != NULL) {
+            bc_error_print(err, "blogc");
+            bc_error_free(err);
+            return 1;
+        }
+    }
+
+    blogc_batch_t b = {
+        .templates = blogc_template_cache_new(),
+        .sources = bc_trie_new((bc_free_func_t) bc_trie_free),
+        .debug = debug,
+    };
+
+    int rv = 0;
+    size_t lineno = 1;
+    char *c = content;
+    while (c != NULL && *c != '\0') {
+        size_t job_lineno = lineno;
+        bc_error_t *err = NULL;
+        char **args = blogc_batch_split(&c, &lineno, &err);
+        if (err != NULL) {
+            bc_error_print(err, "blogc");
+            bc_error_free(err);
+            rv = 1;
+        }
+        else {
+            if (args[0] != NULL)
+                rv = blogc_batch_run_job(&b, config, args);
+            bc_strv_free(args);
+        }
+        if (rv != 0) {
+            fprintf(stderr, "blogc: error: job failed (%s:%zu)\n", jobfile,
+                job_lineno);
+            break;
+        }
+    }
+
+    blogc_template_cache_free(b.templates);
+    bc_trie_free(b.sources);
+    free(content);
+    return rv;
+}
+
+
 int
 main(int argc, char **argv)
 {
@@ -141,11 +546,12 @@ main(int argc, char **argv)
     bool debug = false;
     bool input_stdin = false;
     bool listing = false;
+    bool minify = false;
     char *template = NULL;
     char *output = NULL;
     char *print = NULL;
+    char *batch = NULL;
     char *tmp = NULL;
-    char **pieces = NULL;
 
     bc_slist_t *sources = NULL;
     bc_slist_t *listing_entries = NULL;
@@ -190,57 +596,29 @@ main(int argc, char **argv)
                     else if (i + 1 < argc)
                         output = bc_strdup(argv[++i]);
                     break;
+                case 'M':
+                    minify = true;
+                    break;
                 case 'p':
                     if (argv[i][2] != '\0')
                         print = bc_strdup(argv[i] + 2);
                     else if (i + 1 < argc)
                         print = bc_strdup(argv[++i]);
                     break;
+                case 'b':
+                    if (argv[i][2] != '\0')
+                        batch = bc_strdup(argv[i] + 2);
+                    else if (i + 1 < argc)
+                        batch = bc_strdup(argv[++i]);
+                    break;
                 case 'D':
                     if (argv[i][2] != '\0')
                         tmp = argv[i] + 2;
                     else if (i + 1 < argc)
                         tmp = argv[++i];
-                    if (tmp != NULL) {
-                        if (!bc_utf8_validate((uint8_t*) tmp, strlen(tmp))) {
-                            fprintf(stderr, "blogc: error: invalid value for "
-                                "-D (must be valid UTF-8 string): %s\n", tmp);
-                            goto cleanup;
-                        }
-                        pieces = bc_str_split(tmp, '=', 2);
-                        if (bc_strv_length(pieces) != 2) {
-                            fprintf(stderr, "blogc: error: invalid value for "
-                                "-D (must have an '='): %s\n", tmp);
-                            bc_strv_free(pieces);
-                            rv = 1;
-                            goto cleanup;
-                        }
-                        for (size_t j = 0; pieces[0][j] != '\0'; j++) {
-                            char c = pieces[0][j];
-                            if (j == 0) {
-                                if (!(c >= 'A' && c <= 'Z')) {
-                                    fprintf(stderr, "blogc: error: invalid value "
-                                        "for -D (first character in configuration "
-                                        "key must be uppercase): %s\n", pieces[0]);
-                                    bc_strv_free(pieces);
-                                    rv = 1;
-                                    goto cleanup;
-                                }
-                                continue;
-                            }
-                            if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_')) {
-                                fprintf(stderr, "blogc: error: invalid value "
-                                    "for -D (configuration key must be uppercase "
-                                    "with '_' and digits after first character): %s\n",
-                                    pieces[0]);
-                                bc_strv_free(pieces);
-                                rv = 1;
-                                goto cleanup;
-                            }
-                        }
-                        bc_trie_insert(config, pieces[0], bc_strdup(pieces[1]));
-                        bc_strv_free(pieces);
-                        pieces = NULL;
+                    if (tmp != NULL && !blogc_set_variable(config, tmp)) {
+                        rv = 1;
+                        goto cleanup;
                     }
                     break;
 #ifdef MAKE_EMBEDDED
@@ -269,6 +647,21 @@ main(int argc, char **argv)
 
     }
 
+    if (batch != NULL) {
+        if (input_stdin || listing || template != NULL || output != NULL ||
+            print != NULL || sources != NULL || listing_entries != NULL ||
+            minify)
+        {
+            blogc_print_usage();
+            fprintf(stderr, "blogc: error: only '-d' and '-D' can be used "
+                "together with '-b'\n");
+            rv = 1;
+            goto cleanup;
+        }
+        rv = blogc_batch_run(batch, config, debug);
+        goto cleanup;
+    }
+
     if (input_stdin) {
         size_t input_len;
         char *input = bc_stdin_read(&input_len);
@@ -352,30 +745,9 @@ main(int argc, char **argv)
     if (debug)
         blogc_debug_template(l);
 
-    char *out = blogc_render(l, s, listing_entries_source, config, listing);
+    rv = blogc_write_output(l, s, listing_entries_source, config, listing,
+        output, minify);
 
-    bool write_to_stdout = (output == NULL || (0 == strcmp(output, "-")));
-
-    FILE *fp = stdout;
-    if (!write_to_stdout) {
-        blogc_mkdir_recursive(output);
-        fp = fopen(output, "w");
-        if (fp == NULL) {
-            fprintf(stderr, "blogc: error: failed to open output file (%s): %s\n",
-                output, strerror(errno));
-            rv = 1;
-            goto cleanup4;
-        }
-    }
-
-    if (out != NULL)
-        fprintf(fp, "%s", out);
-
-    if (!write_to_stdout)
-        fclose(fp);
-
-cleanup4:
-    free(out);
 cleanup3:
     blogc_template_free_ast(l);
 cleanup2:
@@ -386,6 +758,7 @@ cleanup:
     free(template);
     free(output);
     free(print);
+    free(batch);
     bc_slist_free_full(listing_entries, free);
     bc_slist_free_full(listing_entries_source, (bc_free_func_t) bc_trie_free);
     bc_slist_free_full(sources, free);
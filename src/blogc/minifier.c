@@ -0,0 +1,300 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "../common/utils.h"
+#include "minifier.h"
+
+// the minifier is a state machine that walks the rendered output once.
+//
+// runs of whitespace outside of tags are collapsed to a single newline, if
+// they include one, or to a single space otherwise, so inline content
+// renders the same. comments are removed, but conditional comments. tags are
+// copied as is, as well as CDATA sections and the content of the elements
+// where whitespace matters or that aren't markup.
+
+typedef enum {
+    MINIFIER_TEXT = 1,
+    MINIFIER_TAG,
+    MINIFIER_COMMENT_START,
+    MINIFIER_COMMENT,
+    MINIFIER_COMMENT_KEEP,
+    MINIFIER_CDATA,
+    MINIFIER_RAW,
+    MINIFIER_RAW_CLOSE,
+} minifier_state_t;
+
+typedef struct {
+    minifier_state_t state;
+    bc_string_t *tag;
+    char quote;
+    char space;
+    bool started;
+    const char *raw;
+    size_t match;
+} minifier_t;
+
+static const char* raw_elements[] = {
+    "code",
+    "pre",
+    "script",
+    "style",
+    "textarea",
+    NULL,
+};
+
+// comments starting with these (after "<!--") are conditional comments, that
+// change the rendered output, and are kept.
+static const char* conditional_comments[] = {
+    "[if",
+    "<![endif]",
+    NULL,
+};
+
+
+static void
+emit_space(minifier_t *minifier, bc_string_t *out)
+{
+    // leading whitespace is dropped.
+    if (minifier->space != 0 && minifier->started)
+        bc_string_append_c(out, minifier->space);
+    minifier->space = 0;
+    minifier->started = true;
+}
+
+
+static void
+emit_tag(minifier_t *minifier, bc_string_t *out)
+{
+    emit_space(minifier, out);
+    bc_string_append_len(out, minifier->tag->str, minifier->tag->len);
+}
+
+
+// returns the raw element opened by the tag, if any.
+static const char*
+raw_element(bc_string_t *tag)
+{
+    if (tag->len < 3 || tag->str[tag->len - 2] == '/')
+        return NULL;
+
+    size_t len;
+    for (len = 0; isalnum((unsigned char) tag->str[len + 1]); len++);
+
+    for (size_t i = 0; raw_elements[i] != NULL; i++) {
+        if (len == strlen(raw_elements[i]) &&
+            0 == strncasecmp(tag->str + 1, raw_elements[i], len))
+        {
+            return raw_elements[i];
+        }
+    }
+    return NULL;
+}
+
+
+static void
+feed_text(minifier_t *minifier, char c, bc_string_t *out)
+{
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        if (minifier->space != '\n')
+            minifier->space = c == '\n' ? '\n' : ' ';
+        return;
+    }
+
+    if (c == '<') {
+        // whitespace is only emitted when we know that the tag isn't a
+        // comment.
+        bc_string_free(minifier->tag, true);
+        minifier->tag = bc_string_append_c(bc_string_new(), c);
+        minifier->quote = 0;
+        minifier->state = MINIFIER_TAG;
+        return;
+    }
+
+    emit_space(minifier, out);
+    bc_string_append_c(out, c);
+}
+
+
+// returns true if the comment started in the tag buffer is a conditional
+// comment. sets *partial if it can't be known yet.
+static bool
+conditional_comment(bc_string_t *tag, bool *partial)
+{
+    const char *str = tag->str + 4;  // "<!--"
+    size_t len = tag->len - 4;
+    *partial = false;
+    for (size_t i = 0; conditional_comments[i] != NULL; i++) {
+        size_t l = strlen(conditional_comments[i]);
+        if (0 != strncmp(str, conditional_comments[i], len < l ? len : l))
+            continue;
+        if (len >= l)
+            return true;
+        *partial = true;
+    }
+    return false;
+}
+
+
+static void
+minifier_feed(minifier_t *minifier, const char *str, bc_string_t *out)
+{
+    for (const char *p = str; *p != '\0'; p++) {
+        char c = *p;
+
+        switch (minifier->state) {
+
+            case MINIFIER_TEXT:
+                feed_text(minifier, c, out);
+                break;
+
+            case MINIFIER_TAG:
+                if (minifier->tag->len == 1 && !isalpha((unsigned char) c) &&
+                    c != '/' && c != '!' && c != '?')
+                {
+                    // not a tag, just a '<' in the text.
+                    emit_tag(minifier, out);
+                    minifier->state = MINIFIER_TEXT;
+                    feed_text(minifier, c, out);
+                    break;
+                }
+                bc_string_append_c(minifier->tag, c);
+                if (0 == strcmp(minifier->tag->str, "<!--")) {
+                    minifier->match = 0;
+                    minifier->state = MINIFIER_COMMENT_START;
+                    break;
+                }
+                if (0 == strcmp(minifier->tag->str, "<![CDATA[")) {
+                    emit_tag(minifier, out);
+                    minifier->match = 0;
+                    minifier->state = MINIFIER_CDATA;
+                    break;
+                }
+                if (minifier->quote != 0) {
+                    if (c == minifier->quote)
+                        minifier->quote = 0;
+                    break;
+                }
+                if (c == '"' || c == '\'') {
+                    minifier->quote = c;
+                    break;
+                }
+                if (c == '>') {
+                    emit_tag(minifier, out);
+                    minifier->raw = raw_element(minifier->tag);
+                    minifier->match = 0;
+                    minifier->state = minifier->raw != NULL ?
+                        MINIFIER_RAW : MINIFIER_TEXT;
+                }
+                break;
+
+            case MINIFIER_COMMENT_START: {
+                // the start of the comment is kept in the tag buffer, until
+                // we know if it is a conditional comment.
+                bool partial;
+                bc_string_append_c(minifier->tag, c);
+                if (conditional_comment(minifier->tag, &partial)) {
+                    emit_tag(minifier, out);
+                    minifier->state = MINIFIER_COMMENT_KEEP;
+                    break;
+                }
+                if (partial)
+                    break;
+                minifier->state = MINIFIER_COMMENT;
+            }
+            // fallthrough
+
+            case MINIFIER_COMMENT:
+                if (c == '>' && minifier->match >= 2) {
+                    minifier->state = MINIFIER_TEXT;
+                    break;
+                }
+                minifier->match = c == '-' ? minifier->match + 1 : 0;
+                break;
+
+            case MINIFIER_COMMENT_KEEP:
+                bc_string_append_c(out, c);
+                if (c == '>' && minifier->match >= 2) {
+                    minifier->state = MINIFIER_TEXT;
+                    break;
+                }
+                minifier->match = c == '-' ? minifier->match + 1 : 0;
+                break;
+
+            case MINIFIER_CDATA:
+                bc_string_append_c(out, c);
+                if (c == '>' && minifier->match >= 2) {
+                    minifier->state = MINIFIER_TEXT;
+                    break;
+                }
+                minifier->match = c == ']' ? minifier->match + 1 : 0;
+                break;
+
+            case MINIFIER_RAW: {
+                // copied as is, until the closing tag of the element,
+                // "</name" followed by something that isn't part of a name.
+                bc_string_append_c(out, c);
+                size_t end = strlen(minifier->raw) + 2;
+                if (minifier->match == end) {
+                    if (!isalnum((unsigned char) c)) {
+                        minifier->state = c == '>' ? MINIFIER_TEXT :
+                            MINIFIER_RAW_CLOSE;
+                        break;
+                    }
+                    minifier->match = 0;
+                }
+                char e = minifier->match < 2 ? "</"[minifier->match] :
+                    minifier->raw[minifier->match - 2];
+                if (tolower((unsigned char) c) == e)
+                    minifier->match++;
+                else
+                    minifier->match = c == '<' ? 1 : 0;
+                break;
+            }
+
+            case MINIFIER_RAW_CLOSE:
+                bc_string_append_c(out, c);
+                if (c == '>')
+                    minifier->state = MINIFIER_TEXT;
+                break;
+        }
+    }
+}
+
+
+char*
+blogc_minify(const char *str)
+{
+    if (str == NULL)
+        return NULL;
+
+    minifier_t minifier = {
+        .state = MINIFIER_TEXT,
+        .tag = bc_string_new(),
+        .quote = 0,
+        .space = 0,
+        .started = false,
+        .raw = NULL,
+        .match = 0,
+    };
+    bc_string_t *rv = bc_string_new();
+    minifier_feed(&minifier, str, rv);
+
+    // an unterminated tag and the trailing whitespace are flushed.
+    if (minifier.state == MINIFIER_TAG)
+        emit_tag(&minifier, rv);
+    if (minifier.space != 0 && minifier.started)
+        bc_string_append_c(rv, minifier.space);
+
+    bc_string_free(minifier.tag, true);
+    return bc_string_free(rv, false);
+}
@@ -0,0 +1,14 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#ifndef _MINIFIER_H
+#define _MINIFIER_H
+
+char* blogc_minify(const char *str);
+
+#endif /* _MINIFIER_H */
@@ -6,6 +6,7 @@
  * See the file LICENSE.
  */
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -27,9 +28,9 @@ typedef enum {
 } blogc_source_parser_state_t;
 
 
-bc_trie_t*
-blogc_source_parse(const char *src, size_t src_len, int toctree_maxdepth,
-    bc_error_t **err)
+static bc_trie_t*
+source_parse(const char *src, size_t src_len, int toctree_maxdepth,
+    bool metadata_only, bc_error_t **err)
 {
     if (err == NULL || *err != NULL)
         return NULL;
@@ -45,7 +46,10 @@ blogc_source_parse(const char *src, size_t src_len, int toctree_maxdepth,
 
     blogc_source_parser_state_t state = SOURCE_START;
 
-    while (current < src_len) {
+    // when parsing only metadata, we stop right after the separator.
+    while (current < src_len &&
+        !(metadata_only && state == SOURCE_CONTENT_START))
+    {
         char c = src[current];
 
         switch (state) {
@@ -260,3 +264,18 @@ blogc_source_parse(const char *src, size_t src_len, int toctree_maxdepth,
 
     return rv;
 }
+
+
+bc_trie_t*
+blogc_source_parse(const char *src, size_t src_len, int toctree_maxdepth,
+    bc_error_t **err)
+{
+    return source_parse(src, src_len, toctree_maxdepth, false, err);
+}
+
+
+bc_trie_t*
+blogc_source_parse_metadata(const char *src, size_t src_len, bc_error_t **err)
+{
+    return source_parse(src, src_len, -1, true, err);
+}
@@ -15,5 +15,7 @@
 
 bc_trie_t* blogc_source_parse(const char *src, size_t src_len, int toctree_maxdepth,
     bc_error_t **err);
+bc_trie_t* blogc_source_parse_metadata(const char *src, size_t src_len,
+    bc_error_t **err);
 
 #endif /* _SOURCE_PARSER_H */
@@ -22,6 +22,10 @@
 #include <netdb.h>
 #endif
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
+
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,6 +35,14 @@
 #include "sysinfo.h"
 
 
+// blogc-make may render outputs from several threads, so the functions used
+// to evaluate these variables must be thread-safe.
+
+#if defined(HAVE_SYSINFO_HOSTNAME) && defined(HAVE_NETDB_H) && defined(HAVE_PTHREAD)
+static pthread_mutex_t mutex_hostent = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
 char*
 blogc_sysinfo_get_hostname(void)
 {
@@ -43,9 +55,19 @@ blogc_sysinfo_get_hostname(void)
         return NULL;
 
 #ifdef HAVE_NETDB_H
+    // gethostbyname() returns a static buffer.
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&mutex_hostent);
+#endif
+    char *rv = NULL;
     struct hostent *h = gethostbyname(buf);
     if (h != NULL && h->h_name != NULL)
-        return bc_strdup(h->h_name);
+        rv = bc_strdup(h->h_name);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&mutex_hostent);
+#endif
+    if (rv != NULL)
+        return rv;
 #endif
 
     // FIXME: return FQDN instead of local host name
@@ -93,12 +115,12 @@ blogc_sysinfo_get_datetime(void)
     if (-1 == time(&tmp))
         return NULL;
 
-    struct tm *t = gmtime(&tmp);
-    if (t == NULL)
+    struct tm t;
+    if (NULL == gmtime_r(&tmp, &t))
         return NULL;
 
     char buf[1024];
-    if (0 == strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", t))
+    if (0 == strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &t))
         return NULL;
 
     return bc_strdup(buf);
@@ -118,29 +140,38 @@ blogc_sysinfo_inject_datetime(bc_trie_t *global)
 
 
 // it is obviously impossible that the same process runs inside and outside
-// docker at the same time, then an unprotected global variable should be fine
-// here
-static bool inside_docker_evaluated = false;
+// docker at the same time, then the result is evaluated only once.
 static bool inside_docker = false;
 
-bool
-blogc_sysinfo_get_inside_docker(void)
+static void
+evaluate_inside_docker(void)
 {
-    if (inside_docker_evaluated)
-        return inside_docker;
-    inside_docker_evaluated = true;
-
     size_t len;
     bc_error_t *err = NULL;
     char *contents = bc_file_get_contents("/proc/1/cgroup", false, &len, &err);
     if (err != NULL) {
         bc_error_free(err);
-        inside_docker = false;
-        return inside_docker;
+        return;
     }
 
-    bool inside_docker = NULL != strstr(contents, "/docker/");
+    inside_docker = NULL != strstr(contents, "/docker/");
     free(contents);
+}
+
+
+bool
+blogc_sysinfo_get_inside_docker(void)
+{
+#ifdef HAVE_PTHREAD
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, evaluate_inside_docker);
+#else
+    static bool evaluated = false;
+    if (!evaluated) {
+        evaluated = true;
+        evaluate_inside_docker();
+    }
+#endif
     return inside_docker;
 }
 
@@ -0,0 +1,131 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif /* HAVE_SYS_STAT_H */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../common/error.h"
+#include "../common/file.h"
+#include "../common/utils.h"
+#include "loader.h"
+#include "template-parser.h"
+#include "template-cache.h"
+
+typedef struct {
+    bc_slist_t *ast;
+    time_t tv_sec;
+    long tv_nsec;
+    size_t size;
+} blogc_template_cache_entry_t;
+
+
+static void
+template_cache_entry_free(blogc_template_cache_entry_t *entry)
+{
+    if (entry == NULL)
+        return;
+    blogc_template_free_ast(entry->ast);
+    free(entry);
+}
+
+
+blogc_template_cache_t*
+blogc_template_cache_new(void)
+{
+    blogc_template_cache_t *rv = bc_malloc(sizeof(blogc_template_cache_t));
+    rv->entries = bc_trie_new((bc_free_func_t) template_cache_entry_free);
+    rv->stale = NULL;
+    return rv;
+}
+
+
+void
+blogc_template_cache_free(blogc_template_cache_t *cache)
+{
+    if (cache == NULL)
+        return;
+    bc_trie_free(cache->entries);
+    bc_slist_free_full(cache->stale, (bc_free_func_t) blogc_template_free_ast);
+    free(cache);
+}
+
+
+// returns the template AST for the given file, parsing it only if it was
+// never seen before or if its mtime/size changed. the AST is owned by the
+// cache and must not be modified or freed by the caller. it is valid at least
+// until the next call to blogc_template_cache_purge().
+//
+// this function is not thread-safe, callers must serialize calls.
+bc_slist_t*
+blogc_template_cache_get(blogc_template_cache_t *cache, const char *f,
+    bc_error_t **err)
+{
+    if (cache == NULL || f == NULL || err == NULL || *err != NULL)
+        return NULL;
+
+#ifdef HAVE_SYS_STAT_H
+    struct stat buf;
+    bool found = 0 == stat(f, &buf);
+
+    blogc_template_cache_entry_t *entry = bc_trie_lookup(cache->entries, f);
+    if (found && entry != NULL && entry->tv_sec == buf.st_mtim_tv_sec &&
+        entry->tv_nsec == buf.st_mtim_tv_nsec && entry->size == (size_t) buf.st_size)
+    {
+        return entry->ast;
+    }
+#endif /* HAVE_SYS_STAT_H */
+
+    bc_slist_t *rv = blogc_template_parse_from_file(f, err);
+    if (rv == NULL)
+        return NULL;
+
+#ifdef HAVE_SYS_STAT_H
+    if (found) {
+        if (entry == NULL) {
+            entry = bc_malloc(sizeof(blogc_template_cache_entry_t));
+            bc_trie_insert(cache->entries, f, entry);
+        }
+        else {
+            // previous callers may still be using the stale AST, keep it
+            // around.
+            cache->stale = bc_slist_append(cache->stale, entry->ast);
+        }
+        entry->ast = rv;
+        entry->tv_sec = buf.st_mtim_tv_sec;
+        entry->tv_nsec = buf.st_mtim_tv_nsec;
+        entry->size = buf.st_size;
+        return rv;
+    }
+#endif /* HAVE_SYS_STAT_H */
+
+    // can't validate the cached AST without the file metadata, then it is
+    // released with the stale ones.
+    cache->stale = bc_slist_append(cache->stale, rv);
+    return rv;
+}
+
+
+// releases the ASTs replaced since the last call. must not be called while
+// ASTs returned by blogc_template_cache_get() are still in use.
+void
+blogc_template_cache_purge(blogc_template_cache_t *cache)
+{
+    if (cache == NULL)
+        return;
+    bc_slist_free_full(cache->stale, (bc_free_func_t) blogc_template_free_ast);
+    cache->stale = NULL;
+}
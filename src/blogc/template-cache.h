@@ -0,0 +1,26 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#ifndef _TEMPLATE_CACHE_H
+#define _TEMPLATE_CACHE_H
+
+#include "../common/error.h"
+#include "../common/utils.h"
+
+typedef struct {
+    bc_trie_t *entries;
+    bc_slist_t *stale;
+} blogc_template_cache_t;
+
+blogc_template_cache_t* blogc_template_cache_new(void);
+void blogc_template_cache_free(blogc_template_cache_t *cache);
+bc_slist_t* blogc_template_cache_get(blogc_template_cache_t *cache,
+    const char *f, bc_error_t **err);
+void blogc_template_cache_purge(blogc_template_cache_t *cache);
+
+#endif /* _TEMPLATE_CACHE_H */
@@ -106,49 +106,66 @@ bc_error_parser(bc_error_type_t type, const char *src, size_t src_len,
 
 
 // error handling is centralized here for the sake of simplicity :/
-void
-bc_error_print(bc_error_t *err, const char *prefix)
+char*
+bc_error_to_string(bc_error_t *err, const char *prefix)
 {
     if (err == NULL)
-        return;
+        return NULL;
 
-    if (prefix != NULL)
-        fprintf(stderr, "%s: ", prefix);
+    const char *type = NULL;
 
     switch(err->type) {
         case BC_ERROR_CONFIG_PARSER:
-            fprintf(stderr, "error: config-parser: %s\n", err->msg);
+            type = "error: config-parser";
             break;
         case BC_ERROR_FILE:
-            fprintf(stderr, "error: file: %s\n", err->msg);
+            type = "error: file";
             break;
         case BLOGC_ERROR_SOURCE_PARSER:
-            fprintf(stderr, "error: source: %s\n", err->msg);
+            type = "error: source";
             break;
         case BLOGC_ERROR_TEMPLATE_PARSER:
-            fprintf(stderr, "error: template: %s\n", err->msg);
+            type = "error: template";
             break;
         case BLOGC_ERROR_LOADER:
-            fprintf(stderr, "error: loader: %s\n", err->msg);
+            type = "error: loader";
             break;
         case BLOGC_WARNING_DATETIME_PARSER:
-            fprintf(stderr, "warning: datetime: %s\n", err->msg);
+            type = "warning: datetime";
             break;
         case BLOGC_MAKE_ERROR_SETTINGS:
-            fprintf(stderr, "error: settings: %s\n", err->msg);
+            type = "error: settings";
             break;
         case BLOGC_MAKE_ERROR_EXEC:
-            fprintf(stderr, "error: exec: %s\n", err->msg);
+            type = "error: exec";
             break;
         case BLOGC_MAKE_ERROR_ATOM:
-            fprintf(stderr, "error: atom: %s\n", err->msg);
+            type = "error: atom";
             break;
         case BLOGC_MAKE_ERROR_UTILS:
-            fprintf(stderr, "error: utils: %s\n", err->msg);
+            type = "error: utils";
+            break;
+        case BLOGC_MAKE_ERROR_TRACE:
+            type = "error: trace";
             break;
         default:
-            fprintf(stderr, "error: %s\n", err->msg);
+            type = "error";
     }
+
+    if (prefix != NULL)
+        return bc_strdup_printf("%s: %s: %s", prefix, type, err->msg);
+    return bc_strdup_printf("%s: %s", type, err->msg);
+}
+
+
+void
+bc_error_print(bc_error_t *err, const char *prefix)
+{
+    char *str = bc_error_to_string(err, prefix);
+    if (str == NULL)
+        return;
+    fprintf(stderr, "%s\n", str);
+    free(str);
 }
 
 
@@ -29,6 +29,7 @@ typedef enum {
     BLOGC_MAKE_ERROR_EXEC,
     BLOGC_MAKE_ERROR_ATOM,
     BLOGC_MAKE_ERROR_UTILS,
+    BLOGC_MAKE_ERROR_TRACE,
 
 } bc_error_type_t;
 
@@ -41,6 +42,7 @@ bc_error_t* bc_error_new(bc_error_type_t type, const char *msg);
 bc_error_t* bc_error_new_printf(bc_error_type_t type, const char *format, ...);
 bc_error_t* bc_error_parser(bc_error_type_t type, const char *src,
     size_t src_len, size_t current, const char *format, ...);
+char* bc_error_to_string(bc_error_t *err, const char *prefix);
 void bc_error_print(bc_error_t *err, const char *prefix);
 void bc_error_free(bc_error_t *err);
 
@@ -6,10 +6,25 @@
  * See the file LICENSE.
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif /* HAVE_SYS_STAT_H */
+
+#if !defined(WIN32) && !defined(_WIN32)
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
 #include <errno.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "file.h"
 #include "error.h"
@@ -64,3 +79,207 @@ bc_file_get_contents(const char *path, bool utf8, size_t *len, bc_error_t **err)
 
     return bc_string_free(str, false);
 }
+
+
+uint64_t
+bc_file_get_hash(const char *path, bc_error_t **err)
+{
+    if (path == NULL || err == NULL || *err != NULL)
+        return 0;
+
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL) {
+        int tmp_errno = errno;
+        *err = bc_error_new_printf(BC_ERROR_FILE,
+            "Failed to open file (%s): %s", path, strerror(tmp_errno));
+        return 0;
+    }
+
+    uint64_t rv = BC_HASH_INIT;
+    char buffer[BC_FILE_CHUNK_SIZE];
+
+    while (!feof(fp)) {
+        size_t read_len = fread(buffer, sizeof(char), BC_FILE_CHUNK_SIZE, fp);
+        if (ferror(fp)) {
+            int tmp_errno = errno;
+            *err = bc_error_new_printf(BC_ERROR_FILE,
+                "Failed to read file (%s): %s", path, strerror(tmp_errno));
+            fclose(fp);
+            return 0;
+        }
+        rv = bc_hash_update(rv, buffer, read_len);
+    }
+    fclose(fp);
+
+    return rv;
+}
+
+
+static bool
+file_equals(const char *path, const char *content, size_t len)
+{
+#ifdef HAVE_SYS_STAT_H
+    struct stat buf;
+    if (0 != stat(path, &buf) || !S_ISREG(buf.st_mode) ||
+        (size_t) buf.st_size != len)
+        return false;
+#endif
+
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return false;
+
+    char buffer[BC_FILE_CHUNK_SIZE];
+    size_t offset = 0;
+    bool rv = true;
+
+    while (rv && !feof(fp)) {
+        size_t read_len = fread(buffer, sizeof(char), BC_FILE_CHUNK_SIZE, fp);
+        if (ferror(fp) || read_len > len - offset ||
+            0 != memcmp(buffer, content + offset, read_len))
+        {
+            rv = false;
+            break;
+        }
+        offset += read_len;
+    }
+    fclose(fp);
+
+    return rv && offset == len;
+}
+
+
+#if !defined(WIN32) && !defined(_WIN32)
+
+// creates a hidden temporary file, next to path, like mkstemp(3) does, but
+// with the permissions that open(2) would give to a new file (mkstemp(3)
+// creates files only readable by the owner, and the umask can't be read
+// without changing it, that isn't thread-safe). the name of the temporary
+// file is stored in tmp, that must be released by the caller.
+static int
+open_tmp(const char *path, char **tmp)
+{
+    static const char chars[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+    const char *base = strrchr(path, '/');
+    int dir_len = base == NULL ? 0 : base - path + 1;
+    base = base == NULL ? path : base + 1;
+
+    // the address of a local variable differs between threads.
+    uint64_t seed = ((uint64_t) time(NULL) << 32) ^ ((uint64_t) getpid() << 16) ^
+        (uintptr_t) &base;
+
+    for (size_t i = 0; i < 100; i++) {
+        uint64_t v = seed ^ ((uint64_t) i * 2654435761u);
+        char suffix[7];
+        for (size_t j = 0; j < 6; j++) {
+            suffix[j] = chars[v % (sizeof(chars) - 1)];
+            v /= sizeof(chars) - 1;
+        }
+        suffix[6] = '\0';
+
+        *tmp = bc_strdup_printf("%.*s.%s.%s", dir_len, path, base, suffix);
+        int fd = open(*tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (fd >= 0 || errno != EEXIST)
+            return fd;
+        free(*tmp);
+        *tmp = NULL;
+    }
+
+    errno = EEXIST;
+    return -1;
+}
+
+#endif
+
+
+// writes content to path, unless the file already has exactly the same
+// content, in which case it is left untouched, including its mtime. the
+// content is written to a hidden temporary file in the same directory, that
+// is renamed to path, so readers never see a truncated file, and concurrent
+// writers of the same file don't collide. returns true if the file was
+// written.
+bool
+bc_file_write_if_changed(const char *path, const char *content, size_t len,
+    bc_error_t **err)
+{
+    if (path == NULL || err == NULL || *err != NULL)
+        return false;
+
+    if (content == NULL)
+        content = "";
+
+    if (file_equals(path, content, len))
+        return false;
+
+#if defined(WIN32) || defined(_WIN32)
+    // rename() won't replace existing files on windows.
+    char *tmp = bc_strdup(path);
+
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL) {
+        int tmp_errno = errno;
+        *err = bc_error_new_printf(BC_ERROR_FILE,
+            "Failed to open file (%s): %s", tmp, strerror(tmp_errno));
+        free(tmp);
+        return false;
+    }
+
+    bool ok = len == fwrite(content, sizeof(char), len, fp);
+    int tmp_errno = errno;
+    if (0 != fclose(fp) && ok) {
+        ok = false;
+        tmp_errno = errno;
+    }
+#else
+    char *tmp = NULL;
+    int fd = open_tmp(path, &tmp);
+    if (fd < 0) {
+        int tmp_errno = errno;
+        *err = bc_error_new_printf(BC_ERROR_FILE,
+            "Failed to open temporary file for (%s): %s", path,
+            strerror(tmp_errno));
+        free(tmp);
+        return false;
+    }
+
+#ifdef HAVE_SYS_STAT_H
+    // keep the permissions of the file being replaced.
+    struct stat buf;
+    if (0 == stat(path, &buf))
+        fchmod(fd, buf.st_mode & 07777);
+#endif
+
+    bool ok = true;
+    int tmp_errno = 0;
+    for (size_t offset = 0; offset < len;) {
+        ssize_t s = write(fd, content + offset, len - offset);
+        if (s < 0 && errno == EINTR)
+            continue;
+        if (s < 0) {
+            ok = false;
+            tmp_errno = errno;
+            break;
+        }
+        offset += s;
+    }
+    if (0 != close(fd) && ok) {
+        ok = false;
+        tmp_errno = errno;
+    }
+    if (ok && 0 != rename(tmp, path)) {
+        ok = false;
+        tmp_errno = errno;
+    }
+    if (!ok)
+        unlink(tmp);
+#endif
+
+    if (!ok)
+        *err = bc_error_new_printf(BC_ERROR_FILE,
+            "Failed to write file (%s): %s", path, strerror(tmp_errno));
+
+    free(tmp);
+    return ok;
+}
@@ -11,10 +11,32 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "error.h"
 
 #define BC_FILE_CHUNK_SIZE 1024
 
+// portable names for the mtime fields of struct stat.
+#ifdef __APPLE__
+#define st_mtim_tv_sec st_mtimespec.tv_sec
+#define st_mtim_tv_nsec st_mtimespec.tv_nsec
+#endif
+
+#ifdef __ANDROID__
+#define st_mtim_tv_sec st_mtime
+#define st_mtim_tv_nsec st_mtime_nsec
+#endif
+
+#ifndef st_mtim_tv_sec
+#define st_mtim_tv_sec st_mtim.tv_sec
+#endif
+#ifndef st_mtim_tv_nsec
+#define st_mtim_tv_nsec st_mtim.tv_nsec
+#endif
+
 char* bc_file_get_contents(const char *path, bool utf8, size_t *len, bc_error_t **err);
+uint64_t bc_file_get_hash(const char *path, bc_error_t **err);
+bool bc_file_write_if_changed(const char *path, const char *content, size_t len,
+    bc_error_t **err);
 
 #endif /* _FILE_H */
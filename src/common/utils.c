@@ -721,3 +721,24 @@ bc_shell_quote(const char *command)
     bc_string_append_c(rv, '\'');
     return bc_string_free(rv, false);
 }
+
+
+uint64_t
+bc_hash_update(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *tmp = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= tmp[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+
+uint64_t
+bc_hash_str(const char *str)
+{
+    if (str == NULL)
+        return BC_HASH_INIT;
+    return bc_hash_update(BC_HASH_INIT, str, strlen(str));
+}
@@ -12,6 +12,7 @@
 #include <stddef.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 
 // memory
@@ -107,4 +108,12 @@ void bc_trie_foreach(bc_trie_t *trie, bc_trie_foreach_func_t func,
 
 char* bc_shell_quote(const char *command);
 
+
+// hash (64-bit FNV-1a, not suitable for cryptographic purposes)
+
+#define BC_HASH_INIT 0xcbf29ce484222325ULL
+
+uint64_t bc_hash_update(uint64_t hash, const void *data, size_t len);
+uint64_t bc_hash_str(const char *str);
+
 #endif /* _UTILS_H */
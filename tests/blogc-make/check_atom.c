@@ -14,6 +14,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../../src/blogc/renderer.h"
+#include "../../src/blogc/template-parser.h"
 #include "../../src/blogc-make/atom.h"
 #include "../../src/blogc-make/settings.h"
 #include "../../src/common/file.h"
@@ -533,6 +535,71 @@ test_atom_legacy_entry_id(void **state)
 }
 
 
+static void
+test_atom_parse(void **state)
+{
+    bm_settings_t *settings = bc_malloc(sizeof(bm_settings_t));
+    settings->settings = bc_trie_new(free);
+    bc_trie_insert(settings->settings, "atom_prefix", bc_strdup("atom"));
+    bc_trie_insert(settings->settings, "atom_ext", bc_strdup(".xml"));
+    bc_trie_insert(settings->settings, "post_prefix", bc_strdup("post"));
+    bc_trie_insert(settings->settings, "html_ext", bc_strdup(".html"));
+
+    bc_error_t *err = NULL;
+    uint64_t hash = 0;
+    bc_slist_t *rv = bm_atom_parse(settings, &hash, &err);
+
+    assert_null(err);
+    assert_non_null(rv);
+
+    char *content = bm_atom_generate(settings);
+    assert_int_equal(hash, bc_hash_str(content));
+    free(content);
+
+    bc_trie_t *c = bc_trie_new(free);
+    bc_trie_insert(c, "SITE_TITLE", bc_strdup("Bola"));
+    char *out = blogc_render(rv, NULL, NULL, c, true);
+    assert_non_null(out);
+    assert_non_null(strstr(out, "<title type=\"text\">Bola</title>\n"));
+    assert_non_null(strstr(out, "<id>/atom.xml</id>\n"));
+    free(out);
+    bc_trie_free(c);
+
+    blogc_template_free_ast(rv);
+    bc_trie_free(settings->settings);
+    free(settings);
+}
+
+
+static void
+test_atom_parse_legacy_entry_id(void **state)
+{
+    bm_settings_t *settings = bc_malloc(sizeof(bm_settings_t));
+    settings->settings = bc_trie_new(free);
+    bc_trie_insert(settings->settings, "atom_prefix", bc_strdup("atom"));
+    bc_trie_insert(settings->settings, "atom_ext", bc_strdup(".xml"));
+    bc_trie_insert(settings->settings, "post_prefix", bc_strdup("post"));
+    bc_trie_insert(settings->settings, "html_ext", bc_strdup(".html"));
+    bc_trie_insert(settings->settings, "atom_legacy_entry_id", bc_strdup("1"));
+
+    bc_error_t *err = NULL;
+    uint64_t hash = 0;
+    bc_slist_t *rv = bm_atom_parse(settings, &hash, &err);
+
+    assert_null(rv);
+    assert_non_null(err);
+
+    assert_int_equal(err->type, BLOGC_MAKE_ERROR_ATOM);
+    assert_string_equal(err->msg,
+        "'atom_legacy_entry_id' setting is not supported anymore. see "
+        "https://blogc.rgm.io/news/blogc-0.16.1/ for details");
+
+    bc_error_free(err);
+    bc_trie_free(settings->settings);
+    free(settings);
+}
+
+
 int
 main(void)
 {
@@ -547,6 +614,8 @@ main(void)
         cmocka_unit_test(test_atom_dir),
         cmocka_unit_test(test_atom_legacy_entry_id_empty),
         cmocka_unit_test(test_atom_legacy_entry_id),
+        cmocka_unit_test(test_atom_parse),
+        cmocka_unit_test(test_atom_parse_legacy_entry_id),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -49,13 +49,13 @@ test_find_binary(void **state)
     will_return(__wrap_access, "../blogc");
     will_return(__wrap_access, 0);
     bin = bm_exec_find_binary("../blogc-make", "blogc", "BLOGC");
-    assert_string_equal(bin, "'../blogc'");
+    assert_string_equal(bin, "../blogc");
     free(bin);
 
     will_return(__wrap_access, "/usr/bin/blogc");
     will_return(__wrap_access, 0);
     bin = bm_exec_find_binary("/usr/bin/blogc-make", "blogc", "BLOGC");
-    assert_string_equal(bin, "'/usr/bin/blogc'");
+    assert_string_equal(bin, "/usr/bin/blogc");
     free(bin);
 
     will_return(__wrap_access, "../blogc");
@@ -66,7 +66,7 @@ test_find_binary(void **state)
 
     setenv("BLOGC", "/path/to/blogc", 1);
     bin = bm_exec_find_binary(NULL, "blogc", "BLOGC");
-    assert_string_equal(bin, "'/path/to/blogc'");
+    assert_string_equal(bin, "/path/to/blogc");
     free(bin);
     unsetenv("BLOGC");
 }
@@ -88,27 +88,27 @@ test_build_blogc_cmd_with_settings(void **state)
     settings->tags = NULL;
 
     char *rv = bm_exec_build_blogc_cmd("blogc", settings, variables, local, NULL,
-        true, NULL, "main.tmpl", "foo.html", false, true);
+        true, NULL, "main.tmpl", "foo.html", false, false, true);
     assert_string_equal(rv,
         "LC_ALL='en_US.utf8' blogc -D FOO='BAR' -D BAR='BAZ' -D LOL='HEHE' "
         "-D ASD='QWE' -l -t 'main.tmpl' -o 'foo.html' -i");
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", settings, variables, local, NULL, true,
-        "foo.txt", "main.tmpl", "foo.html", false, true);
+        "foo.txt", "main.tmpl", "foo.html", false, true, true);
     assert_string_equal(rv,
         "LC_ALL='en_US.utf8' blogc -D FOO='BAR' -D BAR='BAZ' -D LOL='HEHE' "
-        "-D ASD='QWE' -l -e 'foo.txt' -t 'main.tmpl' -o 'foo.html' -i");
+        "-D ASD='QWE' -l -e 'foo.txt' -t 'main.tmpl' -o 'foo.html' -M -i");
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", settings, variables, NULL, NULL, false,
-        NULL, NULL, NULL, false, false);
+        NULL, NULL, NULL, false, false, false);
     assert_string_equal(rv,
         "LC_ALL='en_US.utf8' blogc -D FOO='BAR' -D BAR='BAZ' -D LOL='HEHE'");
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", settings, NULL, NULL, NULL, false,
-        NULL, NULL, NULL, false, false);
+        NULL, NULL, NULL, false, false, false);
     assert_string_equal(rv,
         "LC_ALL='en_US.utf8' blogc -D FOO='BAR' -D BAR='BAZ'");
     free(rv);
@@ -137,7 +137,7 @@ test_build_blogc_cmd_with_settings_and_dev(void **state)
     settings->tags = NULL;
 
     char *rv = bm_exec_build_blogc_cmd("blogc", settings, variables, local, NULL,
-        true, NULL, "main.tmpl", "foo.html", true, true);
+        true, NULL, "main.tmpl", "foo.html", true, false, true);
     assert_string_equal(rv,
         "LC_ALL='en_US.utf8' blogc -D FOO='BAR' -D BAR='BAZ' -D LOL='HEHE' "
         "-D ASD='QWE' -D MAKE_ENV_DEV=1 -D MAKE_ENV='dev' -l -t 'main.tmpl' "
@@ -145,7 +145,7 @@ test_build_blogc_cmd_with_settings_and_dev(void **state)
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", settings, variables, local, NULL, true,
-        "foo.txt", "main.tmpl", "foo.html", true, true);
+        "foo.txt", "main.tmpl", "foo.html", true, false, true);
     assert_string_equal(rv,
         "LC_ALL='en_US.utf8' blogc -D FOO='BAR' -D BAR='BAZ' -D LOL='HEHE' "
         "-D ASD='QWE' -D MAKE_ENV_DEV=1 -D MAKE_ENV='dev' -l -e 'foo.txt' "
@@ -153,14 +153,14 @@ test_build_blogc_cmd_with_settings_and_dev(void **state)
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", settings, variables, NULL, NULL, false,
-        NULL, NULL, NULL, true, false);
+        NULL, NULL, NULL, true, false, false);
     assert_string_equal(rv,
         "LC_ALL='en_US.utf8' blogc -D FOO='BAR' -D BAR='BAZ' -D LOL='HEHE' "
         "-D MAKE_ENV_DEV=1 -D MAKE_ENV='dev'");
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", settings, NULL, NULL, NULL, false,
-        NULL, NULL, NULL, true, false);
+        NULL, NULL, NULL, true, false, false);
     assert_string_equal(rv,
         "LC_ALL='en_US.utf8' blogc -D FOO='BAR' -D BAR='BAZ' "
         "-D MAKE_ENV_DEV=1 -D MAKE_ENV='dev'");
@@ -190,7 +190,7 @@ test_build_blogc_cmd_with_settings_and_tags(void **state)
     settings->tags = bc_str_split("asd foo bar", ' ', 0);
 
     char *rv = bm_exec_build_blogc_cmd("blogc", settings, variables, local, NULL,
-        true, NULL, "main.tmpl", "foo.html", true, true);
+        true, NULL, "main.tmpl", "foo.html", true, false, true);
     assert_string_equal(rv,
         "LC_ALL='en_US.utf8' blogc -D MAKE_TAGS='asd foo bar' -D FOO='BAR' "
         "-D BAR='BAZ' -D LOL='HEHE' -D ASD='QWE' -D MAKE_ENV_DEV=1 "
@@ -198,7 +198,7 @@ test_build_blogc_cmd_with_settings_and_tags(void **state)
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", settings, variables, local, NULL, true,
-        "foo.txt", "main.tmpl", "foo.html", true, true);
+        "foo.txt", "main.tmpl", "foo.html", true, false, true);
     assert_string_equal(rv,
         "LC_ALL='en_US.utf8' blogc -D MAKE_TAGS='asd foo bar' -D FOO='BAR' "
         "-D BAR='BAZ' -D LOL='HEHE' -D ASD='QWE' -D MAKE_ENV_DEV=1 "
@@ -206,14 +206,14 @@ test_build_blogc_cmd_with_settings_and_tags(void **state)
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", settings, variables, NULL, NULL, false,
-        NULL, NULL, NULL, true, false);
+        NULL, NULL, NULL, true, false, false);
     assert_string_equal(rv,
         "LC_ALL='en_US.utf8' blogc -D MAKE_TAGS='asd foo bar' -D FOO='BAR' "
         "-D BAR='BAZ' -D LOL='HEHE' -D MAKE_ENV_DEV=1 -D MAKE_ENV='dev'");
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", settings, NULL, NULL, NULL, false,
-        NULL, NULL, NULL, true, false);
+        NULL, NULL, NULL, true, false, false);
     assert_string_equal(rv,
         "LC_ALL='en_US.utf8' blogc -D MAKE_TAGS='asd foo bar' -D FOO='BAR' "
         "-D BAR='BAZ' -D MAKE_ENV_DEV=1 -D MAKE_ENV='dev'");
@@ -237,26 +237,26 @@ test_build_blogc_cmd_without_settings(void **state)
     bc_trie_insert(local, "ASD", bc_strdup("QWE"));
 
     char *rv = bm_exec_build_blogc_cmd("blogc", NULL, variables, local, NULL,
-        true, NULL, "main.tmpl", "foo.html", false, true);
+        true, NULL, "main.tmpl", "foo.html", false, false, true);
     assert_string_equal(rv,
         "blogc -D LOL='HEHE' -D ASD='QWE' -l -t 'main.tmpl' -o 'foo.html' -i");
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", NULL, variables, local, NULL, true,
-        "foo.txt", "main.tmpl", "foo.html", false, true);
+        "foo.txt", "main.tmpl", "foo.html", false, false, true);
     assert_string_equal(rv,
         "blogc -D LOL='HEHE' -D ASD='QWE' -l -e 'foo.txt' -t 'main.tmpl' "
         "-o 'foo.html' -i");
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", NULL, variables, NULL, NULL, false,
-        NULL, NULL, NULL, false, false);
+        NULL, NULL, NULL, false, false, false);
     assert_string_equal(rv,
         "blogc -D LOL='HEHE'");
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", NULL, NULL, NULL, NULL, false, NULL,
-        NULL, NULL, false, false);
+        NULL, NULL, false, false, false);
     assert_string_equal(rv,
         "blogc");
     free(rv);
@@ -275,23 +275,23 @@ test_build_blogc_cmd_print(void **state)
     bc_trie_insert(local, "ASD", bc_strdup("QWE"));
 
     char *rv = bm_exec_build_blogc_cmd("blogc", NULL, variables, local, "LOL",
-        false, NULL, NULL, NULL, false, true);
+        false, NULL, NULL, NULL, false, false, true);
     assert_string_equal(rv, "blogc -D LOL='HEHE' -D ASD='QWE' -p LOL -i");
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", NULL, variables, local, "LOL", true,
-        NULL, NULL, NULL, false, false);
+        NULL, NULL, NULL, false, false, false);
     assert_string_equal(rv, "blogc -D LOL='HEHE' -D ASD='QWE' -p LOL -l");
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", NULL, variables, NULL, "LOL", false,
-        NULL, NULL, NULL, false, true);
+        NULL, NULL, NULL, false, false, true);
     assert_string_equal(rv,
         "blogc -D LOL='HEHE' -p LOL -i");
     free(rv);
 
     rv = bm_exec_build_blogc_cmd("blogc", NULL, NULL, NULL, "LOL", false, NULL,
-        NULL, NULL, false, false);
+        NULL, NULL, false, false, false);
     assert_string_equal(rv,
         "blogc -p LOL");
     free(rv);
@@ -301,6 +301,68 @@ test_build_blogc_cmd_print(void **state)
 }
 
 
+static void
+test_build_blogc_argv(void **state)
+{
+    bm_settings_t *settings = bc_malloc(sizeof(bm_settings_t));
+    settings->settings = bc_trie_new(free);
+    bc_trie_insert(settings->settings, "locale", bc_strdup("en_US.utf8"));
+    settings->global = bc_trie_new(free);
+    bc_trie_insert(settings->global, "FOO", bc_strdup("BAR"));
+    settings->tags = bc_str_split("asd foo", ' ', 0);
+    bc_trie_t *variables = bc_trie_new(free);
+    bc_trie_insert(variables, "LOL", bc_strdup("HE'HE"));
+    bc_trie_t *local = bc_trie_new(free);
+    bc_trie_insert(local, "ASD", bc_strdup("QWE"));
+
+    char **rv = bm_exec_build_blogc_argv("/usr/bin/blogc", settings, variables,
+        local, true, "foo.txt", "main.tmpl", "foo.html", true, true, true);
+    assert_int_equal(bc_strv_length(rv), 22);
+    assert_string_equal(rv[0], "/usr/bin/blogc");
+    assert_string_equal(rv[1], "-D");
+    assert_string_equal(rv[2], "MAKE_TAGS=asd foo");
+    assert_string_equal(rv[3], "-D");
+    assert_string_equal(rv[4], "FOO=BAR");
+    assert_string_equal(rv[5], "-D");
+    assert_string_equal(rv[6], "LOL=HE'HE");
+    assert_string_equal(rv[7], "-D");
+    assert_string_equal(rv[8], "ASD=QWE");
+    assert_string_equal(rv[9], "-D");
+    assert_string_equal(rv[10], "MAKE_ENV_DEV=1");
+    assert_string_equal(rv[11], "-D");
+    assert_string_equal(rv[12], "MAKE_ENV=dev");
+    assert_string_equal(rv[13], "-l");
+    assert_string_equal(rv[14], "-e");
+    assert_string_equal(rv[15], "foo.txt");
+    assert_string_equal(rv[16], "-t");
+    assert_string_equal(rv[17], "main.tmpl");
+    assert_string_equal(rv[18], "-o");
+    assert_string_equal(rv[19], "foo.html");
+    assert_string_equal(rv[20], "-M");
+    assert_string_equal(rv[21], "-i");
+    assert_null(rv[22]);
+    bc_strv_free(rv);
+
+    rv = bm_exec_build_blogc_argv("blogc", NULL, NULL, NULL, false, NULL,
+        "main.tmpl", "foo.html", false, false, false);
+    assert_int_equal(bc_strv_length(rv), 5);
+    assert_string_equal(rv[0], "blogc");
+    assert_string_equal(rv[1], "-t");
+    assert_string_equal(rv[2], "main.tmpl");
+    assert_string_equal(rv[3], "-o");
+    assert_string_equal(rv[4], "foo.html");
+    assert_null(rv[5]);
+    bc_strv_free(rv);
+
+    bc_trie_free(local);
+    bc_trie_free(variables);
+    bc_trie_free(settings->settings);
+    bc_trie_free(settings->global);
+    bc_strv_free(settings->tags);
+    free(settings);
+}
+
+
 int
 main(void)
 {
@@ -313,6 +375,7 @@ main(void)
         cmocka_unit_test(test_build_blogc_cmd_with_settings_and_tags),
         cmocka_unit_test(test_build_blogc_cmd_without_settings),
         cmocka_unit_test(test_build_blogc_cmd_print),
+        cmocka_unit_test(test_build_blogc_argv),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
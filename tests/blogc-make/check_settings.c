@@ -159,7 +159,7 @@ test_settings2(void **state)
     assert_string_equal(bc_trie_lookup(s->global, "SITE_TITLE"), "Fuuuuuuuuu");
     assert_string_equal(bc_trie_lookup(s->global, "SITE_TAGLINE"), "My cool tagline");
     assert_string_equal(bc_trie_lookup(s->global, "BASE_DOMAIN"), "http://example.com");
-    assert_int_equal(bc_trie_size(s->settings), 16);
+    assert_int_equal(bc_trie_size(s->settings), 17);
     assert_string_equal(bc_trie_lookup(s->settings, "source_ext"), ".txt");
     assert_string_equal(bc_trie_lookup(s->settings, "html_ext"), "/index.html");
     assert_string_equal(bc_trie_lookup(s->settings, "content_dir"), "guda");
@@ -177,6 +177,8 @@ test_settings2(void **state)
     assert_string_equal(bc_trie_lookup(s->settings, "html_order"), "DESC");
     assert_string_equal(bc_trie_lookup(s->settings, "atom_order"), "DESC");
     assert_string_equal(bc_trie_lookup(s->settings, "index_prefix"), "");
+    assert_string_equal(bc_trie_lookup(s->settings, "compress_ext"),
+        ".css .html .js .json .svg .txt .xml");
     assert_non_null(s->posts);
     assert_string_equal(s->posts[0], "aaaa");
     assert_string_equal(s->posts[1], "bbbb");
@@ -248,7 +250,7 @@ test_settings_env2(void **state)
     assert_string_equal(bc_trie_lookup(s->global, "SITE_TITLE"), "Fuuuuuuuuu");
     assert_string_equal(bc_trie_lookup(s->global, "SITE_TAGLINE"), "My cool tagline");
     assert_string_equal(bc_trie_lookup(s->global, "BASE_DOMAIN"), "http://example.com");
-    assert_int_equal(bc_trie_size(s->settings), 16);
+    assert_int_equal(bc_trie_size(s->settings), 17);
     assert_string_equal(bc_trie_lookup(s->settings, "source_ext"), ".txt");
     assert_string_equal(bc_trie_lookup(s->settings, "html_ext"), "/index.html");
     assert_string_equal(bc_trie_lookup(s->settings, "content_dir"), "guda");
@@ -266,6 +268,8 @@ test_settings_env2(void **state)
     assert_string_equal(bc_trie_lookup(s->settings, "html_order"), "DESC");
     assert_string_equal(bc_trie_lookup(s->settings, "atom_order"), "DESC");
     assert_string_equal(bc_trie_lookup(s->settings, "index_prefix"), "");
+    assert_string_equal(bc_trie_lookup(s->settings, "compress_ext"),
+        ".css .html .js .json .svg .txt .xml");
     assert_non_null(s->posts);
     assert_string_equal(s->posts[0], "aaaa");
     assert_string_equal(s->posts[1], "bbbb");
@@ -337,7 +341,7 @@ test_settings_copy_files(void **state)
     assert_string_equal(bc_trie_lookup(s->global, "SITE_TITLE"), "Fuuuuuuuuu");
     assert_string_equal(bc_trie_lookup(s->global, "SITE_TAGLINE"), "My cool tagline");
     assert_string_equal(bc_trie_lookup(s->global, "BASE_DOMAIN"), "http://example.com");
-    assert_int_equal(bc_trie_size(s->settings), 16);
+    assert_int_equal(bc_trie_size(s->settings), 17);
     assert_string_equal(bc_trie_lookup(s->settings, "source_ext"), ".txt");
     assert_string_equal(bc_trie_lookup(s->settings, "html_ext"), "/index.html");
     assert_string_equal(bc_trie_lookup(s->settings, "content_dir"), "guda");
@@ -355,6 +359,8 @@ test_settings_copy_files(void **state)
     assert_string_equal(bc_trie_lookup(s->settings, "html_order"), "DESC");
     assert_string_equal(bc_trie_lookup(s->settings, "atom_order"), "DESC");
     assert_string_equal(bc_trie_lookup(s->settings, "index_prefix"), "");
+    assert_string_equal(bc_trie_lookup(s->settings, "compress_ext"),
+        ".css .html .js .json .svg .txt .xml");
     assert_non_null(s->posts);
     assert_string_equal(s->posts[0], "aaaa");
     assert_string_equal(s->posts[1], "bbbb");
@@ -379,6 +385,85 @@ test_settings_copy_files(void **state)
 }
 
 
+static void
+test_settings_diff(void **state)
+{
+    const char *a =
+        "[global]\n"
+        "AUTHOR_NAME = chunda\n"
+        "AUTHOR_EMAIL = chunda@example.com\n"
+        "SITE_TITLE = Fuuuuuuuuu\n"
+        "SITE_TAGLINE = My cool tagline\n"
+        "BASE_DOMAIN = http://example.com\n"
+        "\n"
+        "[posts]\n"
+        "aaaa\n"
+        "bbbb\n"
+        "[pages]\n"
+        "cccc\n"
+        "[copy]\n"
+        "dddd\n"
+        "[tags]\n"
+        "eeee\n";
+    const char *b =
+        "[global]\n"
+        "AUTHOR_NAME = chunda\n"
+        "AUTHOR_EMAIL = chunda@example.com\n"
+        "SITE_TITLE = Fuuuuuuuuu\n"
+        "SITE_TAGLINE = My cool tagline\n"
+        "BASE_DOMAIN = http://example.com\n"
+        "\n"
+        "[posts]\n"
+        "aaaa\n"
+        "bbbb\n"
+        "ffff\n"
+        "[pages]\n"
+        "cccc\n"
+        "[copy]\n"
+        "dddd\n";
+    const char *c =
+        "[settings]\n"
+        "posts_per_page = 5\n"
+        "\n"
+        "[global]\n"
+        "AUTHOR_NAME = chunda\n"
+        "AUTHOR_EMAIL = chunda@example.com\n"
+        "SITE_TITLE = Bola\n"
+        "SITE_TAGLINE = My cool tagline\n"
+        "BASE_DOMAIN = http://example.com\n"
+        "\n"
+        "[posts]\n"
+        "aaaa\n"
+        "bbbb\n"
+        "[pages]\n"
+        "gggg\n"
+        "[copy]\n"
+        "hhhh\n"
+        "[tags]\n"
+        "eeee\n";
+    bc_error_t *err = NULL;
+    bm_settings_t *sa = bm_settings_parse(a, strlen(a), &err);
+    assert_null(err);
+    bm_settings_t *sb = bm_settings_parse(b, strlen(b), &err);
+    assert_null(err);
+    bm_settings_t *sc = bm_settings_parse(c, strlen(c), &err);
+    assert_null(err);
+    assert_int_equal(bm_settings_diff(sa, sa), 0);
+    assert_int_equal(bm_settings_diff(sa, sb),
+        BM_SETTINGS_CHANGED_POSTS | BM_SETTINGS_CHANGED_TAGS);
+    assert_int_equal(bm_settings_diff(sb, sa),
+        BM_SETTINGS_CHANGED_POSTS | BM_SETTINGS_CHANGED_TAGS);
+    assert_int_equal(bm_settings_diff(sa, sc),
+        BM_SETTINGS_CHANGED_GLOBAL | BM_SETTINGS_CHANGED_SETTINGS |
+        BM_SETTINGS_CHANGED_PAGES | BM_SETTINGS_CHANGED_COPY);
+    assert_int_equal(bm_settings_diff(sa, NULL), BM_SETTINGS_CHANGED_ALL);
+    assert_int_equal(bm_settings_diff(NULL, NULL), 0);
+    bm_settings_free(sa);
+    bm_settings_free(sb);
+    bm_settings_free(sc);
+}
+
+
 int
 main(void)
 {
@@ -389,6 +474,7 @@ main(void)
         cmocka_unit_test(test_settings2),
         cmocka_unit_test(test_settings_env2),
         cmocka_unit_test(test_settings_copy_files),
+        cmocka_unit_test(test_settings_diff),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
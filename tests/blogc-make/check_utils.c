@@ -457,12 +457,44 @@ test_generate_filename2(void **state)
 }
 
 
+static void
+test_shard_contains(void **state)
+{
+    const char *outputs[] = {
+        "_build/index.html",
+        "_build/atom.xml",
+        "_build/page/1/index.html",
+        "_build/page/2/index.html",
+        "_build/post/foo/index.html",
+        "_build/post/bar/index.html",
+        "_build/tag/baz/index.html",
+        "_build/assets/style.css",
+        NULL,
+    };
+    for (size_t i = 0; outputs[i] != NULL; i++) {
+        assert_true(bm_shard_contains(outputs[i], 0, 0));
+        assert_true(bm_shard_contains(outputs[i], 0, 1));
+
+        // each output belongs to exactly one shard
+        for (size_t shards = 2; shards <= 5; shards++) {
+            size_t count = 0;
+            for (size_t shard = 0; shard < shards; shard++)
+                if (bm_shard_contains(outputs[i], shard, shards))
+                    count++;
+            assert_int_equal(count, 1);
+        }
+    }
+    assert_true(bm_shard_contains(NULL, 1, 2));
+}
+
+
 int
 main(void)
 {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_generate_filename),
         cmocka_unit_test(test_generate_filename2),
+        cmocka_unit_test(test_shard_contains),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -1019,6 +1019,80 @@ test_source_parse_from_files_null(void **state)
 }
 
 
+static bc_trie_t*
+new_source(const char *filename, const char *date, const char *tags)
+{
+    bc_trie_t *rv = bc_trie_new(free);
+    bc_trie_insert(rv, "FILENAME", bc_strdup(filename));
+    if (date != NULL)
+        bc_trie_insert(rv, "DATE", bc_strdup(date));
+    if (tags != NULL)
+        bc_trie_insert(rv, "TAGS", bc_strdup(tags));
+    return rv;
+}
+
+
+static void
+test_source_filter(void **state)
+{
+    bc_error_t *err = NULL;
+    bc_slist_t *s = NULL;
+    s = bc_slist_append(s, new_source("bola1", "2002-02-03 04:05:06", "chunda"));
+    s = bc_slist_append(s, new_source("bola2", "2001-02-03 04:05:06", "bola"));
+    s = bc_slist_append(s, new_source("bola3", "2003-02-03 04:05:06", "chunda"));
+    bc_trie_t *c = bc_trie_new(free);
+    bc_trie_insert(c, "FILTER_SORT", bc_strdup("1"));
+    bc_trie_insert(c, "FILTER_TAG", bc_strdup("chunda"));
+    bc_trie_insert(c, "FILTER_PAGE", bc_strdup("1"));
+    bc_trie_insert(c, "FILTER_PER_PAGE", bc_strdup("1"));
+    bc_slist_t *t = blogc_source_filter(c, s, NULL, &err);
+    assert_null(err);
+    assert_non_null(t);
+    assert_int_equal(bc_slist_length(t), 1);
+    // sources are borrowed, so the filtered list points to them.
+    assert_ptr_equal(t->data, s->next->next->data);
+    assert_null(bc_trie_lookup(t->data, "c"));
+    assert_int_equal(bc_trie_size(c), 12);
+    assert_string_equal(bc_trie_lookup(c, "FILENAME_FIRST"), "bola3");
+    assert_string_equal(bc_trie_lookup(c, "FILENAME_LAST"), "bola3");
+    assert_string_equal(bc_trie_lookup(c, "CURRENT_PAGE"), "1");
+    assert_string_equal(bc_trie_lookup(c, "NEXT_PAGE"), "2");
+    assert_string_equal(bc_trie_lookup(c, "LAST_PAGE"), "2");
+    bc_trie_free(c);
+    bc_slist_free(t);
+    bc_slist_free_full(s, (bc_free_func_t) bc_trie_free);
+}
+
+
+static void
+test_source_filter_without_date(void **state)
+{
+    bc_error_t *err = NULL;
+    bc_slist_t *s = NULL;
+    s = bc_slist_append(s, new_source("bola1", "2002-02-03 04:05:06", NULL));
+    s = bc_slist_append(s, new_source("bola2", NULL, NULL));
+    bc_slist_t *f = NULL;
+    f = bc_slist_append(f, bc_strdup("bola1.txt"));
+    f = bc_slist_append(f, bc_strdup("bola2.txt"));
+    bc_trie_t *c = bc_trie_new(free);
+    bc_trie_insert(c, "FILTER_SORT", bc_strdup("1"));
+    bc_slist_t *t = blogc_source_filter(c, s, f, &err);
+    assert_null(t);
+    assert_non_null(err);
+    assert_int_equal(err->type, BLOGC_ERROR_LOADER);
+    assert_string_equal(err->msg,
+        "'FILTER_SORT' requires that 'DATE' variable is set for every source "
+        "file: bola2.txt");
+    bc_error_free(err);
+    assert_int_equal(bc_trie_size(c), 1);
+    assert_int_equal(bc_trie_size(s->data), 2);
+    assert_int_equal(bc_trie_size(s->next->data), 1);
+    bc_trie_free(c);
+    bc_slist_free_full(f, free);
+    bc_slist_free_full(s, (bc_free_func_t) bc_trie_free);
+}
+
+
 int
 main(void)
 {
@@ -1045,6 +1119,8 @@ main(void)
         cmocka_unit_test(test_source_parse_from_files_filter_sort_without_all_dates),
         cmocka_unit_test(test_source_parse_from_files_filter_sort_with_wrong_date),
         cmocka_unit_test(test_source_parse_from_files_null),
+        cmocka_unit_test(test_source_filter),
+        cmocka_unit_test(test_source_filter_without_date),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -0,0 +1,163 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "../../src/common/utils.h"
+#include "../../src/blogc/minifier.h"
+
+
+static void
+test_minify(void **state)
+{
+    char *o = blogc_minify(
+        "\n"
+        "<!DOCTYPE html>\n"
+        "<html>\n"
+        "    <head>\n"
+        "        <!-- a comment -->\n"
+        "        <title>Foo   bar</title>\n"
+        "    </head>\n"
+        "    <body>\n"
+        "        <p>bola <b>guda</b>  <i>chunda</i></p>\n"
+        "        <a href=\"#\"   title=\"a > b\">link</a> <!-- bola -->  asd\n"
+        "    </body>\n"
+        "</html>\n");
+    assert_string_equal(o,
+        "<!DOCTYPE html>\n"
+        "<html>\n"
+        "<head>\n"
+        "<title>Foo bar</title>\n"
+        "</head>\n"
+        "<body>\n"
+        "<p>bola <b>guda</b> <i>chunda</i></p>\n"
+        "<a href=\"#\"   title=\"a > b\">link</a> asd\n"
+        "</body>\n"
+        "</html>\n");
+    free(o);
+    o = blogc_minify("bola");
+    assert_string_equal(o, "bola");
+    free(o);
+    o = blogc_minify("  \n ");
+    assert_string_equal(o, "");
+    free(o);
+    o = blogc_minify("");
+    assert_string_equal(o, "");
+    free(o);
+    assert_null(blogc_minify(NULL));
+}
+
+
+static void
+test_minify_raw(void **state)
+{
+    char *o = blogc_minify(
+        "<div>\n"
+        "    <pre class=\"foo\">  bola\n"
+        "      <!-- guda -->\n"
+        "    </pre >\n"
+        "    <code>a   b</code>  <code/>  <textarea>\n"
+        "  x </TEXTAREA>\n"
+        "    <script>\n"
+        "        if (a < b) { // <!-- x -->\n"
+        "        }\n"
+        "    </script>\n"
+        "    <pre>  </prefix>  </pre>\n"
+        "    <![CDATA[  <!-- a -->  ]]>  </div>\n");
+    assert_string_equal(o,
+        "<div>\n"
+        "<pre class=\"foo\">  bola\n"
+        "      <!-- guda -->\n"
+        "    </pre >\n"
+        "<code>a   b</code> <code/> <textarea>\n"
+        "  x </TEXTAREA>\n"
+        "<script>\n"
+        "        if (a < b) { // <!-- x -->\n"
+        "        }\n"
+        "    </script>\n"
+        "<pre>  </prefix>  </pre>\n"
+        "<![CDATA[  <!-- a -->  ]]> </div>\n");
+    free(o);
+}
+
+
+static void
+test_minify_text(void **state)
+{
+    char *o = blogc_minify("a  <  b <<p> 1 <3\n<!---->c<!-- -- ->--> d");
+    assert_string_equal(o, "a < b <<p> 1 <3\nc d");
+    free(o);
+    o = blogc_minify("<p>unterminated <a href=\"  ");
+    assert_string_equal(o, "<p>unterminated <a href=\"  ");
+    free(o);
+}
+
+
+static void
+test_minify_tags(void **state)
+{
+    char *o = blogc_minify(
+        "<html>\n"
+        "    <!-- a comment -->\n"
+        "    <p title='a > b'>bola   guda</p>\n"
+        "    <pre>  a\n"
+        "    b</pre>\n"
+        "    <![CDATA[  ]]]]>  x\n"
+        "</html>\n");
+    assert_string_equal(o,
+        "<html>\n"
+        "<p title='a > b'>bola guda</p>\n"
+        "<pre>  a\n"
+        "    b</pre>\n"
+        "<![CDATA[  ]]]]> x\n"
+        "</html>\n");
+    free(o);
+}
+
+
+static void
+test_minify_conditional_comments(void **state)
+{
+    char *o = blogc_minify(
+        "<head>\n"
+        "    <!--[if lt IE 9]>\n"
+        "    <script src=\"html5shiv.js\"></script>\n"
+        "    <![endif]-->\n"
+        "    <!-- a comment -->\n"
+        "    <!--[if !IE]><!--><link href=\"a.css\"><!--<![endif]-->\n"
+        "    <!--[i--> <!--<![e-->  x\n"
+        "</head>\n");
+    assert_string_equal(o,
+        "<head>\n"
+        "<!--[if lt IE 9]>\n"
+        "    <script src=\"html5shiv.js\"></script>\n"
+        "    <![endif]-->\n"
+        "<!--[if !IE]><!--><link href=\"a.css\"><!--<![endif]-->\n"
+        "x\n"
+        "</head>\n");
+    free(o);
+}
+
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_minify),
+        cmocka_unit_test(test_minify_raw),
+        cmocka_unit_test(test_minify_text),
+        cmocka_unit_test(test_minify_tags),
+        cmocka_unit_test(test_minify_conditional_comments),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
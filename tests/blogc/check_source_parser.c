@@ -723,6 +723,45 @@ test_source_parse_invalid_separator(void **state)
 }
 
 
+static void
+test_source_parse_metadata(void **state)
+{
+    const char *a =
+        "VAR1: asd asd\n"
+        "VAR2: 123chunda\n"
+        "----------\n"
+        "# This is a test\n"
+        "\n"
+        "bola\n";
+    bc_error_t *err = NULL;
+    bc_trie_t *source = blogc_source_parse_metadata(a, strlen(a), &err);
+    assert_null(err);
+    assert_non_null(source);
+    assert_int_equal(bc_trie_size(source), 2);
+    assert_string_equal(bc_trie_lookup(source, "VAR1"), "asd asd");
+    assert_string_equal(bc_trie_lookup(source, "VAR2"), "123chunda");
+    bc_trie_free(source);
+    a =
+        "VAR1: asd asd\r\n"
+        "----------\r\n";
+    source = blogc_source_parse_metadata(a, strlen(a), &err);
+    assert_null(err);
+    assert_non_null(source);
+    assert_int_equal(bc_trie_size(source), 1);
+    assert_string_equal(bc_trie_lookup(source, "VAR1"), "asd asd");
+    bc_trie_free(source);
+    a = "BOLA: asd\n---#";
+    source = blogc_source_parse_metadata(a, strlen(a), &err);
+    assert_null(source);
+    assert_non_null(err);
+    assert_int_equal(err->type, BLOGC_ERROR_SOURCE_PARSER);
+    assert_string_equal(err->msg,
+        "Invalid content separator. Must be more than one '-' characters.\n"
+        "Error occurred near line 2, position 4: ---#");
+    bc_error_free(err);
+}
+
+
 int
 main(void)
 {
@@ -756,6 +795,7 @@ main(void)
         cmocka_unit_test(test_source_parse_config_reserved_name11),
         cmocka_unit_test(test_source_parse_config_value_no_line_ending),
         cmocka_unit_test(test_source_parse_invalid_separator),
+        cmocka_unit_test(test_source_parse_metadata),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
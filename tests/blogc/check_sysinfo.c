@@ -80,11 +80,12 @@ static struct tm tm = {
 };
 
 struct tm*
-__wrap_gmtime(const time_t *timep)
+__wrap_gmtime_r(const time_t *timep, struct tm *result)
 {
     if (*timep == 2)
         return NULL;
-    return &tm;
+    *result = tm;
+    return result;
 }
 #endif
 
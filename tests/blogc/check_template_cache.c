@@ -0,0 +1,211 @@
+/*
+ * blogc: A blog compiler.
+ * Copyright (C) 2014-2020 Rafael G. Martins <rafael@rafaelmartins.eng.br>
+ *
+ * This program can be distributed under the terms of the BSD License.
+ * See the file LICENSE.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "../../src/common/error.h"
+#include "../../src/common/utils.h"
+#include "../../src/blogc/template-cache.h"
+#include "../../src/blogc/template-parser.h"
+
+
+static void
+write_template(const char *path, const char *content, time_t mtime)
+{
+    FILE *fp = fopen(path, "w");
+    assert_non_null(fp);
+    assert_int_equal(fwrite(content, sizeof(char), strlen(content), fp),
+        strlen(content));
+    assert_int_equal(fclose(fp), 0);
+
+    struct timespec times[2] = {{mtime, 0}, {mtime, 0}};
+    assert_int_equal(utimensat(AT_FDCWD, path, times, 0), 0);
+}
+
+
+// returns the path of a template file in a new temporary directory.
+static char*
+template_new(void)
+{
+    char dir[] = "check_template_cache_XXXXXX";
+    assert_non_null(mkdtemp(dir));
+    return bc_strdup_printf("%s/main.tmpl", dir);
+}
+
+
+static void
+template_free(char *path)
+{
+    assert_int_equal(unlink(path), 0);
+    *strrchr(path, '/') = '\0';
+    assert_int_equal(rmdir(path), 0);
+    free(path);
+}
+
+
+static void
+assert_variable(bc_slist_t *ast, const char *variable)
+{
+    assert_non_null(ast);
+    assert_non_null(ast->next);
+    blogc_template_node_t *node = ast->next->data;
+    assert_int_equal(node->type, BLOGC_TEMPLATE_NODE_VARIABLE);
+    assert_string_equal(node->data[0], variable);
+}
+
+
+static void
+test_template_cache_hit(void **state)
+{
+    char *path = template_new();
+    write_template(path, "foo {{ BAR }}", 1000);
+
+    blogc_template_cache_t *cache = blogc_template_cache_new();
+    bc_error_t *err = NULL;
+    bc_slist_t *ast = blogc_template_cache_get(cache, path, &err);
+    assert_null(err);
+    assert_variable(ast, "BAR");
+    assert_ptr_equal(blogc_template_cache_get(cache, path, &err), ast);
+    assert_null(err);
+    assert_null(cache->stale);
+    blogc_template_cache_free(cache);
+    template_free(path);
+}
+
+
+static void
+test_template_cache_mtime(void **state)
+{
+    char *path = template_new();
+    write_template(path, "foo {{ BAR }}", 1000);
+
+    blogc_template_cache_t *cache = blogc_template_cache_new();
+    bc_error_t *err = NULL;
+    bc_slist_t *ast1 = blogc_template_cache_get(cache, path, &err);
+    assert_null(err);
+    assert_variable(ast1, "BAR");
+
+    // same size, newer mtime.
+    write_template(path, "foo {{ BAZ }}", 2000);
+    bc_slist_t *ast2 = blogc_template_cache_get(cache, path, &err);
+    assert_null(err);
+    assert_ptr_not_equal(ast2, ast1);
+    assert_variable(ast2, "BAZ");
+
+    // the replaced AST is still valid until purged.
+    assert_int_equal(bc_slist_length(cache->stale), 1);
+    assert_ptr_equal(cache->stale->data, ast1);
+    assert_variable(ast1, "BAR");
+    assert_ptr_equal(blogc_template_cache_get(cache, path, &err), ast2);
+    blogc_template_cache_free(cache);
+    template_free(path);
+}
+
+
+static void
+test_template_cache_size(void **state)
+{
+    char *path = template_new();
+    write_template(path, "foo {{ BAR }}", 1000);
+
+    blogc_template_cache_t *cache = blogc_template_cache_new();
+    bc_error_t *err = NULL;
+    bc_slist_t *ast1 = blogc_template_cache_get(cache, path, &err);
+    assert_null(err);
+    assert_variable(ast1, "BAR");
+
+    // same mtime, other size.
+    write_template(path, "foo {{ BARBAZ }}", 1000);
+    bc_slist_t *ast2 = blogc_template_cache_get(cache, path, &err);
+    assert_null(err);
+    assert_ptr_not_equal(ast2, ast1);
+    assert_variable(ast2, "BARBAZ");
+    assert_int_equal(bc_slist_length(cache->stale), 1);
+    assert_ptr_equal(cache->stale->data, ast1);
+    blogc_template_cache_free(cache);
+    template_free(path);
+}
+
+
+static void
+test_template_cache_purge(void **state)
+{
+    char *path = template_new();
+    write_template(path, "foo {{ BAR }}", 1000);
+
+    blogc_template_cache_t *cache = blogc_template_cache_new();
+    bc_error_t *err = NULL;
+    blogc_template_cache_get(cache, path, &err);
+    write_template(path, "foo {{ BAZ }}", 2000);
+    blogc_template_cache_get(cache, path, &err);
+    write_template(path, "foo {{ BARBAZ }}", 2000);
+    bc_slist_t *ast = blogc_template_cache_get(cache, path, &err);
+    assert_null(err);
+    assert_int_equal(bc_slist_length(cache->stale), 2);
+
+    blogc_template_cache_purge(cache);
+    assert_null(cache->stale);
+
+    // the current AST is kept.
+    assert_ptr_equal(blogc_template_cache_get(cache, path, &err), ast);
+    assert_null(err);
+    assert_variable(ast, "BARBAZ");
+    assert_null(cache->stale);
+
+    blogc_template_cache_purge(cache);
+    assert_null(cache->stale);
+    blogc_template_cache_free(cache);
+    template_free(path);
+}
+
+
+static void
+test_template_cache_error(void **state)
+{
+    char *path = template_new();
+    write_template(path, "foo {% bola %}", 1000);
+
+    blogc_template_cache_t *cache = blogc_template_cache_new();
+    bc_error_t *err = NULL;
+    assert_null(blogc_template_cache_get(cache, path, &err));
+    assert_non_null(err);
+    bc_error_free(err);
+    err = NULL;
+
+    // errors aren't cached.
+    write_template(path, "foo {{ BAR }}", 1000);
+    bc_slist_t *ast = blogc_template_cache_get(cache, path, &err);
+    assert_null(err);
+    assert_variable(ast, "BAR");
+    assert_null(cache->stale);
+    blogc_template_cache_free(cache);
+    template_free(path);
+}
+
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_template_cache_hit),
+        cmocka_unit_test(test_template_cache_mtime),
+        cmocka_unit_test(test_template_cache_size),
+        cmocka_unit_test(test_template_cache_purge),
+        cmocka_unit_test(test_template_cache_error),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -10,6 +10,7 @@
 #include <stddef.h>
 #include <setjmp.h>
 #include <cmocka.h>
+#include <stdlib.h>
 #include <string.h>
 #include "../../src/common/error.h"
 
@@ -101,6 +102,31 @@ test_error_parser_crlf(void **state)
 }
 
 
+static void
+test_error_to_string(void **state)
+{
+    assert_null(bc_error_to_string(NULL, "bola"));
+    bc_error_t *error = bc_error_new(BC_ERROR_FILE, "guda");
+    char *s = bc_error_to_string(error, "bola");
+    assert_string_equal(s, "bola: error: file: guda");
+    free(s);
+    s = bc_error_to_string(error, NULL);
+    assert_string_equal(s, "error: file: guda");
+    free(s);
+    bc_error_free(error);
+    error = bc_error_new(BLOGC_WARNING_DATETIME_PARSER, "chunda");
+    s = bc_error_to_string(error, "bola");
+    assert_string_equal(s, "bola: warning: datetime: chunda");
+    free(s);
+    bc_error_free(error);
+    error = bc_error_new(1000, "chunda");
+    s = bc_error_to_string(error, "bola");
+    assert_string_equal(s, "bola: error: chunda");
+    free(s);
+    bc_error_free(error);
+}
+
+
 int
 main(void)
 {
@@ -109,6 +135,7 @@ main(void)
         cmocka_unit_test(test_error_new_printf),
         cmocka_unit_test(test_error_parser),
         cmocka_unit_test(test_error_parser_crlf),
+        cmocka_unit_test(test_error_to_string),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -1086,6 +1086,20 @@ test_shell_quote(void **state)
 }
 
 
+static void
+test_hash(void **state)
+{
+    // reference values for 64-bit FNV-1a
+    assert_true(bc_hash_str(NULL) == 0xcbf29ce484222325ULL);
+    assert_true(bc_hash_str("") == 0xcbf29ce484222325ULL);
+    assert_true(bc_hash_str("a") == 0xaf63dc4c8601ec8cULL);
+    assert_true(bc_hash_str("foobar") == 0x85944171f73967e8ULL);
+    uint64_t h = bc_hash_update(BC_HASH_INIT, "foo", 3);
+    assert_true(bc_hash_update(h, "bar", 3) == bc_hash_str("foobar"));
+    assert_true(bc_hash_update(h, NULL, 0) == bc_hash_str("foo"));
+}
+
+
 int
 main(void)
 {
@@ -1136,6 +1150,7 @@ main(void)
 
         // shell
         cmocka_unit_test(test_shell_quote),
+        cmocka_unit_test(test_hash),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }